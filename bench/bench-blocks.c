@@ -0,0 +1,160 @@
+/*
+ ============================================================================
+ Name        : bench-blocks.c
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Interpreter Block Throughput Benchmark
+ ============================================================================
+ */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gcode-commons.h"
+#include "gcode-parameters.h"
+#include "gcode-tools.h"
+#include "gcode-input.h"
+#include "gcode-machine.h"
+#include "gcode-state.h"
+#include "gcode-stacks.h"
+#include "gcode-cycles.h"
+#include "gcode-queue.h"
+#include "gcode-checker.h"
+#include "gcode-subprogram.h"
+#include "gcode-compiler.h"
+
+
+/* What CAM posts for 3D surfacing: long runs of feed moves, a few arcs, tool
+ * changes and the odd rapid. Parametric programs work the feed moves out */
+static void _generate(const char *name, size_t blocks, bool parametric) {
+  FILE *out = fopen(name, "w");
+  size_t n;
+
+  srand(42);
+  fprintf(out, "G21 G90 G94 G17\nT1 M6\nS12000 M3\nG0 X0 Y0 Z5\n");
+  if(parametric) fprintf(out, "#100=1.5 #101=0.75 #102=0.5\n");
+  for(n = 0; n < blocks; n++) {
+    double x = (rand() % 200000) / 1000.0 - 100.0;
+    double y = (rand() % 200000) / 1000.0 - 100.0;
+    double z = -(rand() % 5000) / 1000.0;
+
+    switch(rand() % 32) {
+      case 0:
+        fprintf(out, "N%zu G2 X%.3f Y%.3f I1.0 J0.0 F900\n", n + 1, x, y);
+        break;
+      case 1:
+        fprintf(out, "N%zu G0 Z5.0\nG0 X%.3f Y%.3f\n", n + 1, x, y);
+        break;
+      case 2:
+        fprintf(out, "N%zu M5\nT%d M6\nS%d M3 M8\n", n + 1, 1 + rand() % 8,
+                8000 + rand() % 8000);
+        break;
+      default:
+        if(parametric)
+          fprintf(out, "N%zu G1 X[%.3f+#100] Y[%.3f*#101] Z[%.3f/3] F%d\n",
+                  n + 1, x, y, z, 600 + rand() % 1200);
+        else
+          fprintf(out, "N%zu G1 X%.3f Y%.3f Z%.3f F%d\n", n + 1, x, y, z,
+                  600 + rand() % 1200);
+        break;
+    }
+  }
+  fprintf(out, "M30\n");
+  fclose(out);
+}
+
+static double _now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1.0E+9;
+}
+
+/* Same sequence as gcode-canon, less saving the parameters on the way out */
+static uint64_t _run(const char *name) {
+  TGCodeBlockView block;
+  uint64_t blocks = 0;
+
+  init_parameters(NULL);
+  init_machine(NULL);
+  init_stacks(NULL);
+  init_tools(NULL);
+  init_input(fopen(name, "r"));
+  init_gcode_state(NULL);
+  init_cycles(NULL);
+  init_queue();
+  init_checker(NULL);
+  init_subprogram(NULL);
+
+  while(machine_running() && gcode_running() && fetch_line_input(&block)) {
+    if(gcode_check(&block)) update_gcode_state(&block);
+    move_machine_queue();
+    blocks++;
+  }
+  while(move_machine_queue());
+
+  done_subprogram();
+  done_checker();
+  done_queue();
+  done_cycles();
+  done_input();
+  done_tools();
+  done_stacks();
+  done_machine();
+
+  return blocks;
+}
+
+int main(int argc, char *argv[]) {
+  const char *name = "bench-blocks.nc", *compiled = "bench-blocks.ncb",
+             *parametric = "bench-blocks-parametric.nc",
+             *runs[] = {name, compiled, parametric},
+             *modes[] = {"text", "compiled", "expressions"};
+  size_t count = (argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000);
+  FILE *source, *target;
+  int console, quiet;
+  unsigned int i;
+
+  _generate(name, count, false);
+  _generate(parametric, count, true);
+  source = fopen(name, "r");
+  target = fopen(compiled, "w");
+  run_compiler(source, target);
+  fclose(source);
+  fclose(target);
+
+  /* The machine reports every move on stdout, that's not what we measure */
+  fflush(stdout);
+  console = dup(STDOUT_FILENO);
+  quiet = open("/dev/null", O_WRONLY);
+  for(i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+    uint64_t blocks;
+    double start;
+
+    fflush(stdout);
+    dup2(quiet, STDOUT_FILENO);
+    start = _now();
+    blocks = _run(runs[i]);
+    start = _now() - start;
+    fflush(stdout);
+    dup2(console, STDOUT_FILENO);
+
+    printf("BENCH,blocks,%s,%.2f Mblocks/s,%llu blocks\n",
+           modes[i], blocks / start / 1.0E+6,
+           (unsigned long long)blocks);
+  }
+  close(quiet);
+  close(console);
+  remove(name);
+  remove(compiled);
+  remove(parametric);
+
+  return 0;
+}
@@ -0,0 +1,165 @@
+/*
+ ============================================================================
+ Name        : bench-checker.c
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Block Checker Overhead Benchmark
+ ============================================================================
+ */
+
+#include <stdbool.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gcode-commons.h"
+#include "gcode-input.h"
+#include "gcode-state.h"
+#include "gcode-checker.h"
+
+
+/* Each round runs both variants over the next this many blocks. At least and
+ * at most so many rounds, the median of the difference is looked at every
+ * so many of them and must agree to within this many seconds per block that
+ * many times in a row */
+#define BENCH_CHUNK 4096
+#define BENCH_MIN_ROUNDS 200
+#define BENCH_ROUNDS 4000
+#define BENCH_EVERY 100
+#define BENCH_SETTLED 3
+#define BENCH_TOLERANCE 0.5E-9
+
+
+static double _now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1.0E+9;
+}
+
+/* Sanitized the way gcode-input hands blocks over: CAM style moves, with the
+ * odd modal code, spindle and coolant change thrown in */
+static char *_generate(size_t count, TGCodeBlockView *blocks) {
+  char *pool = calloc(count, 64), *line;
+  size_t n;
+
+  srand(42);
+  for(n = 0; n < count; n++) {
+    double x = (rand() % 200000) / 1000.0 - 100.0;
+    double y = (rand() % 200000) / 1000.0 - 100.0;
+    double z = -(rand() % 5000) / 1000.0;
+
+    line = &pool[n * 64];
+    switch(rand() % 16) {
+      case 0:
+        snprintf(line, 64, "G17G90G2X%.3fY%.3fI1.J0.F900", x, y);
+        break;
+      case 1:
+        snprintf(line, 64, "S%dM3M8", 8000 + rand() % 8000);
+        break;
+      default:
+        snprintf(line, 64, "G1X%.3fY%.3fZ%.3fF%d", x, y, z, 600 + rand() % 1200);
+        break;
+    }
+    blocks[n].text = line;
+    blocks[n].length = strlen(line);
+    blocks[n].words = NULL;
+    blocks[n].wordCount = 0;
+    blocks[n].table = NULL;
+  }
+
+  return pool;
+}
+
+/* One pass over all blocks, decoding only or checking too */
+static double _pass(TGCodeBlockView *blocks, size_t count, bool check,
+                    uint64_t *words, uint64_t *rejected) {
+  const TGCodeWordTable *table;
+  double elapsed = _now();
+  size_t n;
+
+  *words = *rejected = 0;
+  for(n = 0; n < count; n++)
+    if(check) *rejected += !gcode_check(&blocks[n]);
+    else if((table = load_gcode_words(&blocks[n])))
+      *words += table->wordsEnd - table->words;
+
+  return _now() - elapsed;
+}
+
+static int _compare(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+static double _median(const double *values, unsigned int count) {
+  static double sorted[BENCH_ROUNDS];
+
+  memcpy(sorted, values, count * sizeof(double));
+  qsort(sorted, count, sizeof(double), _compare);
+
+  return (count % 2 ? sorted[count / 2] :
+          (sorted[count / 2 - 1] + sorted[count / 2]) / 2);
+}
+
+/* The two variants take turns going first over the same blocks, the overhead
+ * is the median of the per round differences, reported once it settled */
+int main(int argc, char *argv[]) {
+  static const char *names[2] = {"decode", "decode+check"};
+  static double elapsed[2][BENCH_ROUNDS], difference[BENCH_ROUNDS];
+  size_t count = (argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000), at;
+  TGCodeBlockView *blocks, *chunk;
+  char *pool;
+  double overhead = 0.0, previous = 0.0, best;
+  uint64_t rejected, words, found[2];
+  unsigned int i, round, v, settled = 0;
+
+  if(count < BENCH_CHUNK) count = BENCH_CHUNK;
+  blocks = calloc(count, sizeof(TGCodeBlockView));
+  pool = _generate(count, blocks);
+  init_checker(NULL);
+  /* Warms up caches, branch predictors and the CPU clock, and counts */
+  _pass(blocks, count, false, &words, &found[1]);
+  _pass(blocks, count, true, &found[0], &rejected);
+  for(round = 0; round < BENCH_ROUNDS && settled < BENCH_SETTLED; round++) {
+    at = (size_t)round * BENCH_CHUNK % (count - BENCH_CHUNK + 1);
+    chunk = &blocks[at];
+    for(i = 0; i < 2; i++) {
+      v = (round + i) % 2;
+      elapsed[v][round] = _pass(chunk, BENCH_CHUNK, v, &found[0], &found[1]);
+    }
+    difference[round] = elapsed[1][round] - elapsed[0][round];
+    if((round + 1) % BENCH_EVERY || round + 1 < BENCH_MIN_ROUNDS) continue;
+    overhead = _median(difference, round + 1) / BENCH_CHUNK;
+    settled = (fabs(overhead - previous) <= BENCH_TOLERANCE ? settled + 1 : 0);
+    previous = overhead;
+  }
+
+  for(v = 0; v < 2; v++) {
+    best = elapsed[v][0];
+    for(i = 1; i < round; i++) best = fmin(best, elapsed[v][i]);
+    printf("BENCH,checker,%s,%.1f ns/block median,%.1f ns/block best\n",
+           names[v], _median(elapsed[v], round) / BENCH_CHUNK * 1.0E+9,
+           best / BENCH_CHUNK * 1.0E+9);
+  }
+  if(settled >= BENCH_SETTLED)
+    printf("BENCH,checker,overhead,%.1f ns/block,%u rounds,%llu words,"
+           "%llu rejected\n", overhead * 1.0E+9, round,
+           (unsigned long long)words, (unsigned long long)rejected);
+  else
+    printf("BENCH,checker,overhead,unstable after %u rounds,%llu words,"
+           "%llu rejected\n", round, (unsigned long long)words,
+           (unsigned long long)rejected);
+  done_checker();
+
+  free(pool);
+  free(blocks);
+
+  return rejected ? 1 : 0;
+}
@@ -0,0 +1,378 @@
+/*
+ ============================================================================
+ Name        : bench-expression.c
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Expression Evaluator Benchmark
+ ============================================================================
+ */
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gcode-commons.h"
+#include "gcode-parameters.h"
+#include "gcode-input.h"
+#include "gcode-expression.h"
+
+
+/* The same kind of expressions as tests/300-expression-torture.nc, as
+ * gcode-input hands them over: blanks stripped, opening bracket eaten */
+static const char *corpus[] = {
+  "1+2]", "1-2]", "1--3]", "2/5]", "3.0*5]", "0OR1]", "2AND2]", "2XOR2]",
+  "15MOD4.0]", "1+2*3-4/5]", "2**3.0]", "SIN[30]]", "ATAN[1.7321]/[1.0]]",
+  "ROUND[-0.5001]]", "FUP[9.975]]", "#1*2+#2]", "#[#1+1]*COS[#3]]",
+  "[#1+#2]*[#3-#4]/2]",
+  "2+ASIN[1/2.1+-0.345]/[ATAN[FIX[4.4]*2.1*SQRT[16.8]]/[-18]]**2]"
+};
+#define CORPUS_SIZE (sizeof(corpus) / sizeof(corpus[0]))
+
+/* Generated ones, each that many expressions of up to that many characters */
+#define GENERATED_SIZE 64
+#define GENERATED_LENGTH 2048
+/* Unary functions go through gcode-input, that many blocks of three */
+#define UNARY_BLOCKS 100000
+
+static const char *modes[] = {"compile+run", "cached", "cached+other-writes",
+                              "cached+own-writes"};
+
+/* Function calls wrapped around what is in between, arguments kept in their
+ * domain so that nothing comes out as NAN */
+static const char *functions[][2] = {
+  {"SIN[", "]"}, {"COS[", "]"}, {"ABS[", "]"}, {"FIX[", "]"}, {"FUP[", "]"},
+  {"ROUND[", "]"}, {"SQRT[ABS[", "]]"}, {"LN[ABS[", "]+1]"},
+  {"ATAN[", "]/[1.5]"}, {"EXP[SIN[", "]]"}, {"TAN[FIX[", "]MOD45]"}
+};
+#define FUNCTIONS (sizeof(functions) / sizeof(functions[0]))
+
+
+/* Every allocation anything makes goes through these, glibc does the actual
+ * work. Counted, to tell how many a call to the evaluator costs */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *data, size_t size);
+
+static uint64_t allocations;
+
+void *malloc(size_t size) {
+  allocations++;
+
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  allocations++;
+
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *data, size_t size) {
+  allocations++;
+
+  return __libc_realloc(data, size);
+}
+
+static double _now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1.0E+9;
+}
+
+/* Tokens the way the evaluator reads them: numbers, names, operators ("**"
+ * being one) and brackets, blanks in between don't count */
+static size_t _count_tokens(const char *text, const char *end) {
+  size_t count = 0;
+
+  while(text < end) {
+    if(*text == ' ' || *text == '\t') {
+      text++;
+      continue;
+    }
+    count++;
+    if(isdigit(*text) || *text == '.')
+      do text++; while(text < end && (isdigit(*text) || *text == '.'));
+    else if(isalpha(*text))
+      do text++; while(text < end && isalpha(*text));
+    else if(text[0] == '*' && &text[1] < end && text[1] == '*') text += 2;
+    else text++;
+  }
+
+  return count;
+}
+
+static char *_put(char *at, const char *format, ...) {
+  va_list arguments;
+  int length;
+
+  va_start(arguments, format);
+  length = vsprintf(at, format, arguments);
+  va_end(arguments);
+
+  return &at[length];
+}
+
+/* A literal or a parameter, never 0 so that it can be divided by */
+static char *_put_leaf(char *at) {
+  if(rand() % 3) return _put(at, "%d.%02d", 1 + rand() % 9, rand() % 100);
+  else return _put(at, "#%d", 1 + rand() % 8);
+}
+
+/* Every level a bracket of its own, nested on alternating sides. Only a leaf
+ * gets divided by */
+static char *_nest(char *at, unsigned int depth) {
+  static const char operators[] = "+-*/";
+
+  if(!depth) return _put_leaf(at);
+  at = _put(at, "[");
+  if(depth % 2) {
+    at = _nest(at, depth - 1);
+    at = _put(at, "%c", operators[rand() % 4]);
+    at = _put_leaf(at);
+  } else {
+    at = _put_leaf(at);
+    at = _put(at, "%c", operators[rand() % 3]);
+    at = _nest(at, depth - 1);
+  }
+
+  return _put(at, "]");
+}
+
+/* Calls within calls, with the odd operator in between */
+static char *_call(char *at, unsigned int depth) {
+  unsigned int f = rand() % FUNCTIONS;
+
+  if(!depth) return _put_leaf(at);
+  at = _put(at, "%s", functions[f][0]);
+  if(rand() % 2) {
+    at = _put_leaf(at);
+    at = _put(at, "%c", "+-*"[rand() % 3]);
+  }
+  at = _call(at, depth - 1);
+
+  return _put(at, "%s", functions[f][1]);
+}
+
+/* Parameter numbers worked out from other parameters, kept in #1..#8 */
+static char *_indirect(char *at, unsigned int depth) {
+  if(!depth) return _put(at, "#%d", 1 + rand() % 8);
+  at = _put(at, "#[");
+  at = _indirect(at, depth - 1);
+
+  return _put(at, "MOD8+1]");
+}
+
+/* Fills corpus with expressions as gcode-input hands them over, each of them
+ * made up of a few of what generator makes */
+static void _generate(char (*generated)[GENERATED_LENGTH],
+                      char *(*generator)(char *, unsigned int),
+                      unsigned int minimum, unsigned int maximum) {
+  unsigned int i, j, parts;
+  char *at;
+
+  for(i = 0; i < GENERATED_SIZE; i++) {
+    at = generated[i];
+    parts = 1 + rand() % 3;
+    for(j = 0; j < parts; j++) {
+      if(j) at = _put(at, "%c", "+-*"[rand() % 3]);
+      at = generator(at, minimum + rand() % (maximum - minimum + 1));
+    }
+    _put(at, "]");
+  }
+}
+
+/* Runs the expressions count times over in the given mode, locations starting
+ * at base. Reports per call to the evaluator */
+static void _measure(const char *name, const char **expressions, size_t size,
+                     unsigned int mode, long base, uint32_t count) {
+  size_t *lengths = (size_t *)malloc(size * sizeof(size_t)), i;
+  uint64_t tokens = 0, allocated;
+  uint32_t n;
+  double start, sum = 0.0;
+
+  for(i = 0; i < size; i++) lengths[i] = strlen(expressions[i]);
+  allocated = allocations;
+  start = _now();
+  for(n = 0; n < count; n++) {
+    i = n % size;
+    if(mode == 2) set_parameter(100, n);
+    else if(mode == 3) set_parameter(1, 1.25);
+    sum += (mode ? evaluate_cached_expression(expressions[i], lengths[i],
+                                              base + i) :
+                   evaluate_expression(expressions[i]));
+  }
+  start = _now() - start;
+  allocated = allocations - allocated;
+  for(n = 0; n < count; n++)
+    tokens += _count_tokens(expressions[n % size],
+                            &expressions[n % size][lengths[n % size]]);
+  printf("BENCH,%s,%s,%.1f ns/expression,%.2f Mtokens/s,%.3f allocations/call,%.3f\n",
+         name, modes[mode], start / count * 1.0E+9, tokens / start / 1.0E+6,
+         (double)allocated / count, sum);
+  free(lengths);
+}
+
+/* What is left once compiled: running the bytecode */
+static void _measure_run(const char *name, const char **expressions,
+                         size_t size, uint32_t count) {
+  TGCodeExpressionProgram *programs = (TGCodeExpressionProgram *)malloc(
+      size * sizeof(TGCodeExpressionProgram));
+  uint64_t tokens = 0, allocated;
+  uint32_t n;
+  size_t i;
+  double start, sum = 0.0;
+
+  for(i = 0; i < size; i++) {
+    TGCodeExpressionProgram *program = &programs[i];
+
+    compile_expression(expressions[i], program);
+    /* Only valid up to the next compilation, keep a copy */
+    program->code = memcpy(malloc(program->count *
+                                  sizeof(TGCodeExpressionInstruction)),
+                           program->code,
+                           program->count * sizeof(TGCodeExpressionInstruction));
+    program->constants = memcpy(malloc((program->constantCount + 1) *
+                                       sizeof(double)),
+                                program->constants,
+                                program->constantCount * sizeof(double));
+  }
+  allocated = allocations;
+  start = _now();
+  for(n = 0; n < count; n++) sum += run_expression(&programs[n % size]);
+  start = _now() - start;
+  allocated = allocations - allocated;
+  for(n = 0; n < count; n++)
+    tokens += _count_tokens(expressions[n % size],
+                            strchr(expressions[n % size], '\0'));
+  printf("BENCH,%s,run,%.1f ns/expression,%.2f Mtokens/s,%.3f allocations/call,%.3f\n",
+         name, start / count * 1.0E+9, tokens / start / 1.0E+6,
+         (double)allocated / count, sum);
+
+  for(i = 0; i < size; i++) {
+    free((void *)programs[i].code);
+    free((void *)programs[i].constants);
+  }
+  free(programs);
+}
+
+/* Fetches every block of name, returns how long that took */
+static double _fetch(const char *name, uint64_t *allocated) {
+  TGCodeBlockView block;
+  double start;
+
+  init_input(fopen(name, "r"));
+  *allocated = allocations;
+  start = _now();
+  while(fetch_line_input(&block));
+  start = _now() - start;
+  *allocated = allocations - *allocated;
+  done_input();
+
+  return start;
+}
+
+/* Unary functions only ever run on blocks being fetched: the same blocks with
+ * their functions and with just the arguments tell what the functions cost */
+static void _measure_unary(const char *name) {
+  static const char *unary[] = {"SIN", "COS", "ABS", "FIX", "FUP", "ROUND",
+                                "SQRT", "LN", "EXP", "TAN"};
+  const char *plain = "bench-expression-plain.nc";
+  FILE *calls = fopen(name, "w"), *arguments = fopen(plain, "w");
+  uint64_t tokens = 0, allocated, baseline;
+  char argument[32];
+  uint32_t n, k;
+  double start;
+
+  for(n = 0; n < UNARY_BLOCKS; n++) {
+    fprintf(calls, "G1");
+    fprintf(arguments, "G1");
+    for(k = 0; k < 3; k++) {
+      if(rand() % 4) snprintf(argument, sizeof(argument), "%d.%03d",
+                              1 + rand() % 9, rand() % 1000);
+      else snprintf(argument, sizeof(argument), "#%d", 1 + rand() % 8);
+      if(rand() % 5) {
+        const char *function = unary[rand() % (sizeof(unary) /
+                                               sizeof(unary[0]))];
+
+        fprintf(calls, " %c %s%s", "XYZ"[k], function, argument);
+        tokens += 2;
+      } else {
+        fprintf(calls, " %c ATAN%s/%d", "XYZ"[k], argument, 1 + rand() % 9);
+        tokens += 4;
+      }
+      fprintf(arguments, " %c %s", "XYZ"[k], argument);
+    }
+    fprintf(calls, "\n");
+    fprintf(arguments, "\n");
+  }
+  fclose(calls);
+  fclose(arguments);
+
+  /* Once over each so that both are just as warm */
+  _fetch(name, &allocated);
+  start = _fetch(plain, &baseline);
+  start = _fetch(name, &allocated) - start;
+  n = 3 * UNARY_BLOCKS;
+  printf("BENCH,expression-unary,fetch,%.1f ns/expression,%.2f Mtokens/s,%.3f allocations/call\n",
+         start / n * 1.0E+9, tokens / start / 1.0E+6,
+         (double)(allocated > baseline ? allocated - baseline : 0) / n);
+  remove(name);
+  remove(plain);
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t count = (argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000);
+  static char nesting[GENERATED_SIZE][GENERATED_LENGTH],
+              calls[GENERATED_SIZE][GENERATED_LENGTH],
+              indirections[GENERATED_SIZE][GENERATED_LENGTH];
+  struct {
+    const char *name;
+    char (*generated)[GENERATED_LENGTH];
+    char *(*generator)(char *, unsigned int);
+    unsigned int minimum, maximum;
+  } corpora[] = {
+    {"expression-nesting", nesting, _nest, 8, 64},
+    {"expression-functions", calls, _call, 2, 8},
+    {"expression-indirection", indirections, _indirect, 1, 6}
+  };
+  const char *expressions[GENERATED_SIZE];
+  unsigned int i, j, mode;
+
+  init_parameters(NULL);
+  init_expression(NULL);
+  for(i = 1; i <= 8; i++) set_parameter(i, i * 1.25);
+
+  /* As a loop would see them: from the text every time, then compiled once
+   * per place in the input. Results get reused until a parameter they read
+   * changes: #100 is read by none of them, #1 by a few */
+  for(mode = 0; mode < 4; mode++)
+    _measure("expression", corpus, CORPUS_SIZE, mode, 0, count);
+  _measure_run("expression", corpus, CORPUS_SIZE, count);
+
+  /* Same seed every time, the same expressions for every version */
+  srand(42);
+  for(i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++) {
+    _generate(corpora[i].generated, corpora[i].generator, corpora[i].minimum,
+              corpora[i].maximum);
+    for(j = 0; j < GENERATED_SIZE; j++)
+      expressions[j] = corpora[i].generated[j];
+    /* Places of their own, they don't push each other out of the cache */
+    for(mode = 0; mode < 4; mode++)
+      _measure(corpora[i].name, expressions, GENERATED_SIZE, mode,
+               (i + 1) * GENERATED_SIZE, count);
+    _measure_run(corpora[i].name, expressions, GENERATED_SIZE, count);
+  }
+
+  _measure_unary("bench-expression.nc");
+  done_expression();
+
+  return 0;
+}
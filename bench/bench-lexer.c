@@ -0,0 +1,119 @@
+/*
+ ============================================================================
+ Name        : bench-lexer.c
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Line Sanitizer Throughput Benchmark
+ ============================================================================
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "gcode-commons.h"
+#include "gcode-input.h"
+#include "gcode-lexer.h"
+
+
+/* Roughly what CAM posts look like, with a sprinkling of everything the
+ * sanitizer has to get right. Compact posts (no blanks, upper case) need no
+ * rewriting at all for most blocks */
+static void _generate(const char *name, size_t size, bool compact) {
+  FILE *out = fopen(name, "w");
+  size_t written = 0;
+  uint32_t n = 1;
+
+  srand(42);
+  while(written < size) {
+    double x = (rand() % 200000) / 1000.0 - 100.0;
+    double y = (rand() % 200000) / 1000.0 - 100.0;
+    double z = -(rand() % 5000) / 1000.0;
+
+    if(compact) {
+      written += fprintf(out, "N%uG1X%.3fY%.3fZ%.3f\n", n++, x, y, z);
+      continue;
+    }
+    switch(rand() % 16) {
+      case 0:
+        written += fprintf(out, "N%u g01 x%.3f y%.3f\tz%.3f f1200 (feed move)\r\n",
+                           n, x, y, z);
+        break;
+      case 1:
+        written += fprintf(out, "N%u G01 X[%.3f + 1] Y%.3f\n", n, x, y);
+        break;
+      case 2:
+        written += fprintf(out, "/N%u G00 Z5.000 (deleted)\n", n);
+        break;
+      case 3:
+        written += fprintf(out, "(just a comment on its own line)\n\n");
+        break;
+      default:
+        written += fprintf(out, "N%u G01 X%.3f Y%.3f Z%.3f\n", n, x, y, z);
+        break;
+    }
+    n++;
+  }
+  fclose(out);
+}
+
+static double _now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1.0E+9;
+}
+
+int main(int argc, char *argv[]) {
+  const char *name = "bench-lexer.nc";
+  size_t size = (argc > 1 ? strtoul(argv[1], NULL, 10) : 64) << 20;
+  TGCodeLexerKind kinds[] = {GCODE_LEXER_SCALAR, GCODE_LEXER_SSE2,
+                             GCODE_LEXER_AVX2};
+  uint64_t reference = 0;
+  unsigned int k, compact;
+  bool identical = true;
+
+  for(compact = 0; compact < 2; compact++) {
+    _generate(name, size, compact);
+
+    for(k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+      TGCodeBlockView block;
+      size_t p;
+      uint64_t hash = 1469598103934665603ULL, lines = 0;
+      double start;
+      TGCodeLexerKind actual;
+
+      init_input(fopen(name, "r"));
+      actual = select_lexer(kinds[k]);
+      if(actual != kinds[k]) {
+        done_input();
+        continue;
+      }
+
+      start = _now();
+      while(fetch_line_input(&block)) {
+        /* FNV-1a over every sanitized line, terminator included */
+        for(p = 0; p < block.length; p++)
+          hash = (hash ^ (uint8_t)block.text[p]) * 1099511628211ULL;
+        hash = (hash ^ '\n') * 1099511628211ULL;
+        lines++;
+      }
+      start = _now() - start;
+      done_input();
+
+      if(k == 0) reference = hash;
+      else if(hash != reference) identical = false;
+      printf("BENCH,%s,%s,%.1f MB/s,%.2f Mlines/s,%016llx%s\n",
+             (compact ? "lexer-compact" : "lexer"), describe_lexer(actual),
+             size / start / 1.0E+6, lines / start / 1.0E+6,
+             (unsigned long long)hash, (hash == reference ? "" : ",MISMATCH"));
+    }
+    remove(name);
+  }
+
+  return identical ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+/*
+ ============================================================================
+ Name        : bench-number.c
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Numeric Literal Parser Benchmark
+ ============================================================================
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gcode-commons.h"
+#include "gcode-state.h"
+
+
+/* What read_gcode_real() used to do for every number */
+static double _reference(const char *line) {
+  const char *end = skip_gcode_digits(line);
+  char *theNumber = calloc(end - line + 1, 1);
+  double result;
+
+  strncpy(theNumber, line, end - line);
+  result = strtod(theNumber, (char **)NULL);
+  free(theNumber);
+
+  return result;
+}
+
+static double _now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1.0E+9;
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t count = (argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000);
+  const char **samples;
+  char *pool;
+  uint32_t n;
+  unsigned int i;
+  double start, sum;
+
+  /* What CAM posts are full of: a handful of decimals at most */
+  samples = calloc(count, sizeof(const char *));
+  pool = calloc(count, 16);
+  srand(42);
+  for(n = 0; n < count; n++) {
+    snprintf(&pool[n * 16], 16, "%.*fX", rand() % 5,
+             (rand() % 2000000) / 1000.0 - 1000.0);
+    samples[n] = &pool[n * 16];
+  }
+
+  for(i = 0; i < 2; i++) {
+    sum = 0.0;
+    start = _now();
+    for(n = 0; n < count; n++)
+      sum += (i ? read_gcode_real(samples[n]) : _reference(samples[n]));
+    start = _now() - start;
+    printf("BENCH,number,%s,%.1f Mnumbers/s,%.3f\n",
+           (i ? "read_gcode_real" : "calloc+strtod"),
+           count / start / 1.0E+6, sum);
+  }
+
+  free(pool);
+  free(samples);
+
+  return 0;
+}
@@ -0,0 +1,459 @@
+/*
+ ============================================================================
+ Name        : gcode-batch.c
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Parallel Batch Interpreter Code
+ ============================================================================
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gcode-commons.h"
+#include "gcode-batch.h"
+#include "gcode-debugcon.h"
+#include "gcode-parameters.h"
+#include "gcode-tools.h"
+#include "gcode-input.h"
+#include "gcode-machine.h"
+#include "gcode-state.h"
+#include "gcode-stacks.h"
+#include "gcode-cycles.h"
+#include "gcode-queue.h"
+#include "gcode-checker.h"
+#include "gcode-expression.h"
+#include "gcode-subprogram.h"
+#include "gcode-checkpoint.h"
+#include "gcode-context.h"
+
+
+typedef struct TGCodeBatch TGCodeBatch;
+
+typedef struct {
+  /* Programs [head, tail) still to be run, head in the low half. The worker
+   * takes from the head, others steal the back half. Every program is in one
+   * range at most, so the same value never comes back and CAS is enough */
+  _Atomic uint64_t range;
+  TGCodeBatch *batch;
+  pthread_t thread;
+  unsigned int index;
+  /* Only looked at after the worker has been joined */
+  uint64_t blocks;
+  uint32_t programs, failed, steals;
+  double busy;
+} TGCodeBatchWorker;
+
+struct TGCodeBatch {
+  char *const *files;
+  char *parameters; /* Parameter store contents, every program gets a copy */
+  size_t parametersSize;
+  bool dryRun; /* See dry_run_machine() */
+  TGCodeBatchWorker *workers;
+  unsigned int workerCount;
+};
+
+
+static double _now_batch(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec + now.tv_nsec / 1.0E+9;
+}
+
+static uint64_t _pack_range(uint32_t head, uint32_t tail) {
+  return (uint64_t)tail << 32 | head;
+}
+
+static bool _take_batch(TGCodeBatchWorker *worker, uint32_t *job) {
+  uint64_t range = atomic_load_explicit(&worker->range, memory_order_acquire);
+
+  do {
+    if((uint32_t)range >= (uint32_t)(range >> 32)) return false;
+  } while(!atomic_compare_exchange_weak_explicit(&worker->range, &range,
+                                                 range + 1,
+                                                 memory_order_acq_rel,
+                                                 memory_order_acquire));
+  *job = (uint32_t)range;
+
+  return true;
+}
+
+/* Moves the back half of the first other worker's range that has any left to
+ * worker's own (which is empty). Returns false if there was nothing left */
+static bool _steal_batch(TGCodeBatchWorker *worker) {
+  TGCodeBatch *batch = worker->batch;
+  unsigned int i;
+
+  for(i = 1; i < batch->workerCount; i++) {
+    TGCodeBatchWorker *victim = &batch->workers[(worker->index + i) %
+                                                batch->workerCount];
+    uint64_t range = atomic_load_explicit(&victim->range, memory_order_acquire);
+    uint32_t head, tail, split;
+
+    do {
+      head = (uint32_t)range;
+      tail = (uint32_t)(range >> 32);
+      if(head >= tail) break;
+      split = tail - (tail - head + 1) / 2;
+    } while(!atomic_compare_exchange_weak_explicit(&victim->range, &range,
+                                                   _pack_range(head, split),
+                                                   memory_order_acq_rel,
+                                                   memory_order_acquire));
+    if(head < tail) {
+      atomic_store_explicit(&worker->range, _pack_range(split, tail),
+                            memory_order_release);
+      worker->steals++;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* Same sequence as gcode-canon, on a context of its own and without saving
+ * the parameters on the way out. Takes over inputFile, hotCalls goes to
+ * init_subprogram(), checkpoints to init_checkpoint(), restoreFile (unless
+ * NULL) to restore_checkpoint() and startAt, unless 0, to start_at_input() */
+static bool _run_context_batch(TGCodeBatch *batch, FILE *inputFile,
+                               FILE *console, uint32_t *hotCalls,
+                               TGCodeCheckpointSetup *checkpoints,
+                               FILE *restoreFile, uint32_t startAt,
+                               uint64_t *blocks) {
+  TGCodeContext *context, *previous;
+  TGCodeBlockView block;
+  FILE *parFile = NULL;
+  bool run;
+
+  if(!(context = create_context())) {
+    fclose(inputFile);
+    return false;
+  }
+  if(batch->parametersSize)
+    parFile = fmemopen(batch->parameters, batch->parametersSize, "r");
+
+  context->console = console;
+  previous = select_context(context);
+
+  init_parameters(parFile);
+  init_machine(NULL);
+  if(batch->dryRun) dry_run_machine(true);
+  init_stacks(NULL);
+  init_tools(NULL);
+  init_input(inputFile);
+  init_gcode_state(NULL);
+  init_cycles(NULL);
+  init_queue();
+  init_checker(NULL);
+  init_expression(NULL);
+  init_subprogram(hotCalls);
+  init_checkpoint(checkpoints);
+  run = (!restoreFile || restore_checkpoint(restoreFile)) &&
+        (!startAt || start_at_input(startAt));
+
+  while(run && machine_running() && gcode_running() && fetch_line_input(&block)) {
+    if(gcode_check(&block)) update_gcode_state(&block);
+    move_machine_queue();
+    step_checkpoint();
+    (*blocks)++;
+  }
+  while(move_machine_queue());
+
+  done_checkpoint();
+  done_subprogram();
+  done_expression();
+  done_checker();
+  done_queue();
+  done_cycles();
+  done_input();
+  done_tools();
+  done_stacks();
+  done_machine();
+
+  select_context(previous);
+  if(parFile) fclose(parFile);
+  destroy_context(context);
+
+  return run;
+}
+
+static bool _run_program_batch(TGCodeBatch *batch, const char *name,
+                               uint64_t *blocks) {
+  FILE *inputFile, *console;
+  char *consoleName;
+  bool result;
+
+  consoleName = (char *)malloc(strlen(name) + strlen(GCODE_BATCH_SUFFIX) + 1);
+  if(!consoleName) return false;
+  strcpy(consoleName, name);
+  strcat(consoleName, GCODE_BATCH_SUFFIX);
+  inputFile = fopen(name, "r");
+  console = (inputFile ? fopen(consoleName, "w") : NULL);
+  free(consoleName);
+  if(!inputFile || !console) {
+    if(inputFile) fclose(inputFile);
+    return false;
+  }
+  result = _run_context_batch(batch, inputFile, console, NULL, NULL, NULL, 0,
+                              blocks);
+  fclose(console);
+
+  return result;
+}
+
+static void *_run_worker_batch(void *data) {
+  TGCodeBatchWorker *worker = (TGCodeBatchWorker *)data;
+  uint32_t job;
+  double start;
+
+  for(;;) {
+    if(!_take_batch(worker, &job)) {
+      if(_steal_batch(worker)) continue;
+      break;
+    }
+    start = _now_batch();
+    if(_run_program_batch(worker->batch, worker->batch->files[job],
+                          &worker->blocks)) worker->programs++;
+    else worker->failed++;
+    worker->busy += _now_batch() - start;
+  }
+
+  return NULL;
+}
+
+/* Reads all of the parameter store, so that it is parsed from memory by every
+ * program instead of from disk */
+static bool _load_parameters_batch(TGCodeBatch *batch, FILE *parameterStore) {
+  size_t size = 0, got;
+
+  if(!parameterStore) return true;
+  do {
+    if(batch->parametersSize == size) {
+      char *grown;
+
+      size = (size ? size * 2 : GCODE_INPUT_SPOOL_CHUNK);
+      if(!(grown = (char *)realloc(batch->parameters, size))) return false;
+      batch->parameters = grown;
+    }
+    got = fread(&batch->parameters[batch->parametersSize], 1,
+                size - batch->parametersSize, parameterStore);
+    batch->parametersSize += got;
+  } while(got);
+
+  return true;
+}
+
+bool run_batch(char *const files[], size_t count, unsigned int workers,
+               bool dryRun, FILE *parameterStore) {
+  TGCodeBatch batch;
+  TGCodeBatchWorker *worker;
+  uint64_t blocks = 0;
+  uint32_t programs = 0, failed = 0;
+  unsigned int i;
+  double start;
+  char message[0xFF];
+
+  memset(&batch, 0x00, sizeof(batch));
+  if(!workers) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+    workers = (online > 0 ? online : 1);
+  }
+  if(workers > GCODE_BATCH_WORKERS) workers = GCODE_BATCH_WORKERS;
+  if(workers > count) workers = count;
+  if(!workers || count > UINT32_MAX) {
+    display_machine_message("IER: Nothing to run in batch!");
+    return false;
+  }
+  batch.files = files;
+  batch.dryRun = dryRun;
+  batch.workerCount = workers;
+  batch.workers = (TGCodeBatchWorker *)calloc(workers,
+                                              sizeof(TGCodeBatchWorker));
+  if(!batch.workers || !_load_parameters_batch(&batch, parameterStore)) {
+    display_machine_message("IER: Out of memory while starting batch!");
+    free(batch.workers);
+    free(batch.parameters);
+    return false;
+  }
+
+  start = _now_batch();
+  /* Everyone starts out on an equal share, in order */
+  for(i = 0; i < workers; i++) {
+    worker = &batch.workers[i];
+    worker->batch = &batch;
+    worker->index = i;
+    atomic_init(&worker->range,
+                _pack_range(count * i / workers, count * (i + 1) / workers));
+  }
+  for(i = 0; i < workers; i++)
+    if(pthread_create(&batch.workers[i].thread, NULL, _run_worker_batch,
+                      &batch.workers[i])) {
+      /* Its share gets stolen, or run right here if nobody else can */
+      batch.workers[i].thread = pthread_self();
+      display_machine_message("WAR: Unable to start batch worker!");
+    }
+  for(i = 0; i < workers; i++)
+    if(pthread_equal(batch.workers[i].thread, pthread_self()))
+      _run_worker_batch(&batch.workers[i]);
+    else pthread_join(batch.workers[i].thread, NULL);
+  start = _now_batch() - start;
+
+  for(i = 0; i < workers; i++) {
+    worker = &batch.workers[i];
+    snprintf(message, sizeof(message),
+             "STA: Worker %u: %u programs, %u stolen, %llu blocks in %.3fs, %.3f Mblocks/s",
+             i, worker->programs + worker->failed, worker->steals,
+             (unsigned long long)worker->blocks, worker->busy,
+             (worker->busy > 0.0 ? worker->blocks / worker->busy / 1.0E+6 :
+                                   0.0));
+    display_machine_message(message);
+    blocks += worker->blocks;
+    programs += worker->programs;
+    failed += worker->failed;
+  }
+  snprintf(message, sizeof(message),
+           "STA: Batch: %u programs run, %u failed, %llu blocks on %u workers in %.3fs, %.3f Mblocks/s",
+           programs, failed, (unsigned long long)blocks, workers, start,
+           (start > 0.0 ? blocks / start / 1.0E+6 : 0.0));
+  display_machine_message(message);
+  if(failed)
+    display_machine_message("PER: Some programs in the batch could not be opened!");
+
+  free(batch.workers);
+  free(batch.parameters);
+
+  return !failed;
+}
+
+/* Next line of output at *at that isn't debug output, NULL if there is none.
+ * *at is moved past it */
+static const char *_next_line_batch(const char **at, const char *end,
+                                    size_t *length) {
+  const char *line, *eol;
+
+  while(*at < end) {
+    line = *at;
+    if(!(eol = (const char *)memchr(line, '\n', end - line))) eol = end;
+    *at = (eol < end ? eol + 1 : end);
+    if(*line == '[') continue;
+    *length = eol - line;
+    return line;
+  }
+
+  return NULL;
+}
+
+/* Moves *at past the first line starting with marker, returns false if there
+ * is none */
+static bool _skip_past_batch(const char **at, const char *end,
+                             const char *marker) {
+  const char *line;
+  size_t length, markerLength = strlen(marker);
+
+  while((line = _next_line_batch(at, end, &length)))
+    if(length >= markerLength && !memcmp(line, marker, markerLength))
+      return true;
+
+  return false;
+}
+
+bool run_differential(const char *name, uint32_t startAt,
+                      const TGCodeCheckpointSetup *checkpoints,
+                      bool dryRun, FILE *parameterStore) {
+  TGCodeBatch batch;
+  TGCodeCheckpointSetup setup[2];
+  FILE *inputFile, *console, *restoreFile = NULL;
+  char *output[2] = {NULL, NULL}, *snapshots[2] = {NULL, NULL};
+  size_t size[2] = {0, 0}, snapshotsSize[2] = {0, 0}, length[2], lines = 0;
+  const char *at[2], *line[2];
+  uint32_t hotCalls[2] = {0, 1};
+  uint64_t blocks = 0;
+  unsigned int i;
+  bool result = true, checkpointing, resumed = false;
+  char message[0xFF];
+
+  memset(&batch, 0x00, sizeof(batch));
+  memset(setup, 0x00, sizeof(setup));
+  batch.dryRun = dryRun;
+  if(!_load_parameters_batch(&batch, parameterStore)) {
+    display_machine_message("IER: Out of memory while starting batch!");
+    free(batch.parameters);
+    return false;
+  }
+  checkpointing = (checkpoints && (checkpoints->name || checkpoints->stream));
+  /* Text only first, then with every subprogram compiled on its first call.
+   * Checkpoints only ever go to memory, the second run's are thrown away */
+  for(i = 0; result && i < 2; i++) {
+    if(checkpointing) {
+      setup[i].every = checkpoints->every;
+      setup[i].stream = open_memstream(&snapshots[i], &snapshotsSize[i]);
+    }
+    if(i && snapshotsSize[0])
+      resumed = (restoreFile = fmemopen(snapshots[0], snapshotsSize[0], "r"));
+    inputFile = fopen(name, "r");
+    console = (inputFile ? open_memstream(&output[i], &size[i]) : NULL);
+    if(!inputFile || !console || (checkpointing && !setup[i].stream) ||
+       (i && snapshotsSize[0] && !restoreFile)) {
+      if(inputFile) fclose(inputFile);
+      if(console) fclose(console);
+      if(setup[i].stream) fclose(setup[i].stream);
+      display_machine_message("IER: Unable to open program to run twice!");
+      result = false;
+      break;
+    }
+    /* Resuming from a checkpoint written past N<startAt> starts there */
+    result = _run_context_batch(&batch, inputFile, console, &hotCalls[i],
+                                (checkpointing ? &setup[i] : NULL),
+                                restoreFile, (resumed ? 0 : startAt), &blocks);
+    fclose(console);
+    if(setup[i].stream) fclose(setup[i].stream);
+  }
+  if(restoreFile) fclose(restoreFile);
+
+  if(result) {
+    fwrite(output[resumed ? 0 : 1], 1, size[resumed ? 0 : 1], GCODE_CONSOLE);
+    at[0] = output[0];
+    at[1] = output[1];
+    if(resumed) {
+      _skip_past_batch(&at[0], output[0] + size[0], "MSG: STA: Checkpoint ");
+      _skip_past_batch(&at[1], output[1] + size[1],
+                       "MSG: STA: Resumed from checkpoint");
+    }
+    do {
+      line[0] = _next_line_batch(&at[0], output[0] + size[0], &length[0]);
+      line[1] = _next_line_batch(&at[1], output[1] + size[1], &length[1]);
+      lines++;
+      if(!line[0] != !line[1] ||
+         (line[0] && (length[0] != length[1] ||
+                      memcmp(line[0], line[1], length[0])))) {
+        snprintf(message, sizeof(message),
+                 (resumed ?
+                  "PER: Resumed run differs from text at output line %zu after the checkpoint!" :
+                  "PER: Compiled subprograms differ from text at output line %zu!"),
+                 lines);
+        display_machine_message(message);
+        result = false;
+        break;
+      }
+    } while(line[0]);
+  }
+
+  free(output[0]);
+  free(output[1]);
+  free(snapshots[0]);
+  free(snapshots[1]);
+  free(batch.parameters);
+
+  return result;
+}
@@ -0,0 +1,46 @@
+/*
+ ============================================================================
+ Name        : gcode-batch.h
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Parallel Batch Interpreter API Header
+ ============================================================================
+ */
+
+#ifndef GCODE_BATCH_H_
+#define GCODE_BATCH_H_
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "gcode-checkpoint.h"
+
+
+/* Interprets count programs on up to workers threads (0: one per CPU), each
+ * in a context of its own. Whatever a program prints goes to its name with
+ * GCODE_BATCH_SUFFIX appended. Every program starts out with the parameters
+ * read from parameterStore (may be NULL), none are saved back. With dryRun,
+ * every program is dry run (see dry_run_machine()). Reports blocks per second
+ * for every worker, returns false if any program could not be opened */
+bool run_batch(char *const files[], size_t count, unsigned int workers,
+               bool dryRun, FILE *parameterStore);
+/* Interprets the program twice from the same parameters: as text only and
+ * with every subprogram compiled on its first call (see gcode-subprogram.h).
+ * Prints what the second run printed, then complains and returns false if
+ * that differs from the first run in anything but debug output. Both runs
+ * start at N<startAt> unless that is 0 (see start_at_input()) and both are
+ * dry runs with dryRun (see dry_run_machine()). If checkpoints (may be NULL)
+ * has the first run write any, they are kept in memory and the second run
+ * resumes from the first one instead: what the first run printed is printed,
+ * what the second run printed after resuming must be the same as what the
+ * first one printed after that checkpoint */
+bool run_differential(const char *name, uint32_t startAt,
+                      const TGCodeCheckpointSetup *checkpoints,
+                      bool dryRun, FILE *parameterStore);
+
+
+#endif /* GCODE_BATCH_H_ */
@@ -8,8 +8,15 @@
  ============================================================================
  */
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <locale.h>
+#include <errno.h>
+#include <limits.h>
+#include <getopt.h>
 
 #include "gcode-commons.h"
 #include "gcode-parameters.h"
@@ -21,15 +28,222 @@
 #include "gcode-cycles.h"
 #include "gcode-queue.h"
 #include "gcode-checker.h"
+#include "gcode-expression.h"
+#include "gcode-subprogram.h"
+#include "gcode-checkpoint.h"
+#include "gcode-compiler.h"
+#include "gcode-batch.h"
 
 
-int main(int argc, char *argv[]) {
+/* Long options stand for themselves, -j only goes with --batch */
+static const struct option options[] = {
+  {"start-at", required_argument, NULL, 's'},
+  {"dry-run", no_argument, NULL, 'n'},
+  {"checkpoint", required_argument, NULL, 'c'},
+  {"every", required_argument, NULL, 'e'},
+  {"read-ahead", no_argument, NULL, 'a'},
+  {"restore", required_argument, NULL, 'r'},
+  {"compile", no_argument, NULL, 'C'},
+  {"batch", no_argument, NULL, 'B'},
+  {"differential", no_argument, NULL, 'D'},
+  {NULL, 0, NULL, 0}
+};
+
+
+static double _now(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec + now.tv_nsec / 1.0E+9;
+}
+
+static int _usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [--start-at <N>] [--dry-run] [--checkpoint <file> [--every <blocks>]]\n"
+          "         [--read-ahead] [--restore <file>] [<program>]\n"
+          "       %s [--start-at <N>] [--dry-run] [--checkpoint <file> [--every <blocks>]]\n"
+          "         --differential <program>\n"
+          "       %s [--dry-run] --batch [-j <workers>] [<program>...]\n"
+          "       %s --compile <source> <target>\n",
+          name, name, name, name);
+
+  return EXIT_FAILURE;
+}
+
+/* Whole of text as a number, nothing before or after it */
+static bool _number(const char *text, unsigned long long *value) {
+  char *end;
+
+  if(*text < '0' || *text > '9') return false;
+  errno = 0;
+  *value = strtoull(text, &end, 10);
+
+  return !*end && !errno;
+}
+
+/* gcode-canon --compile <source> <target> */
+static int compile(const char *source, const char *target) {
+  FILE *sourceFile = fopen(source, "r");
+  FILE *targetFile = (sourceFile ? fopen(target, "w") : NULL);
+  bool result;
+
+  if(!sourceFile || !targetFile) {
+    perror(sourceFile ? target : source);
+    if(sourceFile) fclose(sourceFile);
+    return EXIT_FAILURE;
+  }
+  /* Same number format the interpreter reads with */
+  setlocale(LC_ALL, "C");
+  result = run_compiler(sourceFile, targetFile);
+  fclose(sourceFile);
+  if(fclose(targetFile)) result = false;
+
+  return (result ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/* gcode-canon [--dry-run] --batch [-j <workers>] [<program>...], names are
+ * read from stdin, one per line, if none are given */
+static int batch(int argc, char *argv[], unsigned int workers, bool dryRun) {
   FILE *parFile = fopen(GCODE_PARAMETER_STORE, "r");
-  FILE *inputFile = (argc > 1 ? fopen(argv[1], "r") : stdin);
-  char line[0xFF];
+  char **names = NULL, *name = NULL;
+  size_t count = 0, room = 0, size = 0, i;
+  ssize_t length;
+  bool result;
+
+  if(!argc)
+    while((length = getline(&name, &size, stdin)) > 0) {
+      if(name[length - 1] == '\n') name[--length] = '\0';
+      if(!length) continue;
+      if(count == room) {
+        char **grown = (char **)realloc(names, (room ? room * 2 : 64) *
+                                               sizeof(char *));
+
+        if(!grown) break;
+        names = grown;
+        room = (room ? room * 2 : 64);
+      }
+      names[count++] = strdup(name);
+    }
+
+  result = (argc ? run_batch(argv, argc, workers, dryRun, parFile) :
+                   run_batch(names, count, workers, dryRun, parFile));
+  for(i = 0; i < count; i++) free(names[i]);
+  free(names);
+  free(name);
+  if(parFile) fclose(parFile);
+
+  return (result ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/* gcode-canon [--start-at <N>] [--dry-run]
+ *             [--checkpoint <file> [--every <blocks>]]
+ *             --differential <program> */
+static int differential(const char *name, uint32_t startAt,
+                        const TGCodeCheckpointSetup *checkpoints,
+                        bool dryRun) {
+  FILE *parFile = fopen(GCODE_PARAMETER_STORE, "r");
+  bool result = run_differential(name, startAt, checkpoints, dryRun, parFile);
+
+  if(parFile) fclose(parFile);
+
+  return (result ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  FILE *parFile, *inputFile, *restoreFile = NULL;
+  TGCodeBlockView block;
+  TGCodeCheckpointSetup checkpoints;
+  const char *name = argv[0], *restoreName = NULL;
+  unsigned long long value;
+  uint32_t startAt = 0;
+  unsigned int workers = 0;
+  uint64_t blocks = 0;
+  double elapsed = 0.0;
+  bool run, dryRun = false, readAhead = false, every = false, many = false;
+  int option, mode = 0;
+
+  memset(&checkpoints, 0x00, sizeof(checkpoints));
+  while((option = getopt_long(argc, argv, "j:", options, NULL)) != -1)
+    switch(option) {
+      /* Restarting mid-program, e.g. after a tool break */
+      case 's':
+        if(!_number(optarg, &value) || !value || value > UINT32_MAX)
+          return _usage(name);
+        startAt = value;
+        break;
+      /* Pre-flight validation as fast as it goes, see dry_run_machine() */
+      case 'n':
+        dryRun = true;
+        break;
+      /* Multi-hour programs: snapshots to resume from later on */
+      case 'c':
+        checkpoints.name = optarg;
+        break;
+      case 'e':
+        if(!_number(optarg, &value)) return _usage(name);
+        checkpoints.every = value;
+        every = true;
+        break;
+      case 'a':
+        readAhead = true;
+        break;
+      case 'r':
+        restoreName = optarg;
+        break;
+      case 'j':
+        if(!_number(optarg, &value) || value > UINT_MAX) return _usage(name);
+        workers = value;
+        many = true;
+        break;
+      /* One of these at most, instead of running a program */
+      case 'C':
+      case 'B':
+      case 'D':
+        if(mode && mode != option) return _usage(name);
+        mode = option;
+        break;
+      default: /* getopt_long() already said what is wrong */
+        return _usage(name);
+    }
+  argc -= optind;
+  argv += optind;
+  /* Whatever doesn't apply to what was asked for is a mistake, not a no-op */
+  if((every && !checkpoints.name) || (many && mode != 'B') ||
+     ((readAhead || restoreName) && mode) ||
+     ((startAt || checkpoints.name) && mode && mode != 'D') ||
+     (dryRun && mode == 'C'))
+    return _usage(name);
+  switch(mode) {
+    case 'C':
+      return (argc == 2 ? compile(argv[0], argv[1]) : _usage(name));
+    case 'B':
+      return batch(argc, argv, workers, dryRun);
+    case 'D':
+      return (argc == 1 ? differential(argv[0], startAt, &checkpoints, dryRun) :
+                          _usage(name));
+    default:
+      if(argc > 1) return _usage(name);
+  }
+
+  if(restoreName && !(restoreFile = fopen(restoreName, "r"))) {
+    perror(restoreName);
+    return EXIT_FAILURE;
+  }
+  if(!(inputFile = (argc ? fopen(argv[0], "r") : stdin))) {
+    perror(argv[0]);
+    if(restoreFile) fclose(restoreFile);
+    return EXIT_FAILURE;
+  }
+  if(readAhead) enable_read_ahead_input();
+  parFile = fopen(GCODE_PARAMETER_STORE, "r");
 
   init_parameters(parFile);
   init_machine(NULL);
+  if(dryRun) {
+    dry_run_machine(true);
+    elapsed = _now();
+  }
   init_stacks(NULL);
   init_tools(NULL);
   init_input(inputFile);
@@ -39,14 +253,33 @@ int main(int argc, char *argv[]) {
   //TODO: align API, make it take a pointer to init data.
   init_queue();
   init_checker(NULL);
+  init_expression(NULL);
+  init_subprogram(NULL);
+  init_checkpoint(&checkpoints);
+  /* Starting anywhere else than asked for would be worse than not starting */
+  run = (!restoreFile || restore_checkpoint(restoreFile)) &&
+        (!startAt || start_at_input(startAt));
+  if(restoreFile) fclose(restoreFile);
 
-  while(machine_running() && gcode_running() && fetch_line_input(line)) {
-    if(gcode_check(line)) update_gcode_state(line);
+  while(run && machine_running() && gcode_running() && fetch_line_input(&block)) {
+    if(gcode_check(&block)) update_gcode_state(&block);
     move_machine_queue();
+    step_checkpoint();
+    blocks++;
   }
   /* Flush movement queue */
   while(move_machine_queue());
+  /* Off the console, the report itself stays the same from run to run */
+  if(dryRun) {
+    elapsed = _now() - elapsed;
+    fprintf(stderr, "Dry run: %llu blocks in %.3fs, %.3f Mblocks/s\n",
+            (unsigned long long)blocks, elapsed,
+            (elapsed > 0.0 ? blocks / elapsed / 1.0E+6 : 0.0));
+  }
 
+  done_checkpoint();
+  done_subprogram();
+  done_expression();
   done_checker();
   done_queue();
   done_cycles();
@@ -54,7 +287,9 @@ int main(int argc, char *argv[]) {
   done_tools();
   done_stacks();
   done_machine();
-  done_parameters();
+  /* A dry run leaves the parameter store as it found it */
+  if(!dryRun) done_parameters();
+  else if(parFile) fclose(parFile);
 
-  return 0;
+  return (run ? EXIT_SUCCESS : EXIT_FAILURE);
 }
@@ -8,13 +8,16 @@
  ============================================================================
  */
 
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "gcode-commons.h"
 #include "gcode-checker.h"
 #include "gcode-debugcon.h"
+#include "gcode-machine.h"
 #include "gcode-state.h"
 
 /* G command to modal group number mapping */
@@ -36,6 +39,52 @@ static const int8_t M2ModalGroup[] = {
 
 static const char allowedWords[] = "ABCDEFGHIJKLMPQRSTUVWXYZZ";
 
+/* The above as bits per TGCodeWordTable slot, shared by every context */
+static pthread_once_t processChecker = PTHREAD_ONCE_INIT;
+static uint32_t allowedLetters, numberLetters, repeatableLetters;
+
+
+/* Bit per TGCodeWordTable slot for every letter in letters */
+static uint32_t _letter_bits(const char *letters) {
+  uint32_t bits = 0;
+  int slot;
+
+  for(; *letters; letters++)
+    if((slot = gcode_letter_slot(*letters)) >= 0) bits |= (uint32_t)1 << slot;
+
+  return bits;
+}
+
+/* Returns false if two of the codes in codes are from the same modal group.
+ * Codes in group 0 are not modal and those unknown to map are let through */
+static bool _check_modal_groups(TGCodeCodeMask codes, const int8_t *map,
+                                size_t mapSize) {
+  uint32_t groups = 0, group;
+  uint64_t half;
+  unsigned int code, base;
+
+  for(base = 0; base < 128 && base < mapSize; base += 64)
+    for(half = (uint64_t)(codes >> base); half; half &= half - 1) {
+      code = base + __builtin_ctzll(half);
+      if(code >= mapSize) break;
+      if(map[code] <= 0) continue;
+      group = (uint32_t)1 << map[code];
+      if(groups & group) return false;
+      groups |= group;
+    }
+
+  return true;
+}
+
+static void _setup_process_checker(void) {
+  /* Parameter references and assignments are not word addresses as such */
+  allowedLetters = _letter_bits(allowedWords) | _letter_bits("#=");
+  /* Line and program numbers, only ever allowed at the start */
+  numberLetters = _letter_bits("NO");
+  /* G and M as long as the codes differ, # and = any number of times */
+  repeatableLetters = _letter_bits("GM#=");
+}
+
 bool init_checker(void *data) {
   GCODE_DEBUG("G-Code code syntax verifier up, checking against The Book.");
 
@@ -46,40 +95,58 @@ void done_checker(void) {
   /* NOP */
 }
 
-bool gcode_check(const char *line) {
-  const char *checkp;
+bool gcode_check(const TGCodeBlockView *block) {
+  const TGCodeWordTable *table;
+  const TGCodeWord *word;
+  uint32_t letters;
 
   /* No data is bad (our caller didn't get the point) */
-  if(!line) return false;
+  if(!block || !block->text) return false;
+  /* Pre-decoded blocks were checked when they were compiled */
+  if(block->words) return true;
   /* Empty line is good, though it gets stripped before we get here. */
-  if(!(*line)) return true;
-
-  checkp = line;
-
-  /* Skip over deleted block marker, a valid block must still follow */
-  if(*checkp == '/') checkp++;
-  /* If there is a line number, skip over it */
-  //TODO: we need a specialized skip_gcode_digits() here that would not accept
-  //parameter references.
-  if(*checkp == 'N') checkp = skip_gcode_digits(++checkp);
-  /* If there is a program number, check it's the last word in block */
-  if(*checkp == 'O') {
-    checkp = skip_gcode_digits(++checkp);
-    if(*checkp != '\0') return false;
+  if(!block->length) return true;
+
+  /* The compiler checks blocks without an init_checker() */
+  pthread_once(&processChecker, _setup_process_checker);
+  /* Everything below comes out of the pass that decodes the block for
+   * update_gcode_state(), the line itself is never looked at again */
+  if(!(table = load_gcode_words(block))) return false;
+  letters = table->letters;
+  word = table->words;
+  /* A line number may lead the block */
+  if(word < table->wordsEnd && word->letter == 'N') word++;
+  /* So may a program number, as the last word in the block */
+  if(word < table->wordsEnd && word->letter == 'O') {
+    if(&word[1] != table->wordsEnd) {
+      display_machine_message("PER: Program number must stand alone!");
+      return false;
+    }
+    word++;
   }
+  /* Either of them once, anywhere else is an illegal word address */
+  if(word > table->words && !(table->repeated & numberLetters))
+    letters &= ~numberLetters;
 
-  /* From here on we process things word-by-word */
-//  while(*checkp) {
-    /* Illegal word address given or syntax error (e.g. bare number) */
-//    if(!strchr(allowedWords, *checkp)) return false;
-//    if(*checkp == 'G') {
-      /* Check for modal group violations */
-//    } else if(*checkp == 'M') {
-      /* Check for modal group violations */
-//    } else {
-      /* Check if we have seen this word before in this block */
-//    }
-//  }
+  /* Illegal word address given or syntax error (e.g. bare number) */
+  if(!table->clean || (letters & ~allowedLetters)) {
+    display_machine_message("PER: Illegal word in block!");
+    return false;
+  }
+  /* Same word given more than once */
+  if((table->repeated & ~repeatableLetters) || table->repeatedG ||
+     table->repeatedM) {
+    display_machine_message("PER: Word repeated in block!");
+    return false;
+  }
+  /* Two codes from the same modal group */
+  if(!_check_modal_groups(table->G, G2ModalGroup, sizeof(G2ModalGroup)) ||
+     !_check_modal_groups(table->M, M2ModalGroup, sizeof(M2ModalGroup))) {
+    display_machine_message("PER: Modal group violation in block!");
+    return false;
+  }
+  /* Good to be served pre-decoded, should the input come back here */
+  cache_line_input(block, table->words, table->wordsEnd - table->words);
 
   return true;
 }
@@ -0,0 +1,249 @@
+/*
+ ============================================================================
+ Name        : gcode-checkpoint.c
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Interpreter Checkpoint Code
+ ============================================================================
+ */
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gcode-commons.h"
+#include "gcode-checkpoint.h"
+#include "gcode-debugcon.h"
+#include "gcode-input.h"
+#include "gcode-machine.h"
+#include "gcode-parameters.h"
+#include "gcode-stacks.h"
+#include "gcode-context.h"
+
+
+/* State lives in the calling thread's context, see gcode-context.h */
+#define CKP(x) (gcodeContext->checkpointContext.x)
+
+
+/* SIGUSR1 goes to the whole process, the first context to finish a block
+ * after it writes the checkpoint */
+static volatile sig_atomic_t signalled;
+
+
+static void _signal_checkpoint(int signal) {
+  signalled = 1;
+}
+
+/* Plain data parts of the context go as they are, modules that keep theirs
+ * on the heap write it themselves */
+static bool _write_checkpoint(FILE *target) {
+  TGCodeStateContext *state = &gcodeContext->stateContext;
+  TGCodeCheckpointHeader header;
+
+  memset(&header, 0x00, sizeof(header));
+  memcpy(header.magic, GCODE_CHECKPOINT_MAGIC, sizeof(header.magic));
+  header.version = GCODE_CHECKPOINT_VERSION;
+  header.byteOrder = GCODE_CHECKPOINT_BYTE_ORDER;
+  header.contextSize = sizeof(TGCodeContext);
+
+  return identify_input(&header.input) &&
+         fwrite(&header, sizeof(header), 1, target) == 1 &&
+         fwrite(&gcodeContext->parametersContext,
+                sizeof(TGCodeParameterContext), 1, target) == 1 &&
+         fwrite(&gcodeContext->toolsContext,
+                sizeof(TGCodeToolContext), 1, target) == 1 &&
+         fwrite(&gcodeContext->machineContext,
+                sizeof(TGCodeMachineContext), 1, target) == 1 &&
+         fwrite(&gcodeContext->queueContext,
+                sizeof(TGCodeQueueContext), 1, target) == 1 &&
+         fwrite(&state->currentGCodeState, sizeof(TGCodeState), 1,
+                target) == 1 &&
+         fwrite(&state->stillRunning, sizeof(bool), 1, target) == 1 &&
+         fwrite(&state->cycleX, sizeof(double), 1, target) == 1 &&
+         fwrite(&state->cycleY, sizeof(double), 1, target) == 1 &&
+         fwrite(&state->cycleZ, sizeof(double), 1, target) == 1 &&
+         fwrite(&state->lastZ, sizeof(double), 1, target) == 1 &&
+         fwrite(&CKP(blocks), sizeof(CKP(blocks)), 1, target) == 1 &&
+         fwrite(&CKP(written), sizeof(CKP(written)), 1, target) == 1 &&
+         save_stacks(target) && save_input(target);
+}
+
+/* Puts a checkpoint in place of the previous one, or after it */
+static bool _put_checkpoint(const char *data, size_t size) {
+  FILE *target;
+  char *temporary;
+  bool result;
+
+  if(CKP(stream))
+    return fwrite(data, 1, size, CKP(stream)) == size &&
+           !fflush(CKP(stream));
+
+  temporary = (char *)malloc(strlen(CKP(name)) +
+                             strlen(GCODE_CHECKPOINT_SUFFIX) + 1);
+  if(!temporary) return false;
+  strcpy(temporary, CKP(name));
+  strcat(temporary, GCODE_CHECKPOINT_SUFFIX);
+  /* Never leave a half written one where the last good one was */
+  if((target = fopen(temporary, "w"))) {
+    result = fwrite(data, 1, size, target) == size;
+    result = !fclose(target) && result &&
+             !rename(temporary, CKP(name));
+    if(!result) remove(temporary);
+  } else result = false;
+  free(temporary);
+
+  return result;
+}
+
+bool init_checkpoint(void *data) {
+  const TGCodeCheckpointSetup *setup = (const TGCodeCheckpointSetup *)data;
+  struct sigaction action;
+
+  CKP(name) = (setup ? setup->name : NULL);
+  CKP(stream) = (setup && !CKP(name) ? setup->stream : NULL);
+  CKP(every) = (setup ? setup->every : 0);
+  CKP(blocks) = 0;
+  CKP(requested) = false;
+  CKP(written) = 0;
+  CKP(handling) = false;
+  if(!CKP(name) && !CKP(stream)) return true;
+
+  memset(&action, 0x00, sizeof(action));
+  action.sa_handler = _signal_checkpoint;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  CKP(handling) = !sigaction(SIGUSR1, &action, &CKP(previousAction));
+  GCODE_DEBUG("Checkpoints go to %s, on M%d, SIGUSR1 and every %llu blocks",
+              (CKP(name) ? CKP(name) : "a stream"),
+              GCODE_CHECKPOINT_CODE, (unsigned long long)CKP(every));
+
+  return true;
+}
+
+void request_checkpoint(void) {
+  CKP(requested) = true;
+}
+
+void step_checkpoint(void) {
+  FILE *memory;
+  char *data = NULL, message[0xFF];
+  size_t size = 0;
+  bool result;
+
+  if(!CKP(name) && !CKP(stream)) return;
+  CKP(blocks)++;
+  if(CKP(every) && !(CKP(blocks) % CKP(every))) CKP(requested) = true;
+  if(signalled) {
+    signalled = 0;
+    CKP(requested) = true;
+  }
+  /* Nothing a fast-forwarded block did has been output yet */
+  if(!CKP(requested) || gcodeContext->machineContext.fastForward) return;
+
+  /* Put together in memory first, it may turn out it can't be done here. It
+   * counts itself, so that a run resumed from it counts on the same way */
+  if(!(memory = open_memstream(&data, &size))) return;
+  CKP(written)++;
+  result = _write_checkpoint(memory);
+  fclose(memory);
+  if(!result) CKP(written)--;
+  else {
+    CKP(requested) = false;
+    if(_put_checkpoint(data, size)) {
+      snprintf(message, sizeof(message), "STA: Checkpoint %u written",
+               CKP(written));
+      display_machine_message(message);
+    } else display_machine_message("IER: Unable to write checkpoint!");
+  }
+  free(data);
+}
+
+bool save_checkpoint(FILE *target) {
+  FILE *memory;
+  char *data = NULL;
+  size_t size = 0;
+  bool result;
+
+  if(!target || !(memory = open_memstream(&data, &size))) return false;
+  result = _write_checkpoint(memory);
+  fclose(memory);
+  result = result && fwrite(data, 1, size, target) == size;
+  free(data);
+
+  return result;
+}
+
+bool restore_checkpoint(FILE *source) {
+  TGCodeStateContext *state = &gcodeContext->stateContext;
+  TGCodeCheckpointHeader header;
+  TGCodeInputIdentity identity;
+  FILE *parameterStore = gcodeContext->parametersContext.parameterStore;
+  uint64_t parameterWrites = gcodeContext->parametersContext.parameterWrites;
+  TGCodeMachineContext *machine = &gcodeContext->machineContext;
+  TGCodeDryRunReport dryRunReport = machine->dryRunReport;
+  bool fastForward = machine->fastForward, dryRun = machine->dryRun, result;
+
+  if(!source || fread(&header, sizeof(header), 1, source) != 1 ||
+     memcmp(header.magic, GCODE_CHECKPOINT_MAGIC, sizeof(header.magic))) {
+    display_machine_message("IER: Not a checkpoint!");
+    return false;
+  }
+  if(header.version != GCODE_CHECKPOINT_VERSION ||
+     header.byteOrder != GCODE_CHECKPOINT_BYTE_ORDER ||
+     header.contextSize != sizeof(TGCodeContext)) {
+    display_machine_message("IER: Checkpoint is for another version or machine!");
+    return false;
+  }
+  /* Offsets and indexes are meaningless in any other file */
+  if(!identify_input(&identity) ||
+     memcmp(&identity, &header.input, sizeof(identity))) {
+    display_machine_message("IER: Checkpoint is for another program!");
+    return false;
+  }
+
+  result = fread(&gcodeContext->parametersContext,
+                 sizeof(TGCodeParameterContext), 1, source) == 1 &&
+           fread(&gcodeContext->toolsContext,
+                 sizeof(TGCodeToolContext), 1, source) == 1 &&
+           fread(machine, sizeof(TGCodeMachineContext), 1, source) == 1 &&
+           fread(&gcodeContext->queueContext,
+                 sizeof(TGCodeQueueContext), 1, source) == 1 &&
+           fread(&state->currentGCodeState, sizeof(TGCodeState), 1,
+                 source) == 1 &&
+           fread(&state->stillRunning, sizeof(bool), 1, source) == 1 &&
+           fread(&state->cycleX, sizeof(double), 1, source) == 1 &&
+           fread(&state->cycleY, sizeof(double), 1, source) == 1 &&
+           fread(&state->cycleZ, sizeof(double), 1, source) == 1 &&
+           fread(&state->lastZ, sizeof(double), 1, source) == 1 &&
+           fread(&CKP(blocks), sizeof(CKP(blocks)), 1, source) == 1 &&
+           fread(&CKP(written), sizeof(CKP(written)), 1, source) == 1 &&
+           restore_stacks(source) && restore_input(source);
+  /* Those belong to this run, not the one that wrote the checkpoint */
+  gcodeContext->parametersContext.parameterStore = parameterStore;
+  /* Results this run worked out before are no good anymore */
+  gcodeContext->parametersContext.parameterWrites = parameterWrites;
+  touch_parameters();
+  machine->fastForward = fastForward;
+  machine->dryRun = dryRun;
+  machine->dryRunReport = dryRunReport;
+
+  if(result) display_machine_message("STA: Resumed from checkpoint");
+  else display_machine_message("IER: Checkpoint is truncated!");
+
+  return result;
+}
+
+bool done_checkpoint(void) {
+  GCODE_DEBUG("Checkpoints: %u written", CKP(written));
+  /* Every run in the process (--differential, --batch) comes through here */
+  if(CKP(handling)) sigaction(SIGUSR1, &CKP(previousAction), NULL);
+  CKP(handling) = false;
+  CKP(name) = NULL;
+  CKP(stream) = NULL;
+
+  return true;
+}
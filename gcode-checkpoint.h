@@ -0,0 +1,83 @@
+/*
+ ============================================================================
+ Name        : gcode-checkpoint.h
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Interpreter Checkpoint API Header
+ ============================================================================
+ */
+
+#ifndef GCODE_CHECKPOINT_H_
+#define GCODE_CHECKPOINT_H_
+
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "gcode-commons.h"
+#include "gcode-input.h"
+
+
+#define GCODE_CHECKPOINT_MAGIC "GCK\x1A"
+#define GCODE_CHECKPOINT_VERSION 2
+/* Written as is, reads back differently on a machine of the other endianness */
+#define GCODE_CHECKPOINT_BYTE_ORDER 0x01020304U
+
+/* A checkpoint is the header followed by the parts of the context that make up
+ * the interpreter state, as they are in memory. contextSize catches builds
+ * that lay those out differently */
+typedef struct {
+  char magic[4];
+  uint16_t version;
+  uint16_t reserved;
+  uint32_t byteOrder;
+  uint32_t contextSize; /* sizeof(TGCodeContext) of the writing build */
+  TGCodeInputIdentity input; /* Of the program it was written for */
+} TGCodeCheckpointHeader;
+
+/* Where and when checkpoints get written, for init_checkpoint() */
+typedef struct {
+  const char *name; /* Replaced by every checkpoint, NULL: use stream */
+  FILE *stream; /* Every checkpoint is appended to it */
+  uint64_t every; /* Blocks in between two checkpoints, 0: only on request */
+} TGCodeCheckpointSetup;
+
+typedef struct {
+  const char *name;
+  FILE *stream;
+  uint64_t every, blocks;
+  bool requested;
+  uint32_t written;
+  /* What SIGUSR1 did before init_checkpoint(), put back by done_checkpoint() */
+  struct sigaction previousAction;
+  bool handling;
+} TGCodeCheckpointContext;
+
+
+/* Takes a pointer to a TGCodeCheckpointSetup, NULL to never write any. With
+ * somewhere to write them to, a checkpoint is written on M76 (see
+ * GCODE_CHECKPOINT_CODE), every so many blocks and on SIGUSR1 */
+bool init_checkpoint(void *data);
+/* Have a checkpoint written once the current block is done */
+void request_checkpoint(void);
+/* Call after every block, once the machine had its go at the queue. Writes a
+ * checkpoint if one is due, or postpones it to the first block boundary that
+ * is neither inside spliced text (e.g. a canned cycle) nor fast-forwarded */
+void step_checkpoint(void);
+/* Writes the interpreter state to target: everything needed to carry on with
+ * the same program exactly as if it had never stopped. Returns false if that
+ * can't be done right now or on error */
+bool save_checkpoint(FILE *target);
+/* Reads what save_checkpoint() wrote from source into a freshly initialized
+ * interpreter running the same program, which then carries on from there.
+ * The program is told by its identify_input(), a checkpoint of any other one
+ * is refused. Returns false if it can't, the program must not be run any
+ * further then */
+bool restore_checkpoint(FILE *source);
+bool done_checkpoint(void);
+
+
+#endif /* GCODE_CHECKPOINT_H_ */
@@ -12,8 +12,52 @@
 #define GCODE_COMMONS_H_
 
 
-/* How many discrete O words we support */
+/* How many discrete O words we make room for up front, the table doubles in
+ * size as needed. Must be a power of two */
 #define GCODE_PROGRAM_CAPACITY 16
+/* How much of a non-seekable input (e.g. a pipe) we keep around for seeking
+ * back into, and in what increments we read it */
+#define GCODE_INPUT_SPOOL_SIZE (16UL << 20)
+#define GCODE_INPUT_SPOOL_CHUNK (64UL << 10)
+/* How much decompressed input lies between two points a compressed input can
+ * be restarted from. Each one costs a 32KiB window, so keep this well above
+ * that and well below half the spool */
+#define GCODE_INPUT_CHECKPOINT_SPAN (1UL << 20)
+/* Initial size of the buffers blocks and comments are rewritten into, they
+ * double as needed so there is no limit on line length */
+#define GCODE_INPUT_ARENA_SIZE 256
+/* Decoded blocks kept for when loops and subprograms come around again: slots
+ * the cache starts out with (a power of two, doubling as needed) and the most
+ * words all of them together may hold */
+#define GCODE_INPUT_CACHE_SLOTS 256
+#define GCODE_INPUT_CACHE_WORDS (1UL << 20)
+/* Subprograms get compiled into instructions on this many-th call, unless
+ * longer than this many blocks */
+#define GCODE_SUBPROGRAM_HOT_CALLS 8
+#define GCODE_SUBPROGRAM_INSTRUCTIONS 4096
+/* Size of each of the two buffers the optional read-ahead thread fills */
+#define GCODE_READER_BUFFER_SIZE (1UL << 20)
+/* How long either side of the read-ahead naps while waiting for the other, at
+ * first and at most: naps double while the wait goes on */
+#define GCODE_READER_NAP_NS 20000L
+#define GCODE_READER_NAP_MAX_NS 2000000L
+/* How deep splices may nest: canned cycles, subprograms called from them and
+ * canned cycles in those and so on */
+#define GCODE_INPUT_SPLICE_DEPTH 8
+/* After this many blocks in a row could not be viewed in place, only every
+ * this many-th one is checked for it */
+#define GCODE_INPUT_VIEW_RETRY 16
+
+/* Compiled expressions kept for when loops and subprograms come around again:
+ * slots the cache starts out with and the most it grows to (powers of two).
+ * Expressions needing a deeper stack than this get theirs from the heap */
+#define GCODE_EXPRESSION_CACHE_SLOTS 64
+#define GCODE_EXPRESSION_CACHE_MAX_SLOTS (1UL << 16)
+#define GCODE_EXPRESSION_STACK 32
+/* A cached expression's result is reused until one of the parameters it reads
+ * changes, as long as it reads up to this many. Reading more, any change to
+ * any parameter makes it run again */
+#define GCODE_EXPRESSION_READS 8
 
 /* Where is our parameter store */
 #define GCODE_PARAMETER_STORE "parameters.csv"
@@ -22,6 +66,16 @@
 /* How many parameter updates in a single line we support */
 #define GCODE_PARAMETER_UPDATES 53
 
+/* M code asking for a checkpoint to be written (see gcode-checkpoint.h) and
+ * what a checkpoint is written to first, before it replaces the previous one */
+#define GCODE_CHECKPOINT_CODE 76
+#define GCODE_CHECKPOINT_SUFFIX ".tmp"
+
+/* What --batch appends to a program's name to get where its output goes */
+#define GCODE_BATCH_SUFFIX ".log"
+/* Most worker threads --batch will ever run */
+#define GCODE_BATCH_WORKERS 256
+
 /* How many tools we support */
 #define GCODE_TOOL_COUNT 100
 /* Where is the tool data stored */
@@ -66,6 +120,8 @@
 
 /* Handy for feeding decimal values back to us */
 #define GCODE_REAL_FORMAT "%4.4f"
+/* Longest number read_gcode_real() will parse without allocating */
+#define GCODE_REAL_DIGITS 63
 
 /* How many moves will we ever queue before executing them */
 #define GCODE_LOOKAHEAD_DEPTH 8
@@ -0,0 +1,334 @@
+/*
+ ============================================================================
+ Name        : gcode-compiler.c
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : G-Code Program Compiler Code
+ ============================================================================
+ */
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gcode-commons.h"
+#include "gcode-compiler.h"
+#include "gcode-debugcon.h"
+#include "gcode-checker.h"
+#include "gcode-expression.h"
+#include "gcode-machine.h"
+#include "gcode-state.h"
+
+
+/* Growable output buffer, the compiled program is assembled in memory */
+typedef struct {
+  char *data;
+  size_t size, used;
+} TGCodeCompilerBuffer;
+
+static TGCodeCompilerBuffer blocks, programs, numbers;
+static TGCodeWord *words;
+static size_t wordRoom;
+static char *text;
+static size_t textRoom;
+
+
+static bool _put_buffer(TGCodeCompilerBuffer *buffer, const void *data,
+                        size_t length) {
+  /* Everything in a compiled program is 8 byte aligned */
+  size_t padded = (length + 7) & ~(size_t)7;
+
+  if(buffer->used + padded > buffer->size) {
+    size_t size = (buffer->size ? buffer->size : GCODE_INPUT_SPOOL_CHUNK);
+    char *grown;
+
+    while(buffer->used + padded > size) size *= 2;
+    grown = (char *)realloc(buffer->data, size);
+    if(!grown) return false;
+    buffer->data = grown;
+    buffer->size = size;
+  }
+  memcpy(&buffer->data[buffer->used], data, length);
+  memset(&buffer->data[buffer->used + length], 0x00, padded - length);
+  buffer->used += padded;
+
+  return true;
+}
+
+static bool _put_index(TGCodeCompilerBuffer *buffer, unsigned long number) {
+  TGCodeCompiledIndexEntry entry;
+
+  memset(&entry, 0x00, sizeof(entry));
+  /* Same truncation the interpreter applies to what strtoul() returns */
+  entry.number = (uint32_t)number;
+  entry.offset = blocks.used;
+
+  return _put_buffer(buffer, &entry, sizeof(entry));
+}
+
+static bool _put_record(uint16_t kind, const void *data, uint32_t count,
+                        size_t length) {
+  TGCodeCompiledRecord record;
+
+  memset(&record, 0x00, sizeof(record));
+  record.size = sizeof(record) + ((length + 7) & ~(size_t)7);
+  record.kind = kind;
+  record.count = count;
+
+  return _put_buffer(&blocks, &record, sizeof(record)) &&
+         (!length || _put_buffer(&blocks, data, length));
+}
+
+/* Sanitizes a source line the way gcode-input would, as long as that takes
+ * nothing but the line itself: blanks, case, program separators, comments that
+ * aren't messages and the N and O words at the start. Those are indexed either
+ * way since they never depend on run time state. Returns false if the line has
+ * to go through the lexer at run time (messages, expressions, block delete,
+ * anything unusual) */
+static bool _sanitize_line(const char *line, size_t length, size_t *textLength) {
+  const char *close;
+  size_t r = 0, w = 0;
+  bool plain = true, leading = true;
+
+  if(textRoom < length + 1) {
+    char *grown = (char *)realloc(text, length + 1);
+
+    if(!grown) return false;
+    text = grown;
+    textRoom = length + 1;
+  }
+
+  while(r < length) {
+    unsigned char c = line[r];
+
+    if(c == ' ' || c == '\t' || c == '%') r++;
+    else if(c == '(') {
+      /* Only an unterminated comment at the very end of input has no ) */
+      if(!(close = (const char *)memchr(&line[r], ')', length - r)))
+        return false;
+      if(close - &line[r] > (ptrdiff_t)strlen("MSG,") &&
+         !strncmp(&line[r + 1], "MSG,", strlen("MSG,"))) plain = false;
+      r = close - line + 1;
+    } else if(leading && (toupper(c) == 'N' || toupper(c) == 'O')) {
+      unsigned long number = 0;
+
+      /* Same saturation as in gcode-input */
+      while(++r < length && isdigit((unsigned char)line[r]))
+        number = (number > (ULONG_MAX - (line[r] - '0')) / 10 ?
+                  ULONG_MAX : number * 10 + (line[r] - '0'));
+      if(toupper(c) == 'O') {
+        if(!_put_index(&programs, number)) return false;
+      } else {
+        /* Gets complained about at run time */
+        if(!number) plain = false;
+        if(!_put_index(&numbers, number)) return false;
+      }
+    } else if(leading && c == '/') return false;
+    else if(isalnum(c) || c == '.' || c == '+' || c == '-' || c == '#' ||
+            c == '=') {
+      leading = false;
+      text[w++] = toupper(c);
+      r++;
+    } else return false;
+  }
+  text[w] = '\0';
+  *textLength = w;
+
+  return plain;
+}
+
+/* Splits sanitized text into words, returns false if any of it would read
+ * differently that way than through gcode-state's text queries */
+static bool _decode_line(size_t length, size_t *count) {
+  size_t w;
+  bool clean;
+
+  if(wordRoom < length) {
+    TGCodeWord *grown = (TGCodeWord *)realloc(words,
+                                              length * sizeof(TGCodeWord));
+
+    if(!grown) return false;
+    words = grown;
+    wordRoom = length;
+  }
+  /* Padding goes to disk, keep it predictable */
+  memset(words, 0x00, length * sizeof(TGCodeWord));
+
+  w = decode_gcode_words(text, length, words, &clean);
+  /* Parameter assignments are read as pairs */
+  if(!clean || !paired_gcode_words(words, w)) return false;
+  *count = w;
+
+  return true;
+}
+
+static bool _compile_line(const char *line, size_t length, size_t terminator,
+                          uint64_t *decoded) {
+  TGCodeBlockView block;
+  size_t textLength, count;
+
+  if(_sanitize_line(line, length, &textLength)) {
+    /* Nothing but line/program numbers, comments or blanks */
+    if(!textLength) return true;
+    /* The interpreter drops an unterminated last line, let it do just that */
+    if(!terminator) return _put_record(GCODE_COMPILED_TEXT, line, length,
+                                       length);
+    block.text = text;
+    block.length = textLength;
+    block.words = NULL;
+    block.wordCount = 0;
+    block.table = NULL;
+    if(!has_unary_expression(text, textLength) && gcode_check(&block) &&
+       _decode_line(textLength, &count)) {
+      (*decoded)++;
+      return _put_record(GCODE_COMPILED_WORDS, words, count,
+                         count * sizeof(TGCodeWord));
+    }
+  }
+
+  return _put_record(GCODE_COMPILED_TEXT, line, length + terminator,
+                     length + terminator);
+}
+
+/* Finds where the line starting at line ends. Comments and expressions may
+ * run across line breaks, those are kept together as one line */
+static const char *_end_of_line(const char *line, const char *end) {
+  const char *eol = line;
+  size_t depth = 0;
+
+  for(; eol < end; eol++)
+    if(*eol == '(' && !depth) {
+      if(!(eol = (const char *)memchr(eol, ')', end - eol))) return end;
+    } else if(*eol == '[') depth++;
+    else if(*eol == ']' && depth) depth--;
+    else if((*eol == '\n' || *eol == '\r') && !depth) break;
+
+  return eol;
+}
+
+static bool _write_buffer(FILE *target, const TGCodeCompilerBuffer *buffer) {
+  return !buffer->used ||
+         fwrite(buffer->data, 1, buffer->used, target) == buffer->used;
+}
+
+static bool _write_compiler(FILE *target, const TGCodeCompiledHeader *header) {
+  return fwrite(header, sizeof(*header), 1, target) == 1 &&
+         _write_buffer(target, &blocks) && _write_buffer(target, &programs) &&
+         _write_buffer(target, &numbers) && !fflush(target);
+}
+
+bool run_compiler(FILE *source, FILE *target) {
+  TGCodeCompilerBuffer input;
+  TGCodeCompiledHeader header;
+  const char *line, *eol, *end;
+  size_t got, terminator;
+  uint64_t lines = 0, decoded = 0;
+  bool result = true;
+  char message[0xFF];
+
+  memset(&input, 0x00, sizeof(input));
+  memset(&blocks, 0x00, sizeof(blocks));
+  memset(&programs, 0x00, sizeof(programs));
+  memset(&numbers, 0x00, sizeof(numbers));
+  words = NULL;
+  text = NULL;
+  wordRoom = textRoom = 0;
+
+  if(!source || !target) {
+    display_machine_message("IER: Nothing to compile from or to!");
+    return false;
+  }
+  /* Source may well be a pipe, so no mapping it */
+  do {
+    if(input.used == input.size) {
+      char *grown;
+
+      input.size = (input.size ? input.size * 2 : GCODE_INPUT_SPOOL_CHUNK);
+      if(!(grown = (char *)realloc(input.data, input.size))) {
+        result = false;
+        break;
+      }
+      input.data = grown;
+    }
+    got = fread(&input.data[input.used], 1, input.size - input.used, source);
+    input.used += got;
+  } while(got);
+
+  /* The interpreter reads 0xFF as EOF and never looks any further */
+  end = (input.used ? (const char *)memchr(input.data, (char)EOF, input.used) :
+                      NULL);
+  if(!end) end = input.data + input.used;
+  for(line = input.data; result && line < end; line = &eol[terminator]) {
+    /* CR LF, LF or a lone CR end a line, just like in gcode-input */
+    eol = _end_of_line(line, end);
+    terminator = (eol == end ? 0 :
+                  (*eol == '\r' && &eol[1] < end && eol[1] == '\n' ? 2 : 1));
+    result = _compile_line(line, eol - line, terminator, &decoded);
+    lines++;
+  }
+
+  if(result) {
+    memset(&header, 0x00, sizeof(header));
+    memcpy(header.magic, GCODE_COMPILED_MAGIC, sizeof(header.magic));
+    header.version = GCODE_COMPILED_VERSION;
+    header.wordSize = sizeof(TGCodeWord);
+    header.byteOrder = GCODE_COMPILED_BYTE_ORDER;
+    header.programCount = programs.used / sizeof(TGCodeCompiledIndexEntry);
+    header.numberCount = numbers.used / sizeof(TGCodeCompiledIndexEntry);
+    header.blocksAt = sizeof(header);
+    header.blocksSize = blocks.used;
+    header.programsAt = header.blocksAt + blocks.used;
+    header.numbersAt = header.programsAt + programs.used;
+    result = _write_compiler(target, &header);
+  } else {
+    display_machine_message("IER: Out of memory while compiling!");
+    result = false;
+  }
+
+  if(result) {
+    snprintf(message, sizeof(message),
+             "STA: Compiled %llu lines, %llu blocks decoded, %u programs",
+             (unsigned long long)lines, (unsigned long long)decoded,
+             (unsigned int)(programs.used / sizeof(TGCodeCompiledIndexEntry)));
+    display_machine_message(message);
+  } else display_machine_message("IER: Unable to write compiled program!");
+
+  free(input.data);
+  free(blocks.data);
+  free(programs.data);
+  free(numbers.data);
+  free(words);
+  free(text);
+
+  return result;
+}
+
+bool check_compiler(const TGCodeCompiledHeader *header, size_t size) {
+  size_t entry = sizeof(TGCodeCompiledIndexEntry);
+
+  if(size < sizeof(*header) ||
+     memcmp(header->magic, GCODE_COMPILED_MAGIC, sizeof(header->magic)))
+    return false;
+  if(header->version != GCODE_COMPILED_VERSION ||
+     header->wordSize != sizeof(TGCodeWord) ||
+     header->byteOrder != GCODE_COMPILED_BYTE_ORDER) {
+    display_machine_message("IER: Compiled program is for another version or machine!");
+    return false;
+  }
+  if(header->blocksAt % 8 || header->programsAt % 8 || header->numbersAt % 8 ||
+     header->blocksAt > size ||
+     header->blocksSize > size - header->blocksAt ||
+     header->programsAt > size || header->programCount > (size - header->programsAt) / entry ||
+     header->numbersAt > size || header->numberCount > (size - header->numbersAt) / entry) {
+    display_machine_message("IER: Compiled program is truncated!");
+    return false;
+  }
+
+  return true;
+}
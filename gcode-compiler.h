@@ -0,0 +1,72 @@
+/*
+ ============================================================================
+ Name        : gcode-compiler.h
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : G-Code Program Compiler API Header
+ ============================================================================
+ */
+
+#ifndef GCODE_COMPILER_H_
+#define GCODE_COMPILER_H_
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "gcode-input.h"
+
+
+#define GCODE_COMPILED_MAGIC "NCB\x1A"
+#define GCODE_COMPILED_VERSION 2
+/* Written as is, reads back differently on a machine of the other endianness */
+#define GCODE_COMPILED_BYTE_ORDER 0x01020304U
+
+/* Source line stored as pre-decoded words */
+#define GCODE_COMPILED_WORDS 1
+/* Source line stored verbatim, gcode-input lexes it at run time */
+#define GCODE_COMPILED_TEXT 2
+
+/* A compiled program is laid out as header, blocks, program table and line
+ * number table, each starting on an 8 byte boundary. All offsets in the tables
+ * (and those seen through tell_input()) are relative to the first block */
+typedef struct {
+  char magic[4];
+  uint16_t version;
+  uint16_t wordSize; /* sizeof(TGCodeWord) of the compiling machine */
+  uint32_t byteOrder;
+  uint32_t programCount;
+  uint32_t numberCount;
+  uint32_t reserved;
+  uint64_t blocksAt, blocksSize;
+  uint64_t programsAt, numbersAt;
+} TGCodeCompiledHeader;
+
+/* Followed by count TGCodeWords or count characters of source, then padding */
+typedef struct {
+  uint32_t size; /* Whole record, always a multiple of 8 */
+  uint16_t kind;
+  uint16_t reserved;
+  uint32_t count;
+  uint32_t padding;
+} TGCodeCompiledRecord;
+
+/* Used for both O and N words */
+typedef struct {
+  uint32_t number;
+  uint32_t reserved;
+  int64_t offset;
+} TGCodeCompiledIndexEntry;
+
+
+/* Reads G-Code from source and writes it to target in compiled form: every
+ * line that can be is decoded into words, the rest is kept as text for
+ * gcode-input to lex at run time. Returns false on error */
+bool run_compiler(FILE *source, FILE *target);
+/* Returns true if header starts a compiled program this build can run */
+bool check_compiler(const TGCodeCompiledHeader *header, size_t size);
+
+
+#endif /* GCODE_COMPILER_H_ */
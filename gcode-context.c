@@ -0,0 +1,46 @@
+/*
+ ============================================================================
+ Name        : gcode-context.c
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Interpreter Context Code
+ ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gcode-commons.h"
+#include "gcode-context.h"
+#include "gcode-debugcon.h"
+
+
+static TGCodeContext defaultContext;
+
+__thread TGCodeContext *gcodeContext = &defaultContext;
+/* Kept apart so gcode-debugcon.h needs no more than this */
+__thread FILE *gcodeConsole;
+__thread bool gcodeQuiet;
+
+
+TGCodeContext *create_context(void) {
+  return (TGCodeContext *)calloc(1, sizeof(TGCodeContext));
+}
+
+TGCodeContext *select_context(TGCodeContext *context) {
+  TGCodeContext *previous = gcodeContext;
+
+  gcodeContext = context;
+  gcodeConsole = context->console;
+  gcodeQuiet = context->quiet;
+
+  return previous;
+}
+
+void destroy_context(TGCodeContext *context) {
+  if(!context || context == &defaultContext) return;
+  /* Outlives done_*(), the decoder keeps it around between programs */
+  free(context->stateContext.textWords);
+  free(context);
+}
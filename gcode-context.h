@@ -0,0 +1,66 @@
+/*
+ ============================================================================
+ Name        : gcode-context.h
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Interpreter Context API Header
+ ============================================================================
+ */
+
+#ifndef GCODE_CONTEXT_H_
+#define GCODE_CONTEXT_H_
+
+
+#include "gcode-commons.h"
+#include "gcode-parameters.h"
+#include "gcode-stacks.h"
+#include "gcode-tools.h"
+#include "gcode-machine.h"
+#include "gcode-queue.h"
+#include "gcode-cycles.h"
+#include "gcode-input.h"
+#include "gcode-reader.h"
+#include "gcode-state.h"
+#include "gcode-subprogram.h"
+#include "gcode-checkpoint.h"
+#include "gcode-expression.h"
+
+
+/* Everything one run of the interpreter keeps between blocks. Modules reach
+ * their part of it through gcodeContext, each with an accessor of its own
+ * (e.g. IN(inputp) in gcode-input.c), so any number of programs can be run at
+ * the same time, one per thread */
+typedef struct {
+  FILE *console; /* Where machine messages and debug output go, NULL: stdout */
+  bool quiet; /* Debug output muted, machine messages still go out */
+  TGCodeParameterContext parametersContext;
+  TGCodeStackContext stacksContext;
+  TGCodeToolContext toolsContext;
+  TGCodeMachineContext machineContext;
+  TGCodeQueueContext queueContext;
+  TGCodeCycleContext cyclesContext;
+  TGCodeInputContext inputContext;
+  TGCodeReaderContext readerContext;
+  TGCodeStateContext stateContext;
+  TGCodeSubprogramContext subprogramContext;
+  TGCodeCheckpointContext checkpointContext;
+  TGCodeExpressionContext expressionContext;
+} TGCodeContext;
+
+
+/* Context the calling thread works on. Every thread starts out on the same
+ * default one, which is all a single program run ever needs */
+extern __thread TGCodeContext *gcodeContext;
+
+/* Returns a fresh context (as if the program was just started), NULL if out of
+ * memory. The usual init_*() calls still need to be made on it */
+TGCodeContext *create_context(void);
+/* Makes context (and its console) the one the calling thread works on,
+ * returns the previous */
+TGCodeContext *select_context(TGCodeContext *context);
+/* Frees a context once the done_*() calls have been made on it */
+void destroy_context(TGCodeContext *context);
+
+
+#endif /* GCODE_CONTEXT_H_ */
@@ -22,73 +22,66 @@
 #include "gcode-debugcon.h"
 #include "gcode-machine.h"
 #include "gcode-parameters.h"
+#include "gcode-context.h"
 
 
-static uint8_t curSlice;
-static char *slices[GCODE_CYCLE_MAXSLICES];
+/* State lives in the calling thread's context, see gcode-context.h */
+#define CYC(x) (gcodeContext->cyclesContext.x)
 
 
 static bool _add_generated_line(const char *format, ...) {
   va_list ap;
+  int length;
 
   va_start(ap, format);
-  vsnprintf(slices[0], GCODE_CYCLE_BUFSLICE, format, ap);
+  length = vsnprintf(&CYC(cycleText)[CYC(cycleUsed)],
+                     CYC(cycleSize) - CYC(cycleUsed), format, ap);
   va_end(ap);
+  if(length < 0) return false;
 
-  if((strlen(slices[curSlice]) + strlen(slices[0])) >= GCODE_CYCLE_BUFSLICE) {
-    if(curSlice < GCODE_CYCLE_MAXSLICES - 1)
-      slices[++curSlice] = (char *)calloc(GCODE_CYCLE_BUFSLICE, 1);
-    else {
+  if(CYC(cycleUsed) + length >= CYC(cycleSize)) {
+    size_t size = CYC(cycleSize);
+    char *grown;
+
+    while(CYC(cycleUsed) + length >= size) size *= 2;
+    if(!(grown = (char *)realloc(CYC(cycleText), size))) {
+      CYC(cycleText)[CYC(cycleUsed)] = '\0';
       display_machine_message("PER: Canned cycle injection buffer overflow!");
       return false;
     }
+    CYC(cycleText) = grown;
+    CYC(cycleSize) = size;
+    /* Second time around it fits */
+    va_start(ap, format);
+    vsnprintf(&CYC(cycleText)[CYC(cycleUsed)], CYC(cycleSize) - CYC(cycleUsed),
+              format, ap);
+    va_end(ap);
   }
-
-  strncat(slices[curSlice], slices[0], GCODE_CYCLE_BUFSLICE);
-  slices[0][0] = '\0';
+  CYC(cycleUsed) += length;
 
   return true;
 }
 
-static void _reset_slices(void) {
-  uint8_t i;
-
-  for(i = curSlice; i > 1; i--)
-    free((void *)slices[i]);
-  curSlice = 1;
-  slices[curSlice][0] = '\0';
-}
-
-static char *_build_cycle(void) {
-  uint8_t i;
-  size_t size = 0;
-  char *cycle;
-
-  for(i = curSlice; i; i--) size += strlen(slices[i]);
-  cycle = (char *)calloc(size + 1, 1);
-  for(i = 1; i <= curSlice; i++) strncat(cycle, slices[i], size);
-  _reset_slices();
-
-  return cycle;
-}
-
 bool init_cycles(void *data) {
-  slices[0] = (char *)calloc(GCODE_CYCLE_BUFSLICE, 1);
-  slices[1] = (char *)calloc(GCODE_CYCLE_BUFSLICE, 1);
-  _reset_slices();
+  CYC(cycleSize) = GCODE_CYCLE_BUFFER_SIZE;
+  CYC(cycleText) = (char *)calloc(CYC(cycleSize), 1);
+  CYC(cycleUsed) = 0;
 
-  GCODE_DEBUG("Canned Cycles up, using %d bytes injection buffer",
-              GCODE_CYCLE_BUFSLICE * GCODE_CYCLE_MAXSLICES);
+  GCODE_DEBUG("Canned Cycles up, using %d bytes injection buffer to start with",
+              GCODE_CYCLE_BUFFER_SIZE);
 
   return true;
 }
 
-char *generate_cycles(TGCodeState state, double X, double Y, double Z) {
+const char *generate_cycles(TGCodeState state, double X, double Y, double Z) {
   //TODO: factor feedRetract out as it's superfluous.
   bool feedRetract = false, firstTime = true, fixedR = false;
   uint16_t peckSteps;
   double extraMove, howFarDown = 0.0;
 
+  CYC(cycleUsed) = 0;
+  CYC(cycleText)[0] = '\0';
+
   /* Repetitions */
   while(state.L--) {
     /* First preparatory move */
@@ -234,13 +227,13 @@ char *generate_cycles(TGCodeState state, double X, double Y, double Z) {
     //TODO: make it start in the same direction it was turning before
     _add_generated_line("M03\n");
 
-  return _build_cycle();
+  return CYC(cycleText);
 }
 
 bool done_cycles(void) {
-  _reset_slices();
-  free((void *)slices[0]);
-  free((void *)slices[1]);
+  free(CYC(cycleText));
+  CYC(cycleText) = NULL;
+  CYC(cycleSize) = CYC(cycleUsed) = 0;
 
   return true;
 }
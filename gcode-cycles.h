@@ -15,14 +15,19 @@
 #include "gcode-state.h"
 
 
-#define GCODE_CYCLE_BUFSLICE 0xFFU
-#define GCODE_CYCLE_MAXSLICES 32
+/* Initial size of the buffer cycles are generated into, it doubles as needed */
+#define GCODE_CYCLE_BUFFER_SIZE 0x100U
+
+typedef struct {
+  char *cycleText; /* Reused for every cycle, splice_input() takes a copy */
+  size_t cycleSize, cycleUsed;
+} TGCodeCycleContext;
+
 
 bool init_cycles(void *data);
-/* Generates G-Code for the canned cycle in state.cycle. The char * allocated
- * here will be freed in gcode-input, when the '\0' at its end will be read by
- * fetch_char_input */
-char *generate_cycles(TGCodeState state, double X, double Y, double Z);
+/* Generates G-Code for the canned cycle in state.cycle. The text returned is
+ * only valid until the next call, hand it to splice_input() which copies it */
+const char *generate_cycles(TGCodeState state, double X, double Y, double Z);
 bool done_cycles(void);
 
 #endif /* GCODE_CYCLES_H_ */
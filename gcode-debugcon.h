@@ -13,15 +13,24 @@
 
 
 #include <libgen.h>
+#include <stdbool.h>
+#include <stdio.h>
 
 
-#define GCODE_DEBUG(...) { \
-  printf("[%s](%s@%d): ", basename(__FILE__), __FUNCTION__, __LINE__); \
-  printf(__VA_ARGS__); \
-  printf("\n"); }
-#define GCODE_DEBUG_RAW(...) { \
-  printf(__VA_ARGS__); \
-  printf("\n"); }
+/* Console of the calling thread's context, NULL for stdout */
+extern __thread FILE *gcodeConsole;
+/* Whether the calling thread's context has its debug output muted */
+extern __thread bool gcodeQuiet;
+
+#define GCODE_CONSOLE (gcodeConsole ? gcodeConsole : stdout)
+#define GCODE_DEBUG(...) { if(!gcodeQuiet) { \
+  fprintf(GCODE_CONSOLE, "[%s](%s@%d): ", basename(__FILE__), __FUNCTION__, \
+          __LINE__); \
+  fprintf(GCODE_CONSOLE, __VA_ARGS__); \
+  fprintf(GCODE_CONSOLE, "\n"); } }
+#define GCODE_DEBUG_RAW(...) { if(!gcodeQuiet) { \
+  fprintf(GCODE_CONSOLE, __VA_ARGS__); \
+  fprintf(GCODE_CONSOLE, "\n"); } }
 
 
 #endif /* GCODE_DEBUGCON_H_ */
@@ -10,19 +10,25 @@
 
 #include <ctype.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <strings.h>
 
 #include "gcode-commons.h"
 #include "gcode-expression.h"
 #include "gcode-debugcon.h"
+#include "gcode-input.h"
 #include "gcode-state.h"
 #include "gcode-parameters.h"
+#include "gcode-context.h"
+
+
+/* State lives in the calling thread's context, see gcode-context.h */
+#define EXPR(x) (gcodeContext->expressionContext.x)
 
 
 static TGCodeExpressionPrecedence operatorPrecedence[] = {GCODE_EOP_THIRD,
@@ -35,43 +41,198 @@ static TGCodeExpressionPrecedence operatorPrecedence[] = {GCODE_EOP_THIRD,
                                                           GCODE_EOP_SECOND,
                                                           GCODE_EOP_FIRST};
 
+/* Named functions and operators, all there is to adding one besides what it
+ * does. Looked up by their first two letters, see _find_keyword() */
+typedef struct {
+  const char *name;
+  uint8_t tType; /* GCODE_ETT_VALUE for functions, GCODE_ETT_OPERATOR else */
+  uint8_t code; /* TGCodeExpressionFunctions or TGCodeExpressionOperators */
+} TGCodeExpressionKeyword;
+
+static const TGCodeExpressionKeyword keywords[] = {
+  {"ABS", GCODE_ETT_VALUE, GCODE_EF_ABS},
+  {"ACOS", GCODE_ETT_VALUE, GCODE_EF_ACOS},
+  {"AND", GCODE_ETT_OPERATOR, GCODE_EO_AND},
+  {"ASIN", GCODE_ETT_VALUE, GCODE_EF_ASIN},
+  {"ATAN", GCODE_ETT_VALUE, GCODE_EF_ATAN},
+  {"COS", GCODE_ETT_VALUE, GCODE_EF_COS},
+  {"EXP", GCODE_ETT_VALUE, GCODE_EF_EXP},
+  {"FIX", GCODE_ETT_VALUE, GCODE_EF_FIX},
+  {"FUP", GCODE_ETT_VALUE, GCODE_EF_FUP},
+  {"LN", GCODE_ETT_VALUE, GCODE_EF_LN},
+  {"MOD", GCODE_ETT_OPERATOR, GCODE_EO_MOD},
+  {"OR", GCODE_ETT_OPERATOR, GCODE_EO_OR},
+  {"ROUND", GCODE_ETT_VALUE, GCODE_EF_ROUND},
+  {"SIN", GCODE_ETT_VALUE, GCODE_EF_SIN},
+  {"SQRT", GCODE_ETT_VALUE, GCODE_EF_SQRT},
+  {"TAN", GCODE_ETT_VALUE, GCODE_EF_TAN},
+  {"XOR", GCODE_ETT_OPERATOR, GCODE_EO_XOR}
+};
+#define GCODE_EXPRESSION_KEYWORDS (sizeof(keywords) / sizeof(keywords[0]))
+
+/* The above by their first two letters (1 + index, 0: none), keywords sharing
+ * those chained in table order. Shared by every context */
+static pthread_once_t processExpression = PTHREAD_ONCE_INIT;
+static uint8_t keywordIndex[26 * 26];
+static uint8_t keywordNext[GCODE_EXPRESSION_KEYWORDS];
+static uint8_t keywordLength[GCODE_EXPRESSION_KEYWORDS];
+
+
+static void _compile_expression(const char **expression); /* Forward declaration */
+
+static double _do_function(TGCodeExpressionFunctions function, double arg1,
+                           double arg2) {
+  switch(function) {
+    case GCODE_EF_ABS:
+      return fabs(arg1);
+    case GCODE_EF_ASIN:
+      return asin(arg1) * GCODE_RAD2DEG;
+    case GCODE_EF_ACOS:
+      return acos(arg1) * GCODE_RAD2DEG;
+    case GCODE_EF_ATAN:
+      return atan2(arg1, arg2) * GCODE_RAD2DEG;
+    case GCODE_EF_COS:
+      return cos(arg1 * GCODE_DEG2RAD);
+    case GCODE_EF_EXP:
+      return exp(arg1);
+    case GCODE_EF_FIX:
+      return floor(arg1);
+    case GCODE_EF_FUP:
+      return ceil(arg1);
+    case GCODE_EF_LN:
+      return log(arg1);
+    case GCODE_EF_ROUND:
+      return round(arg1);
+    case GCODE_EF_SIN:
+      return sin(arg1 * GCODE_DEG2RAD);
+    case GCODE_EF_SQRT:
+      return sqrt(arg1);
+    case GCODE_EF_TAN:
+      return tan(arg1 * GCODE_DEG2RAD);
+    default:
+      return 0;
+  }
+}
+
+/* Where the first two letters of name go in keywordIndex, -1 if nowhere.
+ * Clearing bit 5 folds ASCII lower case onto upper case and leaves anything
+ * that is not a letter outside A..Z */
+static int _hash_keyword(const char *name) {
+  unsigned int first = (unsigned char)(name[0] & ~0x20) - 'A', second;
+
+  if(first >= 26) return -1;
+  second = (unsigned char)(name[1] & ~0x20) - 'A';
+  if(second >= 26) return -1;
+
+  return first * 26 + second;
+}
+
+static void _setup_process_expression(void) {
+  unsigned int i;
+  uint8_t *last;
+  int hash;
+
+  for(i = 0; i < GCODE_EXPRESSION_KEYWORDS; i++) {
+    /* Keywords need at least two letters */
+    if((hash = _hash_keyword(keywords[i].name)) < 0) continue;
+    keywordLength[i] = strlen(keywords[i].name);
+    for(last = &keywordIndex[hash]; *last; last = &keywordNext[*last - 1]);
+    *last = i + 1;
+  }
+}
+
+/* The keyword text starts with, matched case insensitively either up to the
+ * end of the keyword (prefix) or of text (whole), NULL if none */
+static const TGCodeExpressionKeyword *_find_keyword(const char *text,
+                                                    bool prefix) {
+  const char *name;
+  uint8_t at, i;
+  int hash;
+
+  if((hash = _hash_keyword(text)) < 0) return NULL;
+  /* The first two letters matched already, names are all upper case */
+  for(at = keywordIndex[hash]; at; at = keywordNext[at - 1]) {
+    name = keywords[at - 1].name;
+    for(i = 2; i < keywordLength[at - 1] && (text[i] & ~0x20) == name[i]; i++);
+    if(i == keywordLength[at - 1] && (prefix || !text[i]))
+      return &keywords[at - 1];
+  }
+
+  return NULL;
+}
+
+static TGCodeExpressionFunctions _find_function(const char *fname) {
+  const TGCodeExpressionKeyword *keyword = _find_keyword(fname, false);
 
-static double _do_expression(const char **expression); /* Forward declaration */
-
-static double _do_function(char *fname, double arg1, double arg2) {
-  if(!strcasecmp(fname, "ABS"))
-    return fabs(arg1);
-  if(!strcasecmp(fname, "ASIN"))
-    return asin(arg1) * GCODE_RAD2DEG;
-  if(!strcasecmp(fname, "ACOS"))
-    return acos(arg1) * GCODE_RAD2DEG;
-  if(!strcasecmp(fname, "ATAN"))
-    return atan2(arg1, arg2) * GCODE_RAD2DEG;
-  if(!strcasecmp(fname, "COS"))
-    return cos(arg1 * GCODE_DEG2RAD);
-  if(!strcasecmp(fname, "EXP"))
-    return exp(arg1);
-  if(!strcasecmp(fname, "FIX"))
-    return floor(arg1);
-  if(!strcasecmp(fname, "FUP"))
-    return ceil(arg1);
-  if(!strcasecmp(fname, "LN"))
-    return log(arg1);
-  if(!strcasecmp(fname, "ROUND"))
-    return round(arg1);
-  if(!strcasecmp(fname, "SIN"))
-    return sin(arg1 * GCODE_DEG2RAD);
-  if(!strcasecmp(fname, "SQRT"))
-    return sqrt(arg1);
-  if(!strcasecmp(fname, "TAN"))
-    return tan(arg1 * GCODE_DEG2RAD);
-
-  return 0;
+  return (keyword && keyword->tType == GCODE_ETT_VALUE ?
+          (TGCodeExpressionFunctions)keyword->code : GCODE_EF_UNKNOWN);
+}
+
+static void _emit_expression(TGCodeExpressionOpcode opcode, uint8_t argument,
+                             uint32_t operand) {
+  if(EXPR(buildCodeUsed) == EXPR(buildCodeRoom)) {
+    uint32_t room = (EXPR(buildCodeRoom) ? 2 * EXPR(buildCodeRoom) : 64);
+    TGCodeExpressionInstruction *grown = (TGCodeExpressionInstruction *)realloc(
+        EXPR(buildCode), room * sizeof(TGCodeExpressionInstruction));
+
+    if(!grown) {
+      EXPR(buildFailed) = true;
+      return;
+    }
+    EXPR(buildCode) = grown;
+    EXPR(buildCodeRoom) = room;
+  }
+  EXPR(buildCode)[EXPR(buildCodeUsed)].opcode = opcode;
+  EXPR(buildCode)[EXPR(buildCodeUsed)].argument = argument;
+  EXPR(buildCode)[EXPR(buildCodeUsed)].operand = operand;
+  EXPR(buildCodeUsed)++;
+}
+
+static void _emit_constant_expression(double value) {
+  if(EXPR(buildConstantsUsed) == EXPR(buildConstantsRoom)) {
+    uint32_t room = (EXPR(buildConstantsRoom) ?
+                     2 * EXPR(buildConstantsRoom) : 16);
+    double *grown = (double *)realloc(EXPR(buildConstants),
+                                      room * sizeof(double));
+
+    if(!grown) {
+      EXPR(buildFailed) = true;
+      return;
+    }
+    EXPR(buildConstants) = grown;
+    EXPR(buildConstantsRoom) = room;
+  }
+  EXPR(buildConstants)[EXPR(buildConstantsUsed)] = value;
+  _emit_expression(GCODE_EC_CONSTANT, 0, EXPR(buildConstantsUsed)++);
+}
+
+/* A parameter reference, "#1" or "##1" and so on, the way read_gcode_real()
+ * would have read it */
+static void _emit_parameter_expression(const char *reference) {
+  uint8_t indirections = 0;
+
+  while(*(++reference) == '#') indirections++;
+  _emit_expression(GCODE_EC_PARAMETER, 0, (uint16_t)(uint32_t)atol(reference));
+  while(indirections--) _emit_expression(GCODE_EC_INDIRECT_INTEGER, 0, 0);
+}
+
+/* Arguments are compiled (emitted) as they are met, just like they used to be
+ * evaluated, a value token has its code emitted already */
+static void _emit_function_expression(TGCodeExpressionFunctions function,
+                                      const char **expression) {
+  _compile_expression(expression);
+  if(function == GCODE_EF_ATAN) {
+    /* Skip the slash between the arguments and the following opening
+     * bracket. */
+    *expression += 2;
+    _compile_expression(expression);
+  }
+  _emit_expression(GCODE_EC_FUNCTION, function, 0);
 }
 
 static const char *_next_token(const char *expression,
                                TGCodeExpressionToken *token) {
-  double arg1, arg2;
+  const TGCodeExpressionKeyword *keyword;
 
   /* make sure *token is always initialized */
   token->tType = GCODE_ETT_CLOSE;
@@ -93,7 +254,7 @@ static const char *_next_token(const char *expression,
     case '9':
     case '.':
       token->tType = GCODE_ETT_VALUE;
-      token->tValue = read_gcode_real(expression - 1);
+      _emit_constant_expression(read_gcode_real(expression - 1));
       expression = skip_gcode_digits(expression - 1);
       break;
     case '#':
@@ -101,10 +262,10 @@ static const char *_next_token(const char *expression,
       if(*expression == '[') {
         expression++; /* skip the open bracket */
 
-        token->tValue = fetch_parameter((uint16_t)_do_expression(&expression));
+        _compile_expression(&expression);
+        _emit_expression(GCODE_EC_INDIRECT, 0, 0);
       } else {
-        /* read_gcode_real handles parameter references on its own */
-        token->tValue = read_gcode_real(expression - 1);
+        _emit_parameter_expression(expression - 1);
         expression = skip_gcode_digits(expression - 1);
       }
       break;
@@ -139,118 +300,21 @@ static const char *_next_token(const char *expression,
       token->tType = GCODE_ETT_OPERATOR;
       token->tOperator.oType = GCODE_EO_SLASH;
       break;
-    case 'A':
-      if(!strncasecmp(expression - 1, "ABS", strlen("ABS"))) {
-        token->tType = GCODE_ETT_VALUE;
-        expression += strlen("ABS"); /* Eat the opening bracket as well */
-        token->tValue = _do_function("ABS", _do_expression(&expression), 0.0);
-      }
-      else if(!strncasecmp(expression - 1, "ACOS", strlen("ACOS"))) {
-        token->tType = GCODE_ETT_VALUE;
-        expression += strlen("ACOS"); /* Eat the opening bracket as well */
-        token->tValue = _do_function("ACOS", _do_expression(&expression), 0.0);
-      }
-      else if(!strncasecmp(expression - 1, "AND", strlen("AND"))) {
-        token->tType = GCODE_ETT_OPERATOR;
-        token->tOperator.oType = GCODE_EO_AND;
-        expression += strlen("AND") - 1;
-      }
-      else if(!strncasecmp(expression - 1, "ASIN", strlen("ASIN"))) {
-        token->tType = GCODE_ETT_VALUE;
-        expression += strlen("ASIN"); /* Eat the opening bracket as well */
-        token->tValue = _do_function("ASIN", _do_expression(&expression), 0.0);
-      }
-      else if(!strncasecmp(expression - 1, "ATAN", strlen("ATAN"))) {
-        token->tType = GCODE_ETT_VALUE;
-        expression += strlen("ATAN"); /* Eat the opening bracket as well */
-        arg1 = _do_expression(&expression); /* Enforce order of evaluation */
-        /* Skip the slash between the arguments and the following opening
-         * bracket. */
-        expression += 2;
-        arg2 = _do_expression(&expression);
-        token->tValue = _do_function("ATAN", arg1, arg2);
-      }
-      break;
-    case 'C':
-      if(!strncasecmp(expression - 1, "COS", strlen("COS"))) {
-        token->tType = GCODE_ETT_VALUE;
-        expression += strlen("COS"); /* Eat the opening bracket as well */
-        token->tValue = _do_function("COS", _do_expression(&expression), 0.0);
-      }
-      break;
-    case 'E':
-      if(!strncasecmp(expression - 1, "EXP", strlen("EXP"))) {
-        token->tType = GCODE_ETT_VALUE;
-        expression += strlen("EXP"); /* Eat the opening bracket as well */
-        token->tValue = _do_function("EXP", _do_expression(&expression), 0.0);
-      }
-      break;
-    case 'F':
-      if(!strncasecmp(expression - 1, "FIX", strlen("FIX"))) {
-        token->tType = GCODE_ETT_VALUE;
-        expression += strlen("FIX"); /* Eat the opening bracket as well */
-        token->tValue = _do_function("FIX", _do_expression(&expression), 0.0);
-      }
-      else if(!strncasecmp(expression - 1, "FUP", strlen("FUP"))) {
-        token->tType = GCODE_ETT_VALUE;
-        expression += strlen("FUP"); /* Eat the opening bracket as well */
-        token->tValue = _do_function("FUP", _do_expression(&expression), 0.0);
-      }
-      break;
-    case 'L':
-      if(!strncasecmp(expression - 1, "LN", strlen("LN"))) {
-        token->tType = GCODE_ETT_VALUE;
-        expression += strlen("LN"); /* Eat the opening bracket as well */
-        token->tValue = _do_function("LN", _do_expression(&expression), 0.0);
-      }
-      break;
-    case 'M':
-      if(!strncasecmp(expression - 1, "MOD", strlen("MOD"))) {
-        token->tType = GCODE_ETT_OPERATOR;
-        token->tOperator.oType = GCODE_EO_MOD;
-        expression += strlen("MOD") - 1;
-      }
-      break;
-    case 'O':
-      if(!strncasecmp(expression - 1, "OR", strlen("OR"))) {
-        token->tType = GCODE_ETT_OPERATOR;
-        token->tOperator.oType = GCODE_EO_OR;
-        expression += strlen("OR") - 1;
-      }
-      break;
-    case 'R':
-      if(!strncasecmp(expression - 1, "ROUND", strlen("ROUND"))) {
-        token->tType = GCODE_ETT_VALUE;
-        expression += strlen("ROUND"); /* Eat the opening bracket as well */
-        token->tValue = _do_function("ROUND", _do_expression(&expression), 0.0);
-      }
-      break;
-    case 'S':
-      if(!strncasecmp(expression - 1, "SIN", strlen("SIN"))) {
-        token->tType = GCODE_ETT_VALUE;
-        expression += strlen("SIN"); /* Eat the opening bracket as well */
-        token->tValue = _do_function("SIN", _do_expression(&expression), 0.0);
-      }
-      else if(!strncasecmp(expression - 1, "SQRT", strlen("SQRT"))) {
-        token->tType = GCODE_ETT_VALUE;
-        expression += strlen("SQRT"); /* Eat the opening bracket as well */
-        token->tValue = _do_function("SQRT", _do_expression(&expression), 0.0);
-      }
-      break;
-    case 'T':
-      if(!strncasecmp(expression - 1, "TAN", strlen("TAN"))) {
-        token->tType = GCODE_ETT_VALUE;
-        expression += strlen("TAN"); /* Eat the opening bracket as well */
-        token->tValue = _do_function("TAN", _do_expression(&expression), 0.0);
-      }
-      break;
-    case 'X':
-      if(!strncasecmp(expression - 1, "XOR", strlen("XOR"))) {
-        token->tType = GCODE_ETT_OPERATOR;
-        token->tOperator.oType = GCODE_EO_XOR;
-        expression += strlen("XOR") - 1;
+    default:
+      /* Named functions and operators, upper case as gcode-input leaves them */
+      if(expression[-1] >= 'A' && expression[-1] <= 'Z' &&
+         (keyword = _find_keyword(expression - 1, true))) {
+        token->tType = keyword->tType;
+        if(keyword->tType == GCODE_ETT_OPERATOR) {
+          token->tOperator.oType = (TGCodeExpressionOperators)keyword->code;
+          expression += keywordLength[keyword - keywords] - 1;
+        } else {
+          /* Eat the opening bracket as well */
+          expression += keywordLength[keyword - keywords];
+          _emit_function_expression((TGCodeExpressionFunctions)keyword->code,
+                                    &expression);
+        }
       }
-      break;
   }
 
   if(token->tType == GCODE_ETT_OPERATOR)
@@ -259,9 +323,9 @@ static const char *_next_token(const char *expression,
   return expression;
 }
 
-static double _do_operation(TGCodeExpressionOperator op, double left,
+static double _do_operation(TGCodeExpressionOperators op, double left,
     double right) {
-  switch(op.oType) {
+  switch(op) {
     case GCODE_EO_PLUS:
       return left + right;
     case GCODE_EO_MINUS:
@@ -294,46 +358,54 @@ static double _do_operation(TGCodeExpressionOperator op, double left,
   return NAN;
 }
 
-static double _do_expression(const char **expression) {
+/* Emits code leaving the value of the expression on the stack. Follows the
+ * text exactly the way evaluating it straight away used to, including where
+ * it leaves *expression: left and right are on the stack instead of in
+ * variables, whatever was emitted while peeking ahead or for a right that
+ * then has to yield is taken back */
+static void _compile_expression(const char **expression) {
   TGCodeExpressionToken token;
-  double left = NAN, right = +0.0E+0;
   TGCodeExpressionOperator operator = {GCODE_EO_PLUS,
                                        operatorPrecedence[GCODE_EO_PLUS]};
   bool skipOp = false, skipRight = false;
   const char *subexp = NULL, *tep;
+  uint32_t rightAt, peekAt;
 
   /* First argument */
   *expression = _next_token(*expression, &token);
   switch(token.tType) {
     case GCODE_ETT_OPEN:
-      left = _do_expression(expression);
+      _compile_expression(expression);
       break;
     case GCODE_ETT_OPERATOR:
       if(token.tOperator.oType == GCODE_EO_MINUS ||
          token.tOperator.oType == GCODE_EO_PLUS) {
         skipOp = true; /* We already know what the operator is */
-        left = +0.0E+0;
+        _emit_constant_expression(+0.0E+0);
         operator = token.tOperator;
-      }
+      } else _emit_constant_expression(NAN);
       break;
     case GCODE_ETT_VALUE:
-      left = token.tValue;
+      break;
+    default:
+      _emit_constant_expression(NAN);
       break;
   }
 
    /* Special case of a single value in brackets */
-  if(!**expression) return left;
+  if(!**expression) return;
 
   while(**expression) {
     /* Save where right began, we may need to yield it */
     subexp = *expression;
+    rightAt = EXPR(buildCodeUsed);
 
     if(!skipOp) {
       /* Operator */
       *expression = _next_token(*expression, &token);
       switch(token.tType) {
         case GCODE_ETT_CLOSE:
-          return left; /* Special case of a single value in brackets */
+          return; /* Special case of a single value in brackets */
         case GCODE_ETT_OPERATOR:
           operator = token.tOperator;
           subexp = *expression; /* Normal case, update bookmark for right */
@@ -342,8 +414,7 @@ static double _do_expression(const char **expression) {
         case GCODE_ETT_VALUE:
           /* Standard extension: math-like implicit multiplication */
           skipRight = true; /* We already know what right is */
-          right = (token.tType == GCODE_ETT_OPEN ?
-              _do_expression(expression) : token.tValue);
+          if(token.tType == GCODE_ETT_OPEN) _compile_expression(expression);
           operator.oType = GCODE_EO_STAR;
           operator.oPrec = operatorPrecedence[GCODE_EO_STAR];
           break;
@@ -355,79 +426,415 @@ static double _do_expression(const char **expression) {
       *expression = _next_token(*expression, &token);
       switch(token.tType) {
         case GCODE_ETT_OPEN:
-        right = _do_expression(expression);
-        break;
-      case GCODE_ETT_VALUE:
-        right = token.tValue;
-        break;
+          _compile_expression(expression);
+          break;
+        case GCODE_ETT_VALUE:
+          break;
+        default:
+          _emit_constant_expression(+0.0E+0);
+          break;
       }
     } else skipRight = false;
 
     /* By this time, we have left, operator and right set properly. We should
      * now peek at the next token and decide what to do next. */
+    peekAt = EXPR(buildCodeUsed);
     tep = _next_token(*expression, &token);
+    EXPR(buildCodeUsed) = peekAt;
     /* If this is the end of the expression, we're done */
     if(token.tType == GCODE_ETT_CLOSE) {
       *expression = tep;
+      _emit_expression(GCODE_EC_OPERATOR, operator.oType, 0);
 
-      return _do_operation(operator, left, right);
+      return;
     }
     /* If we're followed by an operation of a higher precedence, yield */
     if((token.tType == GCODE_ETT_OPERATOR &&
         token.tOperator.oPrec > operator.oPrec) ||
        ((token.tType == GCODE_ETT_OPEN || token.tType == GCODE_ETT_VALUE) &&
-        operatorPrecedence[GCODE_EO_STAR] > operator.oPrec))
-      return _do_operation(operator, left, _do_expression(&subexp));
+        operatorPrecedence[GCODE_EO_STAR] > operator.oPrec)) {
+      EXPR(buildCodeUsed) = rightAt;
+      _compile_expression(&subexp);
+      _emit_expression(GCODE_EC_OPERATOR, operator.oType, 0);
+
+      return;
+    }
     /* If we got to here, we're followed by an operation of equal or lower
      * precedence: reduce and repeat */
-    left = _do_operation(operator, left, right);
-    right = +0.0E+0;
+    _emit_expression(GCODE_EC_OPERATOR, operator.oType, 0);
     operator.oType = GCODE_EO_PLUS;
     operator.oPrec = operatorPrecedence[GCODE_EO_PLUS];
   }
 
   /* We should never get here */
-  return NAN;
+  _emit_expression(GCODE_EC_DROP, 0, 0);
+  _emit_constant_expression(NAN);
+}
+
+bool init_expression(void *data) {
+  EXPR(buildCode) = NULL;
+  EXPR(buildConstants) = NULL;
+  EXPR(buildCodeUsed) = EXPR(buildCodeRoom) = 0;
+  EXPR(buildConstantsUsed) = EXPR(buildConstantsRoom) = 0;
+  EXPR(buildFailed) = false;
+  EXPR(expressionCache) = NULL;
+  EXPR(expressionCacheSlots) = EXPR(expressionCacheUsed) = 0;
+  EXPR(evaluations) = EXPR(compilations) = EXPR(reused) = 0;
+
+  return true;
+}
+
+/* Works out at compile time whatever takes constants only, in place: an
+ * operator or function right after the constant(s) it takes is replaced by
+ * its result, a parameter numbered by a constant is fetched directly. Uses
+ * the same routines as run_expression(), so results stay exactly the same */
+static void _fold_expression(void) {
+  TGCodeExpressionInstruction *to = EXPR(buildCode), *from;
+  double value;
+
+  for(from = EXPR(buildCode); from < &EXPR(buildCode)[EXPR(buildCodeUsed)];
+      from++) {
+    *to = *from;
+    switch(from->opcode) {
+      case GCODE_EC_OPERATOR:
+        if(to - EXPR(buildCode) < 2 || to[-1].opcode != GCODE_EC_CONSTANT ||
+           to[-2].opcode != GCODE_EC_CONSTANT) break;
+        /* Goes where the left one was */
+        to--;
+        EXPR(buildConstants)[to[-1].operand] = _do_operation(
+            (TGCodeExpressionOperators)from->argument,
+            EXPR(buildConstants)[to[-1].operand],
+            EXPR(buildConstants)[to[0].operand]);
+        continue;
+      case GCODE_EC_FUNCTION:
+        if(from->argument == GCODE_EF_ATAN) {
+          if(to - EXPR(buildCode) < 2 || to[-1].opcode != GCODE_EC_CONSTANT ||
+             to[-2].opcode != GCODE_EC_CONSTANT) break;
+          to--;
+          EXPR(buildConstants)[to[-1].operand] = _do_function(
+              GCODE_EF_ATAN, EXPR(buildConstants)[to[-1].operand],
+              EXPR(buildConstants)[to[0].operand]);
+        } else {
+          if(to == EXPR(buildCode) || to[-1].opcode != GCODE_EC_CONSTANT) break;
+          EXPR(buildConstants)[to[-1].operand] = _do_function(
+              (TGCodeExpressionFunctions)from->argument,
+              EXPR(buildConstants)[to[-1].operand], 0.0);
+        }
+        continue;
+      case GCODE_EC_INDIRECT:
+      case GCODE_EC_INDIRECT_INTEGER:
+        if(to == EXPR(buildCode) || to[-1].opcode != GCODE_EC_CONSTANT) break;
+        value = EXPR(buildConstants)[to[-1].operand];
+        /* Only where converting it is well defined, run time does the rest */
+        if(!(value > -1.0) || value >= (from->opcode == GCODE_EC_INDIRECT ?
+                                        65536.0 : 4294967296.0)) break;
+        to[-1].opcode = GCODE_EC_PARAMETER;
+        to[-1].operand = (from->opcode == GCODE_EC_INDIRECT ?
+                          (uint16_t)value : (uint16_t)(uint32_t)value);
+        continue;
+      case GCODE_EC_DROP:
+        if(to == EXPR(buildCode) || to[-1].opcode != GCODE_EC_CONSTANT) break;
+        to--;
+        continue;
+    }
+    to++;
+  }
+  EXPR(buildCodeUsed) = to - EXPR(buildCode);
+}
+
+bool compile_expression(const char *expression,
+                        TGCodeExpressionProgram *program) {
+  const TGCodeExpressionInstruction *at;
+  int64_t depth = 0;
+
+  /* Expressions get evaluated without an init_expression() too */
+  pthread_once(&processExpression, _setup_process_expression);
+  EXPR(buildCodeUsed) = EXPR(buildConstantsUsed) = 0;
+  EXPR(buildFailed) = false;
+  _compile_expression(&expression);
+  EXPR(compilations)++;
+  if(EXPR(buildFailed)) return false;
+  _fold_expression();
+
+  program->code = EXPR(buildCode);
+  program->count = EXPR(buildCodeUsed);
+  program->constants = EXPR(buildConstants);
+  program->constantCount = EXPR(buildConstantsUsed);
+  program->depth = 0;
+  for(at = EXPR(buildCode); at < &EXPR(buildCode)[EXPR(buildCodeUsed)]; at++) {
+    switch(at->opcode) {
+      case GCODE_EC_CONSTANT:
+      case GCODE_EC_PARAMETER:
+        depth++;
+        break;
+      case GCODE_EC_OPERATOR:
+      case GCODE_EC_DROP:
+        depth--;
+        break;
+      case GCODE_EC_FUNCTION:
+        if(at->argument == GCODE_EF_ATAN) depth--;
+        break;
+    }
+    if(depth > program->depth) program->depth = depth;
+  }
+
+  return true;
+}
+
+double run_expression(const TGCodeExpressionProgram *program) {
+  double local[GCODE_EXPRESSION_STACK], *stack = local, *top, result;
+  const TGCodeExpressionInstruction *at, *end = &program->code[program->count];
+
+  if(program->depth > GCODE_EXPRESSION_STACK &&
+     !(stack = (double *)malloc(program->depth * sizeof(double)))) return NAN;
+  top = stack - 1;
+  for(at = program->code; at < end; at++)
+    switch(at->opcode) {
+      case GCODE_EC_CONSTANT:
+        *(++top) = program->constants[at->operand];
+        break;
+      case GCODE_EC_PARAMETER:
+        *(++top) = fetch_parameter((uint16_t)at->operand);
+        break;
+      case GCODE_EC_INDIRECT:
+        *top = fetch_parameter((uint16_t)*top);
+        break;
+      case GCODE_EC_INDIRECT_INTEGER:
+        *top = fetch_parameter((uint16_t)(uint32_t)*top);
+        break;
+      case GCODE_EC_OPERATOR:
+        top--;
+        *top = _do_operation((TGCodeExpressionOperators)at->argument, top[0],
+                             top[1]);
+        break;
+      case GCODE_EC_FUNCTION:
+        if(at->argument == GCODE_EF_ATAN) {
+          top--;
+          *top = _do_function(GCODE_EF_ATAN, top[0], top[1]);
+        } else *top = _do_function((TGCodeExpressionFunctions)at->argument,
+                                   *top, 0.0);
+        break;
+      case GCODE_EC_DROP:
+        top--;
+        break;
+    }
+  result = (top >= stack ? *top : NAN);
+  if(stack != local) free(stack);
+
+  return result;
 }
 
 double evaluate_expression(const char *expression) {
-  return _do_expression(&expression);
+  TGCodeExpressionProgram program;
+
+  EXPR(evaluations)++;
+
+  return (compile_expression(expression, &program) ? run_expression(&program) :
+                                                      NAN);
+}
+
+static uint32_t _hash_expression(long location) {
+  /* Same mix as the block cache, expressions are just as clustered */
+  return (uint32_t)(((uint64_t)location * 0x9E3779B97F4A7C15ULL) >> 32) &
+         (EXPR(expressionCacheSlots) - 1);
+}
+
+/* Returns the slot holding location, or the empty slot where it would go */
+static TGCodeExpressionCacheEntry *_probe_expression(long location) {
+  uint32_t slot = _hash_expression(location);
+
+  while(EXPR(expressionCache)[slot].location != -1 &&
+        EXPR(expressionCache)[slot].location != location)
+    slot = (slot + 1) & (EXPR(expressionCacheSlots) - 1);
+
+  return &EXPR(expressionCache)[slot];
+}
+
+/* Makes room for one more entry, returns false if the cache is full */
+static bool _grow_expression(void) {
+  TGCodeExpressionCacheEntry *old = EXPR(expressionCache);
+  uint32_t i, oldSlots = EXPR(expressionCacheSlots);
+  uint32_t slots = (oldSlots ? 2 * oldSlots : GCODE_EXPRESSION_CACHE_SLOTS);
+
+  /* Keep the load factor under 1/2 so that probe sequences stay short */
+  if(2 * (EXPR(expressionCacheUsed) + 1) <= oldSlots) return true;
+  if(slots > GCODE_EXPRESSION_CACHE_MAX_SLOTS) return false;
+  EXPR(expressionCache) = (TGCodeExpressionCacheEntry *)malloc(
+      slots * sizeof(TGCodeExpressionCacheEntry));
+  if(!EXPR(expressionCache)) {
+    EXPR(expressionCache) = old;
+    return false;
+  }
+  EXPR(expressionCacheSlots) = slots;
+  for(i = 0; i < slots; i++) EXPR(expressionCache)[i].location = -1;
+  for(i = 0; i < oldSlots; i++)
+    if(old[i].location != -1) *_probe_expression(old[i].location) = old[i];
+  free(old);
+
+  return true;
+}
+
+/* Notes down which parameters entry's program reads, as far as that can be
+ * told without running it */
+static void _track_expression(TGCodeExpressionCacheEntry *entry) {
+  const TGCodeExpressionInstruction *at,
+      *end = &entry->program.code[entry->program.count];
+  uint8_t i;
+
+  entry->checked = 0;
+  entry->readCount = 0;
+  for(at = entry->program.code; at < end; at++) {
+    if(at->opcode == GCODE_EC_INDIRECT ||
+       at->opcode == GCODE_EC_INDIRECT_INTEGER) {
+      entry->readCount = GCODE_EXPRESSION_UNTRACKED;
+      continue;
+    }
+    if(at->opcode != GCODE_EC_PARAMETER) continue;
+    if(at->operand >= GCODE_PARAMETER_COUNT) {
+      entry->readCount = GCODE_EXPRESSION_VOLATILE;
+      return;
+    }
+    if(entry->readCount == GCODE_EXPRESSION_UNTRACKED) continue;
+    for(i = 0; i < entry->readCount && entry->reads[i] != at->operand; i++);
+    if(i < entry->readCount) continue;
+    if(entry->readCount == GCODE_EXPRESSION_READS)
+      entry->readCount = GCODE_EXPRESSION_UNTRACKED;
+    else entry->reads[entry->readCount++] = at->operand;
+  }
+}
+
+/* Copies what was just compiled into entry, along with the text it came from */
+static bool _keep_expression(TGCodeExpressionCacheEntry *entry,
+                             const char *expression, size_t length,
+                             const TGCodeExpressionProgram *program) {
+  size_t codeAt = (length + 1 + sizeof(double) - 1) / sizeof(double) *
+                  sizeof(double);
+  size_t constantsAt = codeAt +
+                       program->count * sizeof(TGCodeExpressionInstruction);
+  char *data;
+
+  constantsAt = (constantsAt + sizeof(double) - 1) / sizeof(double) *
+                sizeof(double);
+  if(!(data = (char *)malloc(constantsAt +
+                             program->constantCount * sizeof(double))))
+    return false;
+  memcpy(data, expression, length);
+  data[length] = '\0';
+  memcpy(&data[codeAt], program->code,
+         program->count * sizeof(TGCodeExpressionInstruction));
+  if(program->constantCount)
+    memcpy(&data[constantsAt], program->constants,
+           program->constantCount * sizeof(double));
+  free(entry->text);
+  entry->text = data;
+  entry->length = length;
+  entry->program = *program;
+  entry->program.code = (const TGCodeExpressionInstruction *)&data[codeAt];
+  entry->program.constants = (const double *)&data[constantsAt];
+  _track_expression(entry);
+
+  return true;
+}
+
+/* Returns true if entry's last result is still good: no parameter it reads
+ * changed since it was worked out */
+static bool _reuse_expression(TGCodeExpressionCacheEntry *entry) {
+  uint64_t version = fetch_parameters_version();
+  uint8_t i;
+
+  if(!entry->checked || entry->readCount == GCODE_EXPRESSION_VOLATILE)
+    return false;
+  if(entry->checked == version) return true;
+  if(entry->readCount == GCODE_EXPRESSION_UNTRACKED) return false;
+  for(i = 0; i < entry->readCount; i++)
+    if(fetch_parameter_version(entry->reads[i]) > entry->checked) return false;
+  /* Nothing to look at again until the next write */
+  entry->checked = version;
+
+  return true;
+}
+
+static double _run_cached_expression(TGCodeExpressionCacheEntry *entry) {
+  if(_reuse_expression(entry)) {
+    EXPR(reused)++;
+    return entry->result;
+  }
+  entry->result = run_expression(&entry->program);
+  entry->checked = fetch_parameters_version();
+
+  return entry->result;
+}
+
+double evaluate_cached_expression(const char *expression, size_t length,
+                                  long location) {
+  TGCodeExpressionCacheEntry *entry = NULL;
+  TGCodeExpressionProgram program;
+
+  if(location == -1) return evaluate_expression(expression);
+  EXPR(evaluations)++;
+  if(EXPR(expressionCacheUsed)) {
+    entry = _probe_expression(location);
+    /* Same place, same text: the input was not swapped underneath us */
+    if(entry->location != -1 && entry->length == length &&
+       !memcmp(entry->text, expression, length))
+      return _run_cached_expression(entry);
+  }
+
+  if(!compile_expression(expression, &program)) return NAN;
+  if(!entry || entry->location == -1) {
+    if(!_grow_expression()) return run_expression(&program);
+    entry = _probe_expression(location);
+    if(entry->location == -1) {
+      entry->text = NULL;
+      if(!_keep_expression(entry, expression, length, &program))
+        return run_expression(&program);
+      entry->location = location;
+      EXPR(expressionCacheUsed)++;
+      return _run_cached_expression(entry);
+    }
+  }
+  /* Different text at a known place, the old program goes */
+  if(_keep_expression(entry, expression, length, &program))
+    return _run_cached_expression(entry);
+
+  return run_expression(&program);
 }
 
 void evaluate_unary_expression(char *line) {
   bool seenWord = false;
-  char fname[strlen("ROUND") + 1], *sptr, *buf, c; /* longest named function */
+  char fname[strlen("ROUND") + 1], *sptr, c; /* longest named function */
   uint8_t fni;
   double arg, sar;
 
+  pthread_once(&processExpression, _setup_process_expression);
   while((c = *line)) {
-    if((isdigit(c) || c == '-') && seenWord) {
-      /* skip_gcode_digits() is a const domain and we're non-const */
-      line = (char *)skip_gcode_digits(line);
+    if((isdigit(c) || c == '-' || c == GCODE_INPUT_VALUE) && seenWord) {
+      /* skip_gcode_number() is a const domain and we're non-const */
+      line = (char *)skip_gcode_number(line);
       seenWord = false;
       continue;
     } else if(isalpha(c)) {
       if(seenWord) {
         fni = 0;
         sptr = line; /* Remember where it started */
-        do { fname[fni++] = *line; } while (isalpha(*(++line)));
+        /* Anything longer than the longest name can't be one anyway */
+        do {
+          if(fni < sizeof(fname) - 1) fname[fni++] = *line;
+        } while (isalpha(*(++line)));
         fname[fni] = '\0'; /* Function name at fname */
         arg = read_gcode_real(line); /* Function (1st) argument in arg */
-        line = (char *)skip_gcode_digits(line);
+        line = (char *)skip_gcode_number(line);
         if(*line == '/') {/* Special case of ATAN */
           sar = read_gcode_real(++line); /* Skip slash */
-          line = (char *)skip_gcode_digits(line);
+          line = (char *)skip_gcode_number(line);
         }
 
-        buf = (char *)calloc(1, strlen(line) + strlen(GCODE_REAL_FORMAT) + 1);
-        strcpy(buf, GCODE_REAL_FORMAT);
-        strcat(buf, line); /* Save the rest of the line */
-        line = sptr; /* Rewind to where the function started */
-        /* Overwrite with numeric result */
-        snprintf(line, strlen(line), buf, _do_function(fname, arg, sar));
-        free((void *)buf);
-        /* And go past it */
-        line = (char *)skip_gcode_digits(line);
+        /* The result takes the place of the function and its arguments, as
+         * it is, and we go past it: the word has its argument */
+        line = replace_value_input(sptr, line,
+                                   _do_function(_find_function(fname), arg,
+                                                sar));
+        seenWord = false;
         continue;
       } else seenWord = true;
     }
@@ -436,3 +843,42 @@ void evaluate_unary_expression(char *line) {
 
   return;
 }
+
+bool has_unary_expression(const char *line, size_t length) {
+  const char *end = &line[length];
+  bool seenWord = false;
+
+  /* Same walk as above, minus the rewriting */
+  while(line < end) {
+    if((isdigit(*line) || *line == '-' || *line == GCODE_INPUT_VALUE) &&
+       seenWord) {
+      line = skip_gcode_number(line);
+      seenWord = false;
+      continue;
+    } else if(isalpha(*line)) {
+      if(seenWord) return true;
+      else seenWord = true;
+    }
+    line++;
+  }
+
+  return false;
+}
+
+bool done_expression(void) {
+  uint32_t i;
+
+  GCODE_DEBUG("Expressions: %llu evaluated, %llu compiled, %llu reused, "
+              "%u cached", (unsigned long long)EXPR(evaluations),
+              (unsigned long long)EXPR(compilations),
+              (unsigned long long)EXPR(reused),
+              EXPR(expressionCacheUsed));
+  for(i = 0; i < EXPR(expressionCacheSlots); i++)
+    if(EXPR(expressionCache)[i].location != -1)
+      free(EXPR(expressionCache)[i].text);
+  free(EXPR(expressionCache));
+  free(EXPR(buildCode));
+  free(EXPR(buildConstants));
+
+  return init_expression(NULL);
+}
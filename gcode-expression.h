@@ -11,8 +11,12 @@
 #ifndef GCODE_EXPRESSION_H_
 #define GCODE_EXPRESSION_H_
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include "gcode-commons.h"
+
 
 #define GCODE_ETT_VALUE 0x01
 #define GCODE_ETT_OPERATOR 0x02
@@ -31,6 +35,23 @@ typedef enum {
   GCODE_EO_POWER,
 } TGCodeExpressionOperators;
 
+typedef enum {
+  GCODE_EF_ABS = 0,
+  GCODE_EF_ACOS,
+  GCODE_EF_ASIN,
+  GCODE_EF_ATAN, /* The only one taking two arguments */
+  GCODE_EF_COS,
+  GCODE_EF_EXP,
+  GCODE_EF_FIX,
+  GCODE_EF_FUP,
+  GCODE_EF_LN,
+  GCODE_EF_ROUND,
+  GCODE_EF_SIN,
+  GCODE_EF_SQRT,
+  GCODE_EF_TAN,
+  GCODE_EF_UNKNOWN /* Evaluates to 0 */
+} TGCodeExpressionFunctions;
+
 typedef enum {
   GCODE_EOP_THIRD,
   GCODE_EOP_SECOND,
@@ -50,12 +71,93 @@ typedef struct {
   };
 } TGCodeExpressionToken;
 
+/* Compiled expressions run on a stack of values, every instruction takes its
+ * arguments off the top and pushes its result */
+typedef enum {
+  GCODE_EC_CONSTANT, /* Pushes constants[operand] */
+  GCODE_EC_PARAMETER, /* Pushes parameter #operand */
+  GCODE_EC_INDIRECT, /* Replaces the top with the parameter it numbers, #[] */
+  GCODE_EC_INDIRECT_INTEGER, /* Same, truncated to an integer first, ##1 */
+  GCODE_EC_OPERATOR, /* Replaces the top two with operator argument on them */
+  GCODE_EC_FUNCTION, /* Replaces the top one (two for ATAN) with function
+                      * argument of them */
+  GCODE_EC_DROP /* Pops the top */
+} TGCodeExpressionOpcode;
+
+typedef struct {
+  uint8_t opcode, argument;
+  uint32_t operand;
+} TGCodeExpressionInstruction;
+
+typedef struct {
+  const TGCodeExpressionInstruction *code;
+  uint32_t count;
+  const double *constants;
+  uint32_t constantCount;
+  uint32_t depth; /* Most values on the stack at any one time */
+} TGCodeExpressionProgram;
+
+/* readCount of a program whose reads depend on what it reads (#[#1]) or that
+ * reads too many to keep track of, and of one reading past the parameters */
+#define GCODE_EXPRESSION_UNTRACKED 0xFE
+#define GCODE_EXPRESSION_VOLATILE 0xFF
+
+/* A compiled expression kept for when the input is read there again, along
+ * with its last result and the parameters that came from */
+typedef struct {
+  long location; /* Where its text starts, -1 marks an empty slot */
+  char *text; /* Its text, the program's code and constants live after it */
+  size_t length;
+  TGCodeExpressionProgram program;
+  double result;
+  uint64_t checked; /* fetch_parameters_version() result is good for, 0: none */
+  uint16_t reads[GCODE_EXPRESSION_READS];
+  uint8_t readCount;
+} TGCodeExpressionCacheEntry;
+
+typedef struct {
+  /* Where expressions get compiled, grows as needed */
+  TGCodeExpressionInstruction *buildCode;
+  uint32_t buildCodeUsed, buildCodeRoom;
+  double *buildConstants;
+  uint32_t buildConstantsUsed, buildConstantsRoom;
+  bool buildFailed;
+  /* Open addressing hash table keyed by location */
+  TGCodeExpressionCacheEntry *expressionCache;
+  uint32_t expressionCacheSlots, expressionCacheUsed;
+  uint64_t evaluations, compilations, reused;
+} TGCodeExpressionContext;
+
+
+/* Gets the expression cache ready, data is ignored. Expressions evaluate fine
+ * without it, nothing is cached until the first evaluation anyway */
+bool init_expression(void *data);
+/* Compiles expression (what follows the opening bracket, up to and including
+ * the matching closing one) into program, with whatever works on constants
+ * only worked out already. Returns false if out of memory. program stays valid
+ * up to the next compilation only */
+bool compile_expression(const char *expression,
+                        TGCodeExpressionProgram *program);
+/* Runs program on the current parameter values and returns the result */
+double run_expression(const TGCodeExpressionProgram *program);
 /* Evaluates expression according to G-Code expression grammar and returns the
  * numeric result. */
 double evaluate_expression(const char *expression);
+/* Same as evaluate_expression() for expression[0..length) found at location
+ * in the input: compiled the first time, run from the cache every time after
+ * and not even run while none of the parameters it reads changed (see
+ * fetch_parameter_version()). A location of -1 (e.g. for spliced text) is
+ * never cached */
+double evaluate_cached_expression(const char *expression, size_t length,
+                                  long location);
 /* Scan line for function names, evaluate and replace them and their arguments
- * in line with the numeric result. Used for unary expressions without brackets
+ * in line with the result (see replace_value_input(), line must be the block
+ * gcode-input fetched last). Used for unary expressions without brackets
  * i.e. "G01 XSIN10 YATAN9/14" */
 void evaluate_unary_expression(char *line);
+/* Returns true if evaluate_unary_expression() would have anything to replace
+ * in line[0..length), without touching it */
+bool has_unary_expression(const char *line, size_t length);
+bool done_expression(void);
 
 #endif /* GCODE_EXPRESSION_H_ */
@@ -15,81 +15,947 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
 #include <locale.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
 
 #include "gcode-commons.h"
 #include "gcode-input.h"
+#include "gcode-compiler.h"
 #include "gcode-debugcon.h"
 #include "gcode-machine.h"
 #include "gcode-expression.h"
+#include "gcode-lexer.h"
+#include "gcode-reader.h"
+#include "gcode-stacks.h"
+#include "gcode-state.h"
+#include "gcode-subprogram.h"
+#include "gcode-context.h"
 
 
-static FILE *input;
-static TGCodeProgramIndexEntry programs[GCODE_PROGRAM_CAPACITY];
-static uint8_t programCount;
-static bool spliced, endOfSplice;
-static const char *splice;
-static ptrdiff_t splicep;
+/* State lives in the calling thread's context, see gcode-context.h */
+#define IN(x) (gcodeContext->inputContext.x)
 
-bool init_input(void *data) {
-  input = (FILE *)data;
-  memset(&programs, 0x00, sizeof(programs));
-  programCount = 0;
-  spliced = false;
+/* Shared by every context, only ever set up once */
+static pthread_once_t processInput = PTHREAD_ONCE_INIT;
 
-  GCODE_DEBUG("Input stream up, %d program table entries available",
-              GCODE_PROGRAM_CAPACITY);
+static void _setup_process_input(void) {
   /* Protect against numbering system strangeness in other locales. Also makes
    * "upper case" have a very well defined meaning */
   setlocale(LC_ALL, "C");
-  display_machine_message("STA: Scanning input for programs (O words)");
-  while(fetch_line_input(NULL));
-  rewind_input();
+  init_lexer(NULL);
+}
+
+static bool _map_input(void) {
+  struct stat inputStat;
+  void *map;
+
+  /* Pipes, terminals and the like go through the spool */
+  if(fstat(fileno(IN(input)), &inputStat) || !S_ISREG(inputStat.st_mode) ||
+     !inputStat.st_size) return false;
+
+  map = mmap(NULL, inputStat.st_size, PROT_READ, MAP_PRIVATE, fileno(IN(input)),
+             0);
+  if(map == MAP_FAILED) return false;
+  /* Advisory only, we don't care if the kernel ignores it */
+  madvise(map, inputStat.st_size, MADV_SEQUENTIAL);
+
+  IN(inputMap) = map;
+  IN(inputMapSize) = inputStat.st_size;
+  IN(inputBase) = (char *)map;
+  IN(inputp) = IN(inputBase);
+  IN(inputEnd) = IN(inputBase) + inputStat.st_size;
+  IN(inputMapped) = true;
+
+  return true;
+}
+
+static void _add_checkpoint_input(long offset) {
+  TGCodeInputCheckpoint *checkpoint;
+
+  /* Only ever called moving forward, restarts revisit covered ground */
+  if(IN(checkpointCount) &&
+     offset < IN(checkpoints)[IN(checkpointCount) - 1].offset +
+                                 (long)GCODE_INPUT_CHECKPOINT_SPAN) return;
+  if(IN(checkpointCount) == IN(checkpointRoom)) {
+    uint32_t room = (IN(checkpointRoom) ? 2 * IN(checkpointRoom) : 16);
+    TGCodeInputCheckpoint *grown = (TGCodeInputCheckpoint *)realloc(
+        IN(checkpoints), room * sizeof(TGCodeInputCheckpoint));
+
+    /* Not fatal, seeking back just gets slower */
+    if(!grown) return;
+    IN(checkpoints) = grown;
+    IN(checkpointRoom) = room;
+  }
+  checkpoint = &IN(checkpoints)[IN(checkpointCount)];
+  checkpoint->offset = offset;
+  checkpoint->in = (const char *)IN(inflater).next_in -
+                   (const char *)IN(inputMap);
+  checkpoint->bits = IN(inflater).data_type & 7;
+  checkpoint->windowLength = sizeof(checkpoint->window);
+  if(inflateGetDictionary(&IN(inflater), checkpoint->window,
+                          &checkpoint->windowLength) == Z_OK)
+    IN(checkpointCount)++;
+}
+
+/* Moves on to the next gzip member after the end of the current one, returns
+ * false if there is none */
+static bool _next_member_input(void) {
+  /* Raw restarts leave the member trailer (CRC32 and size) to us */
+  if(IN(inflateRaw)) {
+    uInt trailer = (IN(inflater).avail_in < 8 ? IN(inflater).avail_in : 8);
+
+    IN(inflater).next_in += trailer;
+    IN(inflater).avail_in -= trailer;
+  }
+  /* Anything else trailing, like padding, is ignored just as gzip does */
+  if(IN(inflater).avail_in < 2 || IN(inflater).next_in[0] != 0x1F ||
+     IN(inflater).next_in[1] != 0x8B) return false;
+  IN(inflateRaw) = false;
+
+  return inflateReset2(&IN(inflater), 15 + 16) == Z_OK;
+}
+
+/* Inflates up to room bytes of compressed input to dst, checkpointing at
+ * deflate block boundaries on the way */
+static size_t _inflate_input(char *dst, size_t room) {
+  int status;
+
+  IN(inflater).next_out = (Bytef *)dst;
+  IN(inflater).avail_out = room;
+  while(IN(inflater).avail_out && IN(inflater).avail_in) {
+    status = inflate(&IN(inflater), Z_BLOCK);
+    if(status == Z_STREAM_END) {
+      if(!_next_member_input()) IN(inflater).avail_in = 0;
+    } else if(status != Z_OK) {
+      display_machine_message("IER: Corrupt compressed input, stopping!");
+      IN(inflater).avail_in = 0;
+    } else if(!IN(inflater).avail_in)
+      display_machine_message("IER: Compressed input is truncated!");
+    else if((IN(inflater).data_type & 128) && !(IN(inflater).data_type & 64))
+      _add_checkpoint_input(IN(inflatedOffset) +
+                            ((char *)IN(inflater).next_out - dst));
+  }
+  IN(inflatedOffset) += room - IN(inflater).avail_out;
+
+  return room - IN(inflater).avail_out;
+}
+
+/* Points the inflater at the last checkpoint at or before offset. Does nothing
+ * if reading on from where we are would get there at least as fast */
+static void _restart_input(long offset) {
+  const TGCodeInputCheckpoint *checkpoint = NULL;
+  uint32_t i;
+
+  for(i = IN(checkpointCount); i && !checkpoint; i--)
+    if(IN(checkpoints)[i - 1].offset <= offset)
+      checkpoint = &IN(checkpoints)[i - 1];
+  if(offset >= IN(inputOffset) &&
+     (checkpoint ? checkpoint->offset : 0) <=
+         IN(inputOffset) + (IN(inputEnd) - IN(inputBase)))
+    return;
+
+  if(checkpoint) {
+    inflateReset2(&IN(inflater), -15);
+    IN(inflateRaw) = true;
+    IN(inflater).next_in = (Bytef *)IN(inputMap) + checkpoint->in;
+    IN(inflater).avail_in = IN(inputMapSize) - checkpoint->in;
+    if(checkpoint->bits)
+      inflatePrime(&IN(inflater), checkpoint->bits,
+                   IN(inflater).next_in[-1] >> (8 - checkpoint->bits));
+    inflateSetDictionary(&IN(inflater), checkpoint->window,
+                         checkpoint->windowLength);
+    IN(inflatedOffset) = checkpoint->offset;
+  } else {
+    inflateReset2(&IN(inflater), 15 + 16);
+    IN(inflateRaw) = false;
+    IN(inflater).next_in = (Bytef *)IN(inputMap);
+    IN(inflater).avail_in = IN(inputMapSize);
+    IN(inflatedOffset) = 0;
+  }
+  GCODE_DEBUG("Compressed input restarted at offset %ld", IN(inflatedOffset));
+  /* The spool starts over from there */
+  IN(inputOffset) = IN(inflatedOffset);
+  IN(inputEnd) = IN(inputp) = IN(inputBase);
+  IN(inputExhausted) = false;
+}
+
+/* Oldest offset the program flow may still go back to: where subprogram
+ * calls return, where spliced text jumped into the file from and where a scan
+ * ahead resumes. -1 if there is none */
+static long _pinned_input(void) {
+  long pinned = stacks_oldest_program();
+  uint8_t i;
+
+  if(IN(scanResume) >= 0 && (pinned < 0 || IN(scanResume) < pinned))
+    pinned = IN(scanResume);
+  for(i = 0; i < IN(spliceDepth); i++)
+    if(IN(spliceFrames)[i].file &&
+       (pinned < 0 || IN(spliceFrames)[i].resume < pinned))
+      pinned = IN(spliceFrames)[i].resume;
+
+  return pinned;
+}
+
+/* Going on from anywhere else than where the program flow says would be
+ * worse than stopping, so there is no more input after this */
+static void _lose_input(char *message) {
+  display_machine_message(message);
+  IN(inputLost) = true;
+}
+
+/* Reads the next chunk of a non-mappable input into the spool. Only ever
+ * called with inputp at or behind inputEnd, returns false on end of input */
+static bool _refill_input(void) {
+  size_t used, keep, drop;
+  ptrdiff_t at;
+  ssize_t got;
+  long pinned;
+
+  if(IN(inputMapped) || IN(inputExhausted) || IN(inputLost) ||
+     !IN(input)) return false;
+
+  used = IN(inputEnd) - IN(inputBase);
+  at = IN(inputp) - IN(inputBase);
+  if(used + GCODE_INPUT_SPOOL_CHUNK > IN(spoolSize)) {
+    if(IN(spoolSize) < GCODE_INPUT_SPOOL_SIZE) {
+      char *grown;
+
+      IN(spoolSize) = (IN(spoolSize) ?
+                       IN(spoolSize) * 2 : GCODE_INPUT_SPOOL_CHUNK);
+      if(IN(spoolSize) > GCODE_INPUT_SPOOL_SIZE)
+        IN(spoolSize) = GCODE_INPUT_SPOOL_SIZE;
+      grown = (char *)realloc(IN(inputBase), IN(spoolSize));
+      if(!grown) {
+        display_machine_message("IER: Out of memory for the input spool!");
+        return false;
+      }
+      IN(inputBase) = grown;
+    } else {
+      /* Spool is at its limit: drop the oldest half, anything seeking back
+       * there will fail from now on. Unless the input can be read again, that
+       * must not be anywhere the program flow may still go back to */
+      drop = IN(spoolSize) / 2;
+      if(!IN(inputCompressed) && !(IN(readingAhead) && seekable_reader()) &&
+         (pinned = _pinned_input()) >= IN(inputOffset) &&
+         pinned - IN(inputOffset) < (long)drop) {
+        if(used + GCODE_INPUT_SPOOL_CHUNK - IN(spoolSize) >
+           (size_t)(pinned - IN(inputOffset))) {
+          _lose_input("PER: Input spool full of blocks still to go back to!");
+          return false;
+        }
+        drop = pinned - IN(inputOffset);
+      }
+      keep = used - drop;
+      memmove(IN(inputBase), IN(inputBase) + drop, keep);
+      IN(inputOffset) += drop;
+      at -= drop;
+      used = keep;
+      GCODE_DEBUG("Input spool full, offsets before %ld no longer reachable",
+                  IN(inputOffset));
+    }
+  }
+
+  if(IN(inputCompressed))
+    got = _inflate_input(IN(inputBase) + used, GCODE_INPUT_SPOOL_CHUNK);
+  else if(IN(readingAhead))
+    got = fetch_data_reader(IN(inputBase) + used, GCODE_INPUT_SPOOL_CHUNK);
+  else {
+    do got = read(fileno(IN(input)), IN(inputBase) + used,
+                  GCODE_INPUT_SPOOL_CHUNK);
+    while(got < 0 && errno == EINTR);
+  }
+  if(got <= 0) {
+    IN(inputExhausted) = true;
+    got = 0;
+  }
+  IN(inputp) = IN(inputBase) + at;
+  IN(inputEnd) = IN(inputBase) + used + got;
+
+  return got;
+}
+
+static bool _init_index_input(TGCodeInputIndex *index, bool ordered) {
+  uint32_t i;
+
+  memset(index, 0x00, sizeof(*index));
+  index->ordered = ordered;
+  index->entries = (TGCodeInputIndexEntry *)malloc(
+      GCODE_PROGRAM_CAPACITY * sizeof(TGCodeInputIndexEntry));
+  if(!index->entries) return false;
+  index->slots = GCODE_PROGRAM_CAPACITY;
+  for(i = 0; i < index->slots; i++) index->entries[i].offset = -1;
+
+  return true;
+}
+
+static void _done_index_input(TGCodeInputIndex *index) {
+  bool ordered = index->ordered;
+
+  free(index->run);
+  free(index->entries);
+  memset(index, 0x00, sizeof(*index));
+  index->ordered = ordered;
+}
+
+/* Returns the slot holding number, or the empty slot where it would go */
+static TGCodeInputIndexEntry *_probe_index_input(TGCodeInputIndex *index,
+                                                 uint32_t number,
+                                                 uint32_t *probes) {
+  /* Fibonacci hashing, slots is always a power of two */
+  uint32_t slot = (number * 2654435769U) & (index->slots - 1);
+
+  *probes = 1;
+  while(index->entries[slot].offset != -1 &&
+        index->entries[slot].number != number) {
+    slot = (slot + 1) & (index->slots - 1);
+    (*probes)++;
+  }
+
+  return &index->entries[slot];
+}
+
+/* Binary search of the sorted run, NULL if number is not in it */
+static TGCodeInputIndexEntry *_search_index_input(TGCodeInputIndex *index,
+                                                  uint32_t number) {
+  uint32_t low = 0, high = index->runUsed, middle;
+
+  while(low < high) {
+    middle = (low + high) / 2;
+    if(index->run[middle].number < number) low = middle + 1;
+    else high = middle;
+  }
+
+  return (low < index->runUsed && index->run[low].number == number ?
+          &index->run[low] : NULL);
+}
+
+static bool _add_index_input(TGCodeInputIndex *index, uint32_t number,
+                             long offset) {
+  TGCodeInputIndexEntry *entry;
+  uint32_t probes;
+
+  if(!index->slots) return false;
+  /* Anything larger than the whole run can't be in the hash table either */
+  if(index->ordered &&
+     (!index->runUsed || number > index->run[index->runUsed - 1].number)) {
+    if(index->runUsed == index->runRoom) {
+      uint32_t room = (index->runRoom ? 2 * index->runRoom :
+                       GCODE_PROGRAM_CAPACITY);
+      TGCodeInputIndexEntry *grown = (TGCodeInputIndexEntry *)realloc(
+          index->run, room * sizeof(TGCodeInputIndexEntry));
+
+      if(!grown) return false;
+      index->run = grown;
+      index->runRoom = room;
+    }
+    index->run[index->runUsed].number = number;
+    index->run[index->runUsed++].offset = offset;
+    return true;
+  }
+  if(index->ordered && _search_index_input(index, number)) return true;
+  /* Keep the load factor under 1/2 so that probe sequences stay short */
+  if(2 * (index->used + 1) > index->slots) {
+    TGCodeInputIndexEntry *old = index->entries;
+    uint32_t i, oldSlots = index->slots;
+
+    index->entries = (TGCodeInputIndexEntry *)malloc(
+        2 * oldSlots * sizeof(TGCodeInputIndexEntry));
+    if(!index->entries) {
+      index->entries = old;
+      return false;
+    }
+    index->slots = 2 * oldSlots;
+    for(i = 0; i < index->slots; i++) index->entries[i].offset = -1;
+    for(i = 0; i < oldSlots; i++)
+      if(old[i].offset != -1)
+        *_probe_index_input(index, old[i].number, &probes) = old[i];
+    free(old);
+  }
+
+  entry = _probe_index_input(index, number, &probes);
+  /* First definition wins, same as the old linear table */
+  if(entry->offset == -1) {
+    entry->number = number;
+    entry->offset = offset;
+    index->used++;
+  }
+
+  return true;
+}
+
+static bool _find_index_input(TGCodeInputIndex *index, uint32_t number,
+                              long *offset) {
+  uint32_t probes;
+  TGCodeInputIndexEntry *entry;
+
+  if(!index->slots) return false;
+  if(index->ordered) {
+    index->searches++;
+    if((entry = _search_index_input(index, number))) {
+      *offset = entry->offset;
+      return true;
+    }
+  }
+  index->lookups++;
+  entry = _probe_index_input(index, number, &probes);
+  index->probes += probes;
+  if(probes > index->longestProbe) index->longestProbe = probes;
+
+  if(entry->offset == -1) return false;
+  *offset = entry->offset;
+
+  return true;
+}
+
+static bool _add_program_input(uint32_t program, long offset) {
+  return _add_index_input(&IN(programs), program, offset);
+}
+
+/* Nothing looks N words of text up but start_at_input(), which only wants
+ * the block to start at, so they are not indexed. Compiled programs come
+ * with theirs, see _load_compiled_input() */
+static void _add_number_input(unsigned long number, long offset) {
+  if(number && number == IN(startNumber) &&
+     IN(startOffset) < 0) IN(startOffset) = offset;
+}
+
+static bool _grow_arena(TGCodeInputArena *arena, size_t more) {
+  size_t size = (arena->size ? arena->size : GCODE_INPUT_ARENA_SIZE);
+  char *grown;
+
+  while(arena->used + more >= size) size *= 2;
+  grown = (char *)realloc(arena->data, size);
+  if(!grown) {
+    display_machine_message("IER: Out of memory for the block arena!");
+    return false;
+  }
+  arena->data = grown;
+  arena->size = size;
+
+  return true;
+}
+
+/* Makes sure arena can take more characters plus a terminator */
+static inline bool _reserve_arena(TGCodeInputArena *arena, size_t more) {
+  return arena->used + more < arena->size || _grow_arena(arena, more);
+}
+
+static inline void _put_arena(TGCodeInputArena *arena, char c) {
+  if(_reserve_arena(arena, 1)) arena->data[arena->used++] = c;
+}
+
+/* Makes sure there is room for one more expression result */
+static bool _reserve_values(void) {
+  uint32_t room;
+  double *grown;
+
+  if(IN(blockValueCount) < IN(blockValueRoom)) return true;
+  room = (IN(blockValueRoom) ?
+          2 * IN(blockValueRoom) : GCODE_INPUT_ARENA_SIZE / 8);
+  if(!(grown = (double *)realloc(IN(blockValues), room * sizeof(double)))) {
+    display_machine_message("IER: Out of memory for the block arena!");
+    return false;
+  }
+  IN(blockValues) = grown;
+  IN(blockValueRoom) = room;
 
   return true;
 }
 
+/* Puts an expression result in the block, returns how many characters that
+ * took. Read back as it is, see fetch_value_input() */
+static size_t _put_value_arena(TGCodeInputArena *arena, double value) {
+  if(!_reserve_arena(arena, 1) || !_reserve_values()) return 0;
+  IN(blockValues)[IN(blockValueCount)++] = value;
+  arena->data[arena->used++] = GCODE_INPUT_VALUE;
+
+  return 1;
+}
+
+/* How many results stand in the block from from up to at */
+static uint32_t _count_values(const char *from, const char *at) {
+  uint32_t count = 0;
+
+  while((from = (const char *)memchr(from, GCODE_INPUT_VALUE, at - from))) {
+    count++;
+    from++;
+  }
+
+  return count;
+}
+
+static const char *_terminate_arena(TGCodeInputArena *arena) {
+  if(!_reserve_arena(arena, 0)) return "";
+  arena->data[arena->used] = '\0';
+
+  return arena->data;
+}
+
+/* Hands out the next line as a view into the input if it already is in its
+ * sanitized form: upper case, no blanks, comments, expressions or unary
+ * functions. A leading N word is checked and skipped over, O words and block
+ * delete are left to the character loop. Mapped input only, a spool may move
+ * under the view while the caller is still looking at it. */
+static bool _try_view_line_input(TGCodeBlockView *block) {
+  const char *text = IN(inputp), *eol;
+  size_t length;
+  unsigned long number = 0;
+  bool numbered = false;
+
+  if(text < IN(inputEnd) && *text == 'N') {
+    numbered = true;
+    /* Same saturation as in the character loop */
+    while(++text < IN(inputEnd) && isdigit(*text))
+      number = (number > (ULONG_MAX - (*text - '0')) / 10 ?
+                ULONG_MAX : number * 10 + (*text - '0'));
+  }
+  /* Cheap early out, such a block starts with a word or a parameter */
+  if(text == IN(inputEnd) || !(isupper(*text) || *text == '#') ||
+     *text == 'N' || *text == 'O') return false;
+  length = clean_run_lexer(text, IN(inputEnd) - text);
+  eol = &text[length];
+  if(eol == IN(inputEnd) || (*eol != '\n' && *eol != '\r') ||
+     has_unary_expression(text, length)) return false;
+
+  if(numbered && !number) {
+    if(block)
+      display_machine_message("SER: negative or zero argument to N word!");
+    IN(lineVolatile) = true;
+  }
+  if(numbered) _add_number_input(number, tell_input());
+  if(block) {
+    block->text = text;
+    block->length = length;
+    block->words = NULL;
+    block->wordCount = 0;
+    block->table = NULL;
+    IN(blocksViewed)++;
+  }
+  /* CR LF counts as a single end of line, same as in fetch_line_input() */
+  IN(inputp) = (*eol == '\r' && &eol[1] < IN(inputEnd) && eol[1] == '\n' ?
+                &eol[2] : &eol[1]);
+  if(tell_input() > IN(scanHorizon)) IN(scanHorizon) = tell_input();
+
+  return true;
+}
+
+/* Posts tend to format all blocks the same way, so once a run of them had to
+ * be rewritten only look every so often */
+static bool _view_line_input(TGCodeBlockView *block) {
+  if(IN(viewMisses) >= GCODE_INPUT_VIEW_RETRY &&
+     (++IN(viewMisses) % GCODE_INPUT_VIEW_RETRY)) return false;
+  if(_try_view_line_input(block)) {
+    IN(viewMisses) = 0;
+    return true;
+  }
+  IN(viewMisses)++;
+
+  return false;
+}
+
+/* Words a fast-forwarded run of straight moves may have, see _skim_input() */
+static const char skimWords[] = "GXYZF";
+
+/* Checks whether the line at text is an optional N word, then nothing but G0,
+ * G1, X, Y, Z and F words with literal numbers, blanks in between. If so, puts
+ * where each number is and how long it is in at and length (NULL if the word
+ * is not there) and returns where the next line starts, otherwise NULL */
+static const char *_skim_line_input(const char *text, const char **at,
+                                    size_t *length, unsigned long *number) {
+  const char *letter;
+  unsigned long code;
+  bool seen = false, dot;
+  int slot;
+
+  memset(at, 0x00, sizeof(skimWords) * sizeof(*at));
+  *number = 0;
+  if(text < IN(inputEnd) && toupper(*text) == 'N') {
+    /* Same saturation as in the character loop */
+    while(++text < IN(inputEnd) && isdigit(*text))
+      *number = (*number > (ULONG_MAX - (*text - '0')) / 10 ?
+                 ULONG_MAX : *number * 10 + (*text - '0'));
+    if(!*number) return NULL;
+  }
+  for(;;) {
+    while(text < IN(inputEnd) && (*text == ' ' || *text == '\t')) text++;
+    if(text == IN(inputEnd)) return NULL;
+    if(*text == '\n' || *text == '\r') break;
+    if(!*text || !(letter = strchr(skimWords, toupper(*text)))) return NULL;
+    slot = letter - skimWords;
+    if(at[slot]) return NULL; /* Repeated, let the checker have it */
+    at[slot] = ++text;
+    if(slot && text < IN(inputEnd) && (*text == '+' || *text == '-')) text++;
+    for(code = 0, dot = !slot; text < IN(inputEnd); text++)
+      if(isdigit(*text)) code = (code > 1 ? code : code * 10 + (*text - '0'));
+      else if(*text == '.' && !dot) dot = true;
+      else break;
+    length[slot] = text - at[slot];
+    if(!isdigit(text[-1]) && (text[-1] != '.' || !isdigit(text[-2])))
+      return NULL;
+    if(!slot && code > 1) return NULL;
+    seen = true;
+  }
+
+  /* CR LF counts as a single end of line, same as in fetch_line_input() */
+  return !seen ? NULL : (*text == '\r' && &text[1] < IN(inputEnd) &&
+                         text[1] == '\n' ? &text[2] : &text[1]);
+}
+
+/* While fast-forwarding, a run of lines that only move in a straight line ends
+ * up where its last X, Y and Z words say, at its last F and in the mode of its
+ * last G word. Such a run is read in one go and handed out as a single block
+ * made of just those words, the block to start at always runs on its own */
+static bool _skim_input(TGCodeBlockView *block) {
+  const char *at[sizeof(skimWords)], *last[sizeof(skimWords)] = { NULL };
+  const char *next;
+  size_t length[sizeof(skimWords)], lastLength[sizeof(skimWords)];
+  unsigned long number;
+  uint64_t lines = 0;
+  long offset;
+  int slot;
+
+  if(!IN(startNumber) || !IN(inputMapped) ||
+     gcodeContext->machineContext.dryRun ||
+     !collapsible_gcode_state()) return false;
+  while((next = _skim_line_input(IN(inputp), at, length, &number))) {
+    offset = tell_input();
+    if(number == IN(startNumber) ||
+       (IN(startOffset) >= offset &&
+        IN(startOffset) < offset + (next - IN(inputp))))
+      break;
+    if(number) _add_number_input(number, offset);
+    for(slot = 0; slot < (int)sizeof(skimWords) - 1; slot++)
+      if(at[slot]) {
+        last[slot] = at[slot];
+        lastLength[slot] = length[slot];
+      }
+    IN(inputp) = next;
+    lines++;
+  }
+  if(!lines) return false;
+  if(tell_input() > IN(scanHorizon)) IN(scanHorizon) = tell_input();
+  /* One of them gets counted by fetch_line_input() */
+  IN(blocksSkipped) += lines - 1;
+
+  IN(blockArena).used = 0;
+  IN(blockValueCount) = 0;
+  IN(valueAt) = NULL;
+  for(slot = 0; slot < (int)sizeof(skimWords) - 1; slot++)
+    if(last[slot] && _reserve_arena(&IN(blockArena), lastLength[slot] + 1)) {
+      IN(blockArena).data[IN(blockArena).used++] = skimWords[slot];
+      memcpy(&IN(blockArena).data[IN(blockArena).used], last[slot],
+             lastLength[slot]);
+      IN(blockArena).used += lastLength[slot];
+    }
+  block->text = _terminate_arena(&IN(blockArena));
+  block->length = IN(blockArena).used;
+  block->words = NULL;
+  block->wordCount = 0;
+  block->table = NULL;
+  IN(blocksRewritten)++;
+  IN(lineVolatile) = true;
+
+  return true;
+}
+
+/* Takes over a mapped input if it is a compiled program: from here on the
+ * input is just its blocks, already indexed for O words */
+static bool _load_compiled_input(void) {
+  const TGCodeCompiledHeader *header =
+      (const TGCodeCompiledHeader *)IN(inputBase);
+  const TGCodeCompiledIndexEntry *entries;
+  uint32_t i;
+
+  if(!IN(inputMapped) || IN(inputMapSize) < sizeof(*header) ||
+     memcmp(header->magic, GCODE_COMPILED_MAGIC, sizeof(header->magic)))
+    return false;
+  if(!check_compiler(header, IN(inputMapSize))) {
+    /* Running it as G-Code would not end well either */
+    IN(inputEnd) = IN(inputp);
+    return false;
+  }
+
+  entries = (const TGCodeCompiledIndexEntry *)
+      &IN(inputBase)[header->programsAt];
+  for(i = 0; i < header->programCount; i++)
+    if(entries[i].offset >= 0 &&
+       entries[i].offset <= (int64_t)header->blocksSize &&
+       !_add_program_input(entries[i].number, entries[i].offset)) {
+      display_machine_message("PER: Program table overflow!");
+      break;
+    }
+  entries = (const TGCodeCompiledIndexEntry *)&IN(inputBase)[header->numbersAt];
+  for(i = 0; i < header->numberCount; i++)
+    if(entries[i].offset >= 0 &&
+       entries[i].offset <= (int64_t)header->blocksSize &&
+       !_add_index_input(&IN(numbers), entries[i].number, entries[i].offset)) {
+      display_machine_message("PER: Line number table overflow!");
+      break;
+    }
+  IN(inputBase) += header->blocksAt;
+  IN(inputp) = IN(inputBase);
+  IN(inputEnd) = IN(inputBase) + header->blocksSize;
+  IN(scanHorizon) = header->blocksSize;
+  IN(scanComplete) = true;
+  IN(inputCompiled) = true;
+  IN(compiledTextEnd) = NULL;
+
+  GCODE_DEBUG("Compiled program, %u programs and %llu bytes of blocks",
+              header->programCount, (unsigned long long)header->blocksSize);
+
+  return true;
+}
+
+/* Takes over a mapped input if it is gzip compressed: from here on it is
+ * spooled like a pipe, only inflated from the mapping instead of read */
+static bool _load_compressed_input(void) {
+  const unsigned char *magic = (const unsigned char *)IN(inputBase);
+
+  if(!IN(inputMapped) || IN(inputMapSize) < 2 || magic[0] != 0x1F ||
+     magic[1] != 0x8B)
+    return false;
+  memset(&IN(inflater), 0x00, sizeof(IN(inflater)));
+  IN(inflater).next_in = (Bytef *)IN(inputMap);
+  IN(inflater).avail_in = IN(inputMapSize);
+  /* 15 + 16: largest window, gzip header and trailer */
+  if(inflateInit2(&IN(inflater), 15 + 16) != Z_OK) {
+    display_machine_message("IER: Unable to set up decompression, assuming empty!");
+    IN(inflater).avail_in = 0;
+  }
+  IN(inflateRaw) = false;
+  IN(inflatedOffset) = 0;
+  IN(inputMapped) = false;
+  IN(inputCompressed) = true;
+  IN(inputBase) = NULL;
+  IN(inputEnd) = IN(inputp) = NULL;
+
+  GCODE_DEBUG("Input is compressed, checkpointing every %lu bytes",
+              (unsigned long)GCODE_INPUT_CHECKPOINT_SPAN);
+
+  return true;
+}
+
+/* Plain text is read by the read-ahead thread if that was asked for, so it
+ * is spooled instead of mapped */
+static bool _load_read_ahead_input(void) {
+  if(!IN(readAheadWanted) || !IN(input)) return false;
+  if(IN(inputMapped)) {
+    munmap(IN(inputMap), IN(inputMapSize));
+    IN(inputMap) = NULL;
+    IN(inputMapSize) = 0;
+    IN(inputMapped) = false;
+    IN(inputBase) = NULL;
+    IN(inputEnd) = IN(inputp) = NULL;
+  }
+
+  return (IN(readingAhead) = init_reader(IN(input)));
+}
+
+void enable_read_ahead_input(void) {
+  IN(readAheadWanted) = true;
+}
+
+bool init_input(void *data) {
+  IN(input) = (FILE *)data;
+  IN(inputBase) = NULL;
+  IN(inputEnd) = IN(inputp) = NULL;
+  IN(inputOffset) = 0;
+  IN(spoolSize) = 0;
+  IN(inputMapped) = IN(inputAtEOF) = IN(inputExhausted) =
+      IN(inputCompiled) = false;
+  IN(inputCompressed) = IN(readingAhead) = false;
+  IN(checkpoints) = NULL;
+  IN(checkpointCount) = IN(checkpointRoom) = 0;
+  IN(inputMap) = NULL;
+  IN(inputMapSize) = 0;
+  IN(compiledTextEnd) = NULL;
+  if(IN(input) && _map_input())
+    GCODE_DEBUG("Input mapped in, %zd bytes", IN(inputEnd) - IN(inputBase))
+  else GCODE_DEBUG("Input is not mappable, spooling up to %zd bytes of it",
+                   (size_t)GCODE_INPUT_SPOOL_SIZE);
+  IN(scanHorizon) = 0;
+  IN(scanResume) = -1;
+  IN(scanComplete) = IN(inputLost) = false;
+  if(!_init_index_input(&IN(programs), false) ||
+     !_init_index_input(&IN(numbers), true))
+    display_machine_message("WAR: No memory for indexing the program!");
+  IN(startNumber) = 0;
+  IN(startOffset) = -1;
+  IN(blocksSkipped) = 0;
+  if(!_load_compiled_input() && !_load_compressed_input())
+    _load_read_ahead_input();
+  memset(IN(spliceFrames), 0x00, sizeof(IN(spliceFrames)));
+  IN(spliceDepth) = 0;
+  IN(spliced) = IN(endOfSplice) = false;
+  IN(splicesReused) = 0;
+  IN(blockArena).used = IN(wordArena).used = 0;
+  IN(blockValueCount) = 0;
+  IN(valueAt) = NULL;
+  _reserve_arena(&IN(blockArena), 0);
+  _reserve_arena(&IN(wordArena), 0);
+  IN(blocksViewed) = IN(blocksRewritten) = IN(blocksDecoded) = 0;
+  IN(viewMisses) = 0;
+  IN(blockCache) = NULL;
+  IN(blockCacheSlots) = IN(blockCacheUsed) = 0;
+  IN(cacheWords) = NULL;
+  IN(cacheWordsUsed) = IN(cacheWordsRoom) = 0;
+  IN(readSpans) = NULL;
+  IN(readSpanCount) = IN(readSpanRoom) = 0;
+  IN(runStart) = IN(runEnd) = IN(knownEnd) = 0;
+  IN(pendingText) = NULL;
+  IN(cacheHits) = IN(cacheMisses) = 0;
+  IN(inputIdentified) = false;
+
+  GCODE_DEBUG("Input stream up, %d program table entries preallocated",
+              GCODE_PROGRAM_CAPACITY);
+  pthread_once(&processInput, _setup_process_input);
+
+  return true;
+}
+
+static bool _seek_file_input(long offset) {
+  bool result;
+
+  /* Compressed input doesn't have to inflate all the way to get there */
+  if(IN(inputCompressed) &&
+     (offset < IN(inputOffset) ||
+      offset > IN(inputOffset) + (IN(inputEnd) - IN(inputBase))))
+    _restart_input(offset);
+  /* So does a seekable input read ahead */
+  else if(IN(readingAhead) &&
+          (offset < IN(inputOffset) ||
+           offset > IN(inputOffset) + (IN(inputEnd) - IN(inputBase))) &&
+          restart_reader(offset)) {
+    IN(inputOffset) = offset;
+    IN(inputEnd) = IN(inputp) = IN(inputBase);
+    IN(inputExhausted) = false;
+  }
+  /* A spool may need to read ahead to get there */
+  while(offset > IN(inputOffset) + (IN(inputEnd) - IN(inputBase)) &&
+        _refill_input());
+  if(offset < IN(inputOffset) ||
+     offset > IN(inputOffset) + (IN(inputEnd) - IN(inputBase)))
+    result = false;
+  else {
+    IN(inputp) = IN(inputBase) + (offset - IN(inputOffset));
+    IN(inputAtEOF) = false;
+    /* Compiled programs only ever seek to the start of a record */
+    IN(compiledTextEnd) = NULL;
+    result = true;
+  }
+
+  GCODE_DEBUG("Seek to offset %zd in input file", offset);
+
+  return result;
+}
+
 bool rewind_input(void) {
-  if(input) {
-    rewind(input);
+  /* Whatever was spliced is abandoned */
+  IN(spliceDepth) = 0;
+  IN(spliced) = false;
+  if(IN(input) && _seek_file_input(0)) {
     GCODE_DEBUG("Program reset");
 
     return true;
   } else {
-    display_machine_message("IER: No program to reset, ignoring request!");
+    /* Otherwise the start was dropped from a spool, up to the caller */
+    if(!IN(input))
+      display_machine_message("IER: No program to reset, ignoring request!");
+
+    return false;
+  }
+}
 
+static TGCodeSpliceFrame *_push_splice_input(void) {
+  if(IN(spliceDepth) == GCODE_INPUT_SPLICE_DEPTH) {
+    display_machine_message("PER: Splices nested too deep!");
+    return NULL;
+  }
+
+  return &IN(spliceFrames)[IN(spliceDepth)++];
+}
+
+/* Goes back to a position told inside spliced text, dropping all frames above
+ * it. File frames on the way put the file back where the jump came from */
+static bool _resume_splice_input(long offset) {
+  uint8_t depth = (-1 - offset) % GCODE_INPUT_SPLICE_DEPTH;
+  size_t at = (-1 - offset) / GCODE_INPUT_SPLICE_DEPTH;
+
+  if(depth >= IN(spliceDepth) || IN(spliceFrames)[depth].file ||
+     at > IN(spliceFrames)[depth].length) {
+    display_machine_message("IER: Return into a splice that is gone!");
     return false;
   }
+  while(IN(spliceDepth) > depth + 1)
+    if(IN(spliceFrames)[--IN(spliceDepth)].file &&
+       !_seek_file_input(IN(spliceFrames)[IN(spliceDepth)].resume)) {
+      _lose_input("PER: Unable to return from a subprogram called in a splice!");
+      return false;
+    }
+  IN(spliceFrames)[depth].at = at;
+  IN(spliced) = true;
+
+  return true;
 }
 
 bool seek_input(long offset) {
-  int result;
+  TGCodeSpliceFrame *frame;
+  char message[0xFF];
 
-  result = fseek(input, offset, SEEK_SET);
+  if(offset < 0) return _resume_splice_input(offset);
+  /* Spliced text jumping into the file, remember where to come back to */
+  if(IN(spliced)) {
+    if(!(frame = _push_splice_input())) return false;
+    frame->file = true;
+    frame->resume = IN(inputOffset) + (IN(inputp) - IN(inputBase));
+    IN(spliced) = false;
+  }
+  if(_seek_file_input(offset)) return true;
 
-  GCODE_DEBUG("Seek to offset %zd in input file", offset);
+  snprintf(message, sizeof(message),
+           "PER: Unable to seek input to offset %ld!", offset);
+  _lose_input(message);
 
-  return result ? false : true;
+  return false;
 }
 
 long tell_input(void) {
-  return ftell(input);
+  /* Positions inside spliced text are negative, the frame is encoded too */
+  if(IN(spliced))
+    return -1 - (long)(IN(spliceFrames)[IN(spliceDepth) - 1].at *
+                       GCODE_INPUT_SPLICE_DEPTH + (IN(spliceDepth) - 1));
+  else return IN(inputOffset) + (IN(inputp) - IN(inputBase));
 }
 
 char fetch_char_input(void) {
   char result;
 
-  if(spliced) {
-    result = splice[splicep++];
-    /* If the next char is '\0', act as if it were EOF and revert to the file */
-    if(!splice[splicep]) {
-      spliced = false;
-      endOfSplice = true;
-      free((void *)splice);
+  if(IN(spliced)) {
+    TGCodeSpliceFrame *frame = &IN(spliceFrames)[IN(spliceDepth) - 1];
+
+    result = frame->data[frame->at++];
+    /* At the end, act as if it were EOF and revert to what was underneath */
+    if(frame->at >= frame->length) {
+      IN(spliceDepth)--;
+      IN(spliced) = (IN(spliceDepth) &&
+                     !IN(spliceFrames)[IN(spliceDepth) - 1].file);
+      IN(endOfSplice) = true;
     }
   } else {
-    if(input) result = fgetc(input);
-    else {
+    if(IN(input)) {
+      if(IN(inputp) < IN(inputEnd) || _refill_input()) result = *IN(inputp)++;
+      else {
+        IN(inputAtEOF) = true;
+        result = EOF;
+      }
+    } else {
       display_machine_message("IER: Unable to read input, assuming empty!");
       result = EOF;
     }
@@ -101,17 +967,38 @@ char fetch_char_input(void) {
 /* NOTE: when in spliced mode, this does not change content retrieved in the
  * future as ungetc() does, only moves the virtual file pointer backwards */
 void push_char_input(unsigned char c) {
-  if(spliced && splicep) splicep--;
-  else ungetc(c, input);
+  if(IN(spliced) && IN(spliceFrames)[IN(spliceDepth) - 1].at)
+    IN(spliceFrames)[IN(spliceDepth) - 1].at--;
+  /* Pushing back EOF is a NOP, we'll hit it again on the next fetch */
+  else if(IN(inputAtEOF)) IN(inputAtEOF) = false;
+  else if(IN(inputp) > IN(inputBase)) IN(inputp)--;
 }
 
-bool fetch_line_input(char *line) {
+/* The character by character path for everything that can't be viewed */
+static bool _lex_line_input(TGCodeBlockView *block) {
   int c = '\0';
-  uint8_t i = 0, j, l;
+  size_t i = 0, l;
   bool ignore = false;
-  char commsg[0xFF - 2]; /* max line length - 2 parentheses */
 
+  IN(blockArena).used = 0;
+  IN(blockValueCount) = 0;
+  IN(valueAt) = NULL;
   while(c != EOF) {
+    /* Plain text in the middle of a block is sanitized in bulk */
+    if(i && !ignore && !IN(spliced)) {
+      size_t written, room = SIZE_MAX;
+
+      if(block)
+        room = (_reserve_arena(&IN(blockArena), GCODE_INPUT_ARENA_SIZE) ?
+                IN(blockArena).size - IN(blockArena).used - 1 : 0);
+      IN(inputp) += sanitize_run_lexer(
+          IN(inputp), IN(inputEnd) - IN(inputp),
+          (block ? &IN(blockArena).data[IN(blockArena).used] : NULL), room,
+          &written);
+      if(block) IN(blockArena).used += written;
+      i += written;
+    }
+
     c = toupper(fetch_char_input());
 
     if(c == '\n' || c == '\r') {
@@ -123,7 +1010,10 @@ bool fetch_line_input(char *line) {
       }
 
       if(i) break; /* EOL with data: return line */
-      else continue; /* EOL without data: strip empty line */
+      /* EOL without data: strip empty line, the next one may be clean */
+      else if(IN(inputMapped) && !IN(spliced) &&
+              _view_line_input(block)) return true;
+      else continue;
     }
 
     /* Strip whitespace and deleted blocks */
@@ -131,55 +1021,62 @@ bool fetch_line_input(char *line) {
 
     if(c == '/' && !i && block_delete_machine()) { /* Strip deleted blocks */
       ignore = true;
+      IN(lineVolatile) = true;
       continue;
     }
 
     if(c == '(') { /* Strip (and maybe display) comments */
-      j = 0;
+      IN(wordArena).used = 0;
 
       c = fetch_char_input();
-      while(c != ')') {
-        commsg[j++] = c;
+      while(c != ')' && c != EOF) {
+        _put_arena(&IN(wordArena), c);
         c = fetch_char_input();
       }
-      commsg[j] = '\0';
+      _terminate_arena(&IN(wordArena));
       /* We shouldn't output messages if we were called in test mode */
-      if(!strncmp(commsg, "MSG,", strlen("MSG,")) && line)
-        display_machine_message(&commsg[strlen("MSG,")]);
+      if(!strncmp(IN(wordArena).data, "MSG,", strlen("MSG,"))) {
+        if(block) display_machine_message(&IN(wordArena).data[strlen("MSG,")]);
+        IN(lineVolatile) = true;
+      }
 
       continue;
     }
 
     if((c == 'N' || c == 'O') && !i) {
       int d;
+      unsigned long number = 0;
+      long at = tell_input() - 1;
 
-      j = 0;
       /* read the number, which should be a literal integer, since O and N do
-       * not support parameter indirection */
+       * not support parameter indirection. Saturates just like strtoul() */
       d = fetch_char_input();
       while(isdigit(d)) {
-        commsg[j++] = d;
+        number = (number > (ULONG_MAX - (d - '0')) / 10 ?
+                  ULONG_MAX : number * 10 + (d - '0'));
         d = fetch_char_input();
       }
-      commsg[j] = '\0';
       push_char_input(d); /* First non-digit character has to go back */
 
       if(c == 'O') {
-        if(programCount < GCODE_PROGRAM_CAPACITY) {
-          /* Better mess with precision than signedness */
-          programs[programCount].program = (uint16_t)atol(commsg);
-          /* The line immediately after the O word */
-          programs[programCount].offset = tell_input();
-          programCount++;
-        } else display_machine_message("PER: Program table overflow!");
+        IN(lineVolatile) = true;
+        /* Anything behind the horizon has already been indexed */
+        if(tell_input() <= IN(scanHorizon)) continue;
+        /* The line immediately after the O word */
+        if(!_add_program_input(number, tell_input()))
+          display_machine_message("PER: Program table overflow!");
       } else {
         /* The standard is quite ambivalent about N: it's not mandatory and
          * serves no universal (i.e. cross-vendor) purpose. Even the arguments
          * can be duplicated or be given out of order! The only thing we can
          * check for is that we have indeed been given a positive non-zero
          * integer as argument. */
-        if(atol(commsg) <= 0)
-          display_machine_message("SER: negative or zero argument to N word!");
+        if(!number) {
+          if(block)
+            display_machine_message("SER: negative or zero argument to N word!");
+          IN(lineVolatile) = true;
+        }
+        if(!IN(spliced)) _add_number_input(number, at);
       }
 
       continue;
@@ -189,67 +1086,695 @@ bool fetch_line_input(char *line) {
     if(c == '%') continue;
 
     if(c == '[') { /* Evaluate expressions before any other processing */
-      j = 0;
+      long location = (IN(spliced) ? -1 : tell_input());
+
+      IN(lineVolatile) = true;
+      IN(wordArena).used = 0;
       l = 0;
       c = fetch_char_input();
-      while(!(c == ']' && !l)) {
+      while(!(c == ']' && !l) && c != EOF) {
         /* Strip whitespace */
         if(!(c == ' ' || c == '\t')) {
-          commsg[j++] = c;
+          _put_arena(&IN(wordArena), c);
           if(c == '[') l++; /* Handle nested brackets properly */
           if(c == ']') l--;
         }
         c = fetch_char_input();
       }
-      commsg[j] = '\0';
 
-      if(line)
-        i += snprintf(&line[i], 0xFF - i, GCODE_REAL_FORMAT,
-                      evaluate_expression(commsg));
+      if(block) {
+        const char *text = _terminate_arena(&IN(wordArena));
+
+        /* Compiled once per place in the input, see gcode-expression.h. The
+         * result goes into the word table as it is, never through text */
+        i += _put_value_arena(&IN(blockArena), evaluate_cached_expression(
+            text, (text == IN(wordArena).data ? IN(wordArena).used : 0),
+            location));
+      } else i++; /* Only need to know the line isn't empty */
 
       continue;
     }
 
-    if(line && c != EOF) line[i++] = c; /* Otherwise add to the line buffer */
+    if(c != EOF) { /* Otherwise add to the line buffer */
+      if(block) _put_arena(&IN(blockArena), c);
+      i++;
+    }
+  }
+
+  if(!IN(spliced)) {
+    if(tell_input() > IN(scanHorizon)) IN(scanHorizon) = tell_input();
+    if(c == EOF) IN(scanComplete) = true;
   }
 
-  if(line) {
-    line[i] = '\0';
-    evaluate_unary_expression(line);
+  if(block) {
+    block->text = _terminate_arena(&IN(blockArena));
+    if(IN(blockArena).data && has_unary_expression(IN(blockArena).data,
+                                                   IN(blockArena).used)) {
+      evaluate_unary_expression(IN(blockArena).data);
+      IN(lineVolatile) = true;
+    }
+    block->length = strlen(block->text);
+    block->words = NULL;
+    block->wordCount = 0;
+    block->table = NULL;
+    IN(blocksRewritten)++;
   }
 
   return c == EOF ? false : true;
 }
 
-long get_program_input(uint16_t program) {
-  uint8_t i;
-  for(i = 0; i < GCODE_PROGRAM_CAPACITY; i++)
-    if(programs[i].program == program) return programs[i].offset;
+/* Runs the lexer on what is left of input up to end only */
+static bool _lex_fenced_input(TGCodeBlockView *block, const char *end) {
+  const char *blocksEnd = IN(inputEnd);
+  bool result;
+
+  IN(inputEnd) = end;
+  result = _lex_line_input(block);
+  IN(inputEnd) = blocksEnd;
+  IN(inputAtEOF) = false;
+
+  return result;
+}
+
+/* Next block of a compiled program. Decoded records are handed out as they
+ * are, text records go through the lexer as if they were the whole input */
+static bool _fetch_compiled_input(TGCodeBlockView *block) {
+  const TGCodeCompiledRecord *record;
+  size_t room;
+  bool valid;
+
+  while(true) {
+    if(IN(compiledTextEnd)) {
+      valid = _lex_fenced_input(block, IN(compiledTextEnd));
+      /* A deleted block may leave more than one block in a record */
+      if(valid && IN(inputp) < IN(compiledTextEnd)) return true;
+      /* Records start 8 byte aligned */
+      IN(inputp) = IN(inputBase) +
+          ((IN(compiledTextEnd) - IN(inputBase) + 7) & ~(ptrdiff_t)7);
+      IN(compiledTextEnd) = NULL;
+      /* An empty one (e.g. a deleted block) yields nothing, try the next */
+      if(valid) return true;
+    }
+    if(IN(inputp) >= IN(inputEnd)) {
+      IN(inputp) = IN(inputEnd);
+      IN(inputAtEOF) = true;
+      return false;
+    }
+
+    record = (const TGCodeCompiledRecord *)IN(inputp);
+    room = IN(inputEnd) - IN(inputp);
+    valid = !((IN(inputp) - IN(inputBase)) % 8) && room >= sizeof(*record) &&
+            record->size >= sizeof(*record) && !(record->size % 8) &&
+            record->size <= room;
+    if(valid && record->kind == GCODE_COMPILED_WORDS)
+      valid = record->count <=
+              (record->size - sizeof(*record)) / sizeof(TGCodeWord);
+    else if(valid && record->kind == GCODE_COMPILED_TEXT)
+      valid = record->count <= record->size - sizeof(*record);
+    else valid = false;
+    if(!valid) {
+      display_machine_message("IER: Corrupt compiled program, stopping!");
+      IN(inputp) = IN(inputEnd);
+      IN(inputAtEOF) = true;
+      return false;
+    }
+
+    if(record->kind == GCODE_COMPILED_WORDS) {
+      if(block) {
+        block->text = "";
+        block->length = 0;
+        block->words = (const TGCodeWord *)&record[1];
+        block->wordCount = record->count;
+        block->table = NULL;
+        IN(blocksDecoded)++;
+      }
+      IN(inputp) += record->size;
+      return true;
+    }
+    IN(inputp) = (const char *)&record[1];
+    IN(compiledTextEnd) = &IN(inputp)[record->count];
+  }
+}
+
+static uint32_t _hash_cache_input(long offset) {
+  /* Offsets grow in small steps, so mix the high bits into the low ones */
+  return (uint32_t)(((uint64_t)offset * 0x9E3779B97F4A7C15ULL) >> 32) &
+         (IN(blockCacheSlots) - 1);
+}
+
+/* Returns the slot holding offset, or the empty slot where it would go */
+static TGCodeBlockCacheEntry *_probe_cache_input(long offset) {
+  uint32_t slot = _hash_cache_input(offset);
+
+  while(IN(blockCache)[slot].offset != -1 &&
+        IN(blockCache)[slot].offset != offset)
+    slot = (slot + 1) & (IN(blockCacheSlots) - 1);
+
+  return &IN(blockCache)[slot];
+}
+
+/* Hands out the block fetched from offset before, as long as where that fetch
+ * left off is still in what we have of the input */
+static bool _fetch_cached_input(TGCodeBlockView *block, long offset) {
+  TGCodeBlockCacheEntry *entry;
+
+  if(!IN(blockCacheUsed) ||
+     (entry = _probe_cache_input(offset))->offset == -1 ||
+     entry->next < IN(inputOffset) ||
+     entry->next > IN(inputOffset) + (IN(inputEnd) - IN(inputBase))) {
+    IN(cacheMisses)++;
+    return false;
+  }
+
+  block->text = "";
+  block->length = 0;
+  block->words = &IN(cacheWords)[entry->at];
+  block->wordCount = entry->count;
+  block->table = NULL;
+  IN(inputp) = IN(inputBase) + (entry->next - IN(inputOffset));
+  IN(cacheHits)++;
+
+  return true;
+}
+
+/* Hands out an instruction of a compiled subprogram, as long as where its
+ * fetch left off is still in what we have of the input */
+static bool _fetch_instruction_input(TGCodeBlockView *block,
+                                     const TGCodeInstruction *instruction) {
+  if(instruction->next < IN(inputOffset) ||
+     instruction->next > IN(inputOffset) + (IN(inputEnd) - IN(inputBase)))
+    return false;
+
+  block->text = "";
+  block->length = 0;
+  block->words = instruction->table.words;
+  block->wordCount = instruction->table.wordsEnd - instruction->table.words;
+  block->table = &instruction->table;
+  IN(inputp) = IN(inputBase) + (instruction->next - IN(inputOffset));
+
+  return true;
+}
+
+/* Index of the first span ending at or after offset */
+static uint32_t _find_span_input(long offset) {
+  uint32_t low = 0, high = IN(readSpanCount), middle;
+
+  while(low < high) {
+    middle = (low + high) / 2;
+    if(IN(readSpans)[middle].end < offset) low = middle + 1;
+    else high = middle;
+  }
+
+  return low;
+}
+
+/* Merges [start, end) into the spans read so far */
+static void _add_span_input(long start, long end) {
+  uint32_t first = _find_span_input(start), last = first;
+
+  while(last < IN(readSpanCount) && IN(readSpans)[last].start <= end) {
+    if(IN(readSpans)[last].start < start) start = IN(readSpans)[last].start;
+    if(IN(readSpans)[last].end > end) end = IN(readSpans)[last].end;
+    last++;
+  }
+  if(first == last) {
+    if(IN(readSpanCount) == IN(readSpanRoom)) {
+      uint32_t room = (IN(readSpanRoom) ?
+                       2 * IN(readSpanRoom) : GCODE_PROGRAM_CAPACITY);
+      TGCodeInputSpan *grown = (TGCodeInputSpan *)realloc(
+          IN(readSpans), room * sizeof(TGCodeInputSpan));
+
+      /* Only costs cache hits later on */
+      if(!grown) return;
+      IN(readSpans) = grown;
+      IN(readSpanRoom) = room;
+    }
+    memmove(&IN(readSpans)[first + 1], &IN(readSpans)[first],
+            (IN(readSpanCount) - first) * sizeof(TGCodeInputSpan));
+    IN(readSpanCount)++;
+    last = first + 1;
+  }
+  IN(readSpans)[first].start = start;
+  IN(readSpans)[first].end = end;
+  memmove(&IN(readSpans)[first + 1], &IN(readSpans)[last],
+          (IN(readSpanCount) - last) * sizeof(TGCodeInputSpan));
+  IN(readSpanCount) -= last - first - 1;
+}
+
+/* Fetching continues somewhere else than where the last fetch left off */
+static void _jump_read_input(long offset) {
+  uint32_t span;
+
+  if(IN(runEnd) > IN(runStart)) _add_span_input(IN(runStart), IN(runEnd));
+  IN(runStart) = IN(runEnd) = offset;
+  span = _find_span_input(offset);
+  IN(knownEnd) = (span < IN(readSpanCount) &&
+                  IN(readSpans)[span].start <= offset ?
+                  IN(readSpans)[span].end : offset);
+}
+
+static bool _fetch_block_input(TGCodeBlockView *block) {
+  const TGCodeInstruction *instruction;
+  long offset;
+  bool fromFile, jumped, again, result;
+
+  if(IN(inputCompiled)) {
+    /* Splices end with a line break and must not run into the records */
+    if(IN(spliced) && _lex_fenced_input(block, IN(inputp))) return true;
+    return _fetch_compiled_input(block);
+  }
+  IN(pendingText) = NULL;
+  /* Scanning for O words is no reading as far as the cache is concerned */
+  fromFile = (block && !IN(spliced));
+  offset = (fromFile ? tell_input() : -1);
+  jumped = (fromFile && offset != IN(runEnd));
+  if(jumped) _jump_read_input(offset);
+  if(fromFile && (instruction = fetch_subprogram(offset, jumped)) &&
+     _fetch_instruction_input(block, instruction)) {
+    IN(runEnd) = instruction->next;
+    return true;
+  }
+  again = (fromFile && offset < IN(knownEnd));
+  if(again && _fetch_cached_input(block, offset)) {
+    IN(runEnd) = tell_input();
+    fetched_subprogram(offset, IN(runEnd), true);
+    return true;
+  }
+
+  IN(lineVolatile) = false;
+  result = ((fromFile && _skim_input(block)) ||
+            (IN(inputMapped) && !IN(spliced) && _view_line_input(block)) ||
+            _lex_line_input(block));
+  if(fromFile) {
+    if(result && again && !IN(lineVolatile)) {
+      IN(pendingText) = block->text;
+      IN(pendingOffset) = offset;
+      IN(pendingNext) = tell_input();
+    }
+    IN(runEnd) = tell_input();
+    if(result) fetched_subprogram(offset, IN(runEnd), !IN(lineVolatile));
+  }
+
+  return result;
+}
+
+bool fetch_line_input(TGCodeBlockView *block) {
+  char message[0xFF];
+  long offset = (block && !IN(spliced) ? tell_input() : -1);
+  bool result = !IN(inputLost) && _fetch_block_input(block);
+
+  if(!IN(startNumber) || !block || !result) return result;
+  /* However it was fetched, the block to start at is the one that spans it */
+  if(IN(startOffset) >= 0 && offset >= 0 && offset <= IN(startOffset) &&
+     IN(startOffset) < tell_input()) {
+    fast_forward_machine(false);
+    snprintf(message, sizeof(message),
+             "STA: Starting at N%u after %llu blocks fast-forwarded",
+             IN(startNumber), (unsigned long long)IN(blocksSkipped));
+    display_machine_message(message);
+    IN(startNumber) = 0;
+  } else IN(blocksSkipped)++;
+
+  return result;
+}
+
+double fetch_value_input(const char *at) {
+  const char *from = IN(blockArena).data;
+  uint32_t index = 0;
+
+  if(!IN(blockValueCount) || at < IN(blockArena).data ||
+     at >= &IN(blockArena).data[IN(blockArena).used] ||
+     *at != GCODE_INPUT_VALUE)
+    return NAN;
+  /* Words get read left to right, carry on from the one before */
+  if(IN(valueAt) && IN(valueAt) <= at) {
+    from = IN(valueAt);
+    index = IN(valueIndex);
+  }
+  index += _count_values(from, at);
+  IN(valueAt) = at;
+  IN(valueIndex) = index;
+
+  return (index < IN(blockValueCount) ? IN(blockValues)[index] : NAN);
+}
+
+char *replace_value_input(char *at, char *end, double value) {
+  uint32_t index = _count_values(IN(blockArena).data, at),
+           covered = _count_values(at, end);
+
+  if(!covered) {
+    if(!_reserve_values()) return end;
+    memmove(&IN(blockValues)[index + 1], &IN(blockValues)[index],
+            (IN(blockValueCount) - index) * sizeof(double));
+    IN(blockValueCount)++;
+  } else if(covered > 1) {
+    memmove(&IN(blockValues)[index + 1], &IN(blockValues)[index + covered],
+            (IN(blockValueCount) - index - covered) * sizeof(double));
+    IN(blockValueCount) -= covered - 1;
+  }
+  IN(blockValues)[index] = value;
+  IN(valueAt) = NULL;
+
+  *at = GCODE_INPUT_VALUE;
+  memmove(&at[1], end, &IN(blockArena).data[IN(blockArena).used] - end + 1);
+  IN(blockArena).used -= end - at - 1;
+
+  return &at[1];
+}
+
+void cache_line_input(const TGCodeBlockView *block, const TGCodeWord *words,
+                      size_t count) {
+  TGCodeBlockCacheEntry *entry;
+
+  if(!IN(pendingText) || block->text != IN(pendingText)) return;
+  IN(pendingText) = NULL;
+  /* Same rule as for compiled programs, so blocks read back the same */
+  if(!paired_gcode_words(words, count) ||
+     IN(cacheWordsUsed) + count > GCODE_INPUT_CACHE_WORDS) return;
+
+  if(!IN(blockCacheSlots)) {
+    IN(blockCache) = (TGCodeBlockCacheEntry *)malloc(
+        GCODE_INPUT_CACHE_SLOTS * sizeof(TGCodeBlockCacheEntry));
+    if(!IN(blockCache)) return;
+    IN(blockCacheSlots) = GCODE_INPUT_CACHE_SLOTS;
+    for(IN(blockCacheUsed) = 0; IN(blockCacheUsed) < IN(blockCacheSlots);
+        IN(blockCacheUsed)++)
+      IN(blockCache)[IN(blockCacheUsed)].offset = -1;
+    IN(blockCacheUsed) = 0;
+  }
+  /* Keep the load factor under 1/2 so that probe sequences stay short */
+  if(2 * (IN(blockCacheUsed) + 1) > IN(blockCacheSlots)) {
+    TGCodeBlockCacheEntry *old = IN(blockCache);
+    uint32_t i, oldSlots = IN(blockCacheSlots);
+
+    IN(blockCache) = (TGCodeBlockCacheEntry *)malloc(
+        2 * oldSlots * sizeof(TGCodeBlockCacheEntry));
+    if(!IN(blockCache)) {
+      IN(blockCache) = old;
+      return;
+    }
+    IN(blockCacheSlots) = 2 * oldSlots;
+    for(i = 0; i < IN(blockCacheSlots); i++) IN(blockCache)[i].offset = -1;
+    for(i = 0; i < oldSlots; i++)
+      if(old[i].offset != -1) *_probe_cache_input(old[i].offset) = old[i];
+    free(old);
+  }
+  if(IN(cacheWordsUsed) + count > IN(cacheWordsRoom)) {
+    size_t room = (IN(cacheWordsRoom) ?
+                   IN(cacheWordsRoom) : GCODE_INPUT_CACHE_SLOTS);
+    TGCodeWord *grown;
+
+    while(IN(cacheWordsUsed) + count > room) room *= 2;
+    if(!(grown = (TGCodeWord *)realloc(IN(cacheWords),
+                                       room * sizeof(TGCodeWord)))) return;
+    IN(cacheWords) = grown;
+    IN(cacheWordsRoom) = room;
+  }
+
+  entry = _probe_cache_input(IN(pendingOffset));
+  if(entry->offset != -1) return;
+  memcpy(&IN(cacheWords)[IN(cacheWordsUsed)], words,
+         count * sizeof(TGCodeWord));
+  entry->offset = IN(pendingOffset);
+  entry->next = IN(pendingNext);
+  entry->at = IN(cacheWordsUsed);
+  entry->count = count;
+  IN(cacheWordsUsed) += count;
+  IN(blockCacheUsed)++;
+}
+
+/* Looks number up in index. Not seen yet: index forward from the horizon until
+ * we find it, then go back to where we were */
+static bool _scan_index_input(TGCodeInputIndex *index, uint32_t number,
+                              long *offset) {
+  long resume;
+  bool wasSpliced;
+
+  if(_find_index_input(index, number, offset)) return true;
+  if(IN(scanComplete)) return false;
+
+  GCODE_DEBUG("Scanning ahead of offset %ld for %c%u", IN(scanHorizon),
+              (index == &IN(programs) ? 'O' : 'N'), number);
+  /* The file, that is, even if we were called from spliced text */
+  wasSpliced = IN(spliced);
+  IN(spliced) = false;
+  /* The spool must still have what we come back to, see _refill_input() */
+  resume = IN(scanResume) = tell_input();
+  if(_seek_file_input(IN(scanHorizon)))
+    while(fetch_line_input(NULL))
+      if(_find_index_input(index, number, offset)) break;
+  IN(scanResume) = -1;
+  if(!_seek_file_input(resume))
+    _lose_input("PER: Unable to come back from scanning ahead!");
+  IN(spliced) = wasSpliced;
+
+  return !IN(inputLost) && _find_index_input(index, number, offset);
+}
+
+long get_program_input(uint32_t program) {
+  long offset;
+
+  if(_scan_index_input(&IN(programs), program, &offset)) return offset;
+  /* Otherwise already said why */
+  if(!IN(inputLost)) display_machine_message("PER: Call to undefined program!");
 
   return 0;
 }
 
+bool start_at_input(uint32_t number) {
+  if(!number) {
+    display_machine_message("PER: No such block to start at!");
+    return false;
+  }
+  IN(startNumber) = number;
+  /* Otherwise found once it is read, see _add_number_input() */
+  if(!_find_index_input(&IN(numbers), number,
+                        &IN(startOffset))) IN(startOffset) = -1;
+  GCODE_DEBUG("Fast-forwarding up to N%u at offset %ld", number,
+              IN(startOffset));
+  fast_forward_machine(true);
+
+  return true;
+}
+
 bool splice_input(const char *data) {
-  if(!spliced) {
-    splice = data;
-    spliced = true;
-    endOfSplice = false;
-    splicep = 0;
+  TGCodeSpliceFrame *frame;
+  size_t length = strlen(data);
 
-    return true;
-  } else return false;
+  if(!(frame = _push_splice_input())) return false;
+  /* Buffers stay with their frame, so after warming up nothing is allocated */
+  if(frame->size < length + 1) {
+    char *grown = (char *)realloc(frame->data, length + 1);
+
+    if(!grown) {
+      display_machine_message("IER: Out of memory for the splice buffer!");
+      IN(spliceDepth)--;
+      return false;
+    }
+    frame->data = grown;
+    frame->size = length + 1;
+  } else IN(splicesReused)++;
+  memcpy(frame->data, data, length + 1);
+  frame->length = length;
+  frame->at = 0;
+  frame->file = false;
+  IN(spliced) = true;
+  IN(endOfSplice) = false;
+
+  return true;
 }
 
 bool end_of_spliced_input(void) {
-  if(endOfSplice) {
-    endOfSplice = false;
+  if(IN(endOfSplice)) {
+    IN(endOfSplice) = false;
     return true;
   } else return false;
 }
 
+static bool _save_index_input(const TGCodeInputIndex *index, FILE *target) {
+  uint32_t i;
+
+  if(fwrite(&index->runUsed, sizeof(index->runUsed), 1, target) != 1 ||
+     fwrite(&index->used, sizeof(index->used), 1, target) != 1 ||
+     (index->runUsed && fwrite(index->run, sizeof(TGCodeInputIndexEntry),
+                               index->runUsed, target) != index->runUsed))
+    return false;
+  for(i = 0; i < index->slots; i++)
+    if(index->entries[i].offset != -1 &&
+       fwrite(&index->entries[i], sizeof(TGCodeInputIndexEntry), 1,
+              target) != 1) return false;
+
+  return true;
+}
+
+static bool _restore_index_input(TGCodeInputIndex *index, FILE *source) {
+  TGCodeInputIndexEntry entry;
+  uint32_t runUsed, used;
+  uint64_t i;
+
+  if(fread(&runUsed, sizeof(runUsed), 1, source) != 1 ||
+     fread(&used, sizeof(used), 1, source) != 1) return false;
+  /* Sorted run first, so it comes out the same */
+  for(i = 0; i < (uint64_t)runUsed + used; i++)
+    if(fread(&entry, sizeof(entry), 1, source) != 1 ||
+       !_add_index_input(index, entry.number, entry.offset)) return false;
+
+  return true;
+}
+
+/* CRC-32 of the file from its own descriptor, leaving the stream alone */
+static bool _crc_file_input(TGCodeInputIdentity *identity) {
+  struct stat inputStat;
+  unsigned char *buffer;
+  ssize_t length;
+  off_t offset = 0;
+
+  if(fstat(fileno(IN(input)), &inputStat) || !S_ISREG(inputStat.st_mode))
+    return true;
+  if(!(buffer = (unsigned char *)malloc(GCODE_INPUT_SPOOL_CHUNK))) return false;
+  identity->crc = crc32(0L, Z_NULL, 0);
+  while((length = pread(fileno(IN(input)), buffer, GCODE_INPUT_SPOOL_CHUNK,
+                        offset)) > 0) {
+    identity->crc = crc32(identity->crc, buffer, length);
+    offset += length;
+  }
+  identity->size = offset;
+  free(buffer);
+
+  return !length;
+}
+
+bool identify_input(TGCodeInputIdentity *identity) {
+  size_t at, length;
+  bool result = true;
+
+  if(!IN(inputIdentified)) {
+    memset(&IN(inputIdentity), 0x00, sizeof(IN(inputIdentity)));
+    if(IN(inputMap)) {
+      /* crc32() only takes so much at a time */
+      IN(inputIdentity).crc = crc32(0L, Z_NULL, 0);
+      for(at = 0; at < IN(inputMapSize); at += length) {
+        length = (IN(inputMapSize) - at > GCODE_INPUT_SPOOL_CHUNK ?
+                  GCODE_INPUT_SPOOL_CHUNK : IN(inputMapSize) - at);
+        IN(inputIdentity).crc = crc32(IN(inputIdentity).crc,
+                                      (const Bytef *)IN(inputMap) + at, length);
+      }
+      IN(inputIdentity).size = IN(inputMapSize);
+    } else if(IN(input)) result = _crc_file_input(&IN(inputIdentity));
+    IN(inputIdentified) = result;
+    GCODE_DEBUG("Input is %llu bytes, CRC-32 %08x",
+                (unsigned long long)IN(inputIdentity).size,
+                IN(inputIdentity).crc);
+  }
+  *identity = IN(inputIdentity);
+
+  return result;
+}
+
+bool save_input(FILE *target) {
+  long offset = tell_input();
+  uint8_t complete = IN(scanComplete);
+
+  if(IN(spliceDepth) || (IN(inputCompiled) &&
+                         IN(compiledTextEnd))) return false;
+
+  return fwrite(&offset, sizeof(offset), 1, target) == 1 &&
+         fwrite(&IN(scanHorizon), sizeof(IN(scanHorizon)), 1, target) == 1 &&
+         fwrite(&complete, sizeof(complete), 1, target) == 1 &&
+         _save_index_input(&IN(programs), target) &&
+         _save_index_input(&IN(numbers), target);
+}
+
+bool restore_input(FILE *source) {
+  long offset, horizon;
+  uint8_t complete;
+
+  if(fread(&offset, sizeof(offset), 1, source) != 1 ||
+     fread(&horizon, sizeof(horizon), 1, source) != 1 ||
+     fread(&complete, sizeof(complete), 1, source) != 1 ||
+     !_restore_index_input(&IN(programs), source) ||
+     !_restore_index_input(&IN(numbers), source) || offset < 0 ||
+     !_seek_file_input(offset)) return false;
+  /* Whatever lies before it was indexed on the way there */
+  if(horizon > IN(scanHorizon)) IN(scanHorizon) = horizon;
+  IN(scanComplete) |= complete;
+  GCODE_DEBUG("Input resumed at offset %ld, indexed up to %ld", offset,
+              IN(scanHorizon));
+
+  return true;
+}
+
 bool done_input(void) {
-  if(input) {
-    return fclose(input) ? false : true;
+  if(IN(startNumber)) {
+    fast_forward_machine(false);
+    display_machine_message("PER: Program ended before the block to start at!");
+  }
+  GCODE_DEBUG("Program table: %u programs in %u slots, %llu lookups at %.2f probes average, %u longest",
+              IN(programs).used, IN(programs).slots,
+              (unsigned long long)IN(programs).lookups,
+              (IN(programs).lookups ?
+               (double)IN(programs).probes / IN(programs).lookups : 0.0),
+              IN(programs).longestProbe);
+  GCODE_DEBUG("Line number table: %u numbers in order, %llu searches, %u others in %u slots, %llu lookups at %.2f probes average",
+              IN(numbers).runUsed, (unsigned long long)IN(numbers).searches,
+              IN(numbers).used, IN(numbers).slots,
+              (unsigned long long)IN(numbers).lookups,
+              (IN(numbers).lookups ?
+               (double)IN(numbers).probes / IN(numbers).lookups : 0.0));
+  _done_index_input(&IN(programs));
+  _done_index_input(&IN(numbers));
+  GCODE_DEBUG("Blocks: %llu viewed in place, %llu rewritten, %llu decoded, arena grew to %zd bytes",
+              (unsigned long long)IN(blocksViewed),
+              (unsigned long long)IN(blocksRewritten),
+              (unsigned long long)IN(blocksDecoded), IN(blockArena).size);
+  GCODE_DEBUG("Splices: %llu served from recycled buffers",
+              (unsigned long long)IN(splicesReused));
+  GCODE_DEBUG("Block cache: %u blocks in %zd words, %llu hits, %llu misses, %.1f%% hit rate",
+              IN(blockCacheUsed), IN(cacheWordsUsed),
+              (unsigned long long)IN(cacheHits),
+              (unsigned long long)IN(cacheMisses),
+              (IN(cacheHits) + IN(cacheMisses) ?
+               100.0 * IN(cacheHits) / (IN(cacheHits) + IN(cacheMisses)) :
+               0.0));
+  free(IN(blockCache));
+  free(IN(cacheWords));
+  free(IN(readSpans));
+  IN(blockCache) = NULL;
+  IN(cacheWords) = NULL;
+  IN(readSpans) = NULL;
+  IN(readSpanCount) = IN(readSpanRoom) = 0;
+  IN(blockCacheSlots) = IN(blockCacheUsed) = 0;
+  IN(cacheWordsUsed) = IN(cacheWordsRoom) = 0;
+  for(IN(spliceDepth) = 0; IN(spliceDepth) < GCODE_INPUT_SPLICE_DEPTH;
+      IN(spliceDepth)++)
+    free(IN(spliceFrames)[IN(spliceDepth)].data);
+  memset(IN(spliceFrames), 0x00, sizeof(IN(spliceFrames)));
+  IN(spliceDepth) = 0;
+  IN(spliced) = false;
+  free(IN(blockArena).data);
+  free(IN(wordArena).data);
+  free(IN(blockValues));
+  IN(blockArena).data = IN(wordArena).data = NULL;
+  IN(blockArena).size = IN(wordArena).size = 0;
+  IN(blockValues) = NULL;
+  IN(blockValueCount) = IN(blockValueRoom) = 0;
+  IN(valueAt) = NULL;
+
+  if(IN(readingAhead)) done_reader();
+  if(IN(inputCompressed)) {
+    GCODE_DEBUG("Compressed input: %u checkpoints", IN(checkpointCount));
+    inflateEnd(&IN(inflater));
+    free(IN(checkpoints));
+    IN(checkpoints) = NULL;
+  }
+
+  if(IN(input)) {
+    if(IN(inputMapped)) munmap(IN(inputMap), IN(inputMapSize));
+    else {
+      free(IN(inputBase));
+      if(IN(inputMap)) munmap(IN(inputMap), IN(inputMapSize));
+    }
+    return fclose(IN(input)) ? false : true;
   } else {
     display_machine_message("IER: No input to close, ignoring request!");
     return false;
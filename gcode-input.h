@@ -12,24 +12,206 @@
 #define GCODE_INPUT_H_
 
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <zlib.h>
 
 #include "gcode-commons.h"
 
 
 typedef struct {
-  long offset; /* "long" as per man fseek */
-  uint16_t program;
-} TGCodeProgramIndexEntry;
+  long offset; /* "long" as per man fseek, -1 marks an empty slot */
+  uint32_t number;
+} TGCodeInputIndexEntry;
 
+/* Where O or N words are, keyed by their number, in an open addressing hash
+ * table. N words are many and nearly always come in ascending order, an
+ * ordered index appends those to a sorted run and only hashes the others */
+typedef struct {
+  bool ordered;
+  TGCodeInputIndexEntry *run;
+  uint32_t runUsed, runRoom;
+  TGCodeInputIndexEntry *entries;
+  uint32_t slots, used;
+  uint64_t searches, lookups, probes; /* Of the run and the table */
+  uint32_t longestProbe;
+} TGCodeInputIndex;
+
+/* Tells programs apart, see identify_input() */
+typedef struct {
+  uint64_t size;
+  uint32_t crc; /* zlib's CRC-32 of the whole file */
+  uint32_t reserved;
+} TGCodeInputIdentity;
+
+/* One word of a decoded block: its letter ('#' and '=' included) and its
+ * argument, either a literal or a parameter number behind indirection levels
+ * of '#'. The argument is stored both as read_gcode_integer() and as
+ * read_gcode_real() would have read it, less the indirection */
+typedef struct {
+  char letter;
+  uint8_t indirection;
+  uint32_t integer;
+  double value;
+} TGCodeWord;
+
+/* See gcode-state.h */
+struct TGCodeWordTable;
+
+/* Stands in a rewritten block for the result of an expression, whose exact
+ * value is kept aside (see fetch_value_input()). The lexer eats every one in
+ * the input, so it never means anything else in block text */
+#define GCODE_INPUT_VALUE '['
+
+/* A sanitized block, not NUL terminated. text[length] is always readable and
+ * never a G-Code character, so number parsing may safely stop there.
+ * Blocks coming from a compiled program have no text, only words. Those of a
+ * compiled subprogram (see gcode-subprogram.h) come fully decoded as table */
+typedef struct {
+  const char *text;
+  size_t length;
+  const TGCodeWord *words;
+  size_t wordCount;
+  const struct TGCodeWordTable *table;
+} TGCodeBlockView;
+
+/* A decoded block kept for when the file is read there again */
+typedef struct {
+  long offset; /* Where its fetch started, -1 marks an empty slot */
+  long next; /* Where its fetch left off */
+  uint32_t at, count; /* Its words in the cache's word pool */
+} TGCodeBlockCacheEntry;
+
+/* Part of the file blocks were fetched from, one after the other */
+typedef struct {
+  long start, end;
+} TGCodeInputSpan;
+
+/* A point compressed input can be restarted from without inflating everything
+ * before it: a deflate block boundary and the window in effect there */
+typedef struct {
+  long offset; /* Decompressed, what tell_input() would say */
+  size_t in; /* Compressed, first byte of the block */
+  int bits; /* Unused bits of the byte before that one, if any */
+  unsigned int windowLength;
+  unsigned char window[32768];
+} TGCodeInputCheckpoint;
+
+/* One level of input splicing: either spliced text being read or the input
+ * file being read on behalf of spliced text that jumped there (e.g. M98) */
+typedef struct {
+  char *data; /* Kept from one splice to the next, grown as needed */
+  size_t size, length, at;
+  long resume; /* Where the file was when spliced text jumped into it */
+  bool file;
+} TGCodeSpliceFrame;
+
+/* Growable buffer for text that had to be rewritten, reused for every block */
+typedef struct {
+  char *data;
+  size_t size, used;
+} TGCodeInputArena;
+
+typedef struct {
+  FILE *input;
+  /* Input is always walked with a pointer: regular files are mapped in whole,
+   * anything else (pipes, terminals) is read into a bounded spool so that we
+   * can still seek back into what was already read */
+  char *inputBase;
+  const char *inputEnd, *inputp;
+  /* Stream offset of inputBase[0], only ever non-zero for a spool that had to
+   * drop its oldest data */
+  long inputOffset;
+  size_t spoolSize;
+  bool inputMapped, inputAtEOF, inputExhausted;
+  /* The whole mapping, a compiled program's blocks start past its header */
+  void *inputMap;
+  size_t inputMapSize;
+  bool inputCompiled;
+  /* End of the compiled text record being lexed, if any */
+  const char *compiledTextEnd;
+  /* Compressed input is inflated from the mapping into the spool */
+  bool inputCompressed, inflateRaw;
+  z_stream inflater;
+  long inflatedOffset;
+  TGCodeInputCheckpoint *checkpoints;
+  uint32_t checkpointCount, checkpointRoom;
+  /* Plain input may be spooled from a read-ahead thread instead */
+  bool readAheadWanted, readingAhead;
+  /* Everything before scanHorizon has been looked at for O and N words, a
+   * scan ahead of it comes back to scanResume (-1: not scanning) */
+  long scanHorizon, scanResume;
+  bool scanComplete;
+  /* Set once the input could not be taken where the program flow goes, there
+   * is no more input after that */
+  bool inputLost;
+  /* Where the blocks after O words start and, for compiled programs, where
+   * N words are */
+  TGCodeInputIndex programs, numbers;
+  /* N word being fast-forwarded to (0: none) and where it is, -1 until seen */
+  uint32_t startNumber;
+  long startOffset;
+  uint64_t blocksSkipped;
+  /* Rewritten blocks and comment/expression/number text respectively */
+  TGCodeInputArena blockArena, wordArena;
+  /* Exact results of the expressions in blockArena, in the order they stand
+   * in it, and the last one looked up */
+  double *blockValues;
+  uint32_t blockValueCount, blockValueRoom;
+  const char *valueAt;
+  uint32_t valueIndex;
+  uint64_t blocksViewed, blocksRewritten, blocksDecoded;
+  uint32_t viewMisses;
+  /* Splice frames, spliced is true while the top one is spliced text */
+  TGCodeSpliceFrame spliceFrames[GCODE_INPUT_SPLICE_DEPTH];
+  uint8_t spliceDepth;
+  bool spliced, endOfSplice;
+  uint64_t splicesReused;
+  /* Decoded blocks that were fetched again from the same place. Open
+   * addressing hash table keyed by file offset */
+  TGCodeBlockCacheEntry *blockCache;
+  uint32_t blockCacheSlots, blockCacheUsed;
+  TGCodeWord *cacheWords;
+  size_t cacheWordsUsed, cacheWordsRoom;
+  /* Where blocks were fetched from so far: sorted, disjoint spans plus the
+   * run since the last jump. Up to knownEnd the run is reading them again */
+  TGCodeInputSpan *readSpans;
+  uint32_t readSpanCount, readSpanRoom;
+  long runStart, runEnd, knownEnd;
+  /* Set while lexing if the block has side effects or depends on run time
+   * state, in which case it is never cached */
+  bool lineVolatile;
+  /* The block just fetched, if cache_line_input() may take it */
+  const char *pendingText;
+  long pendingOffset, pendingNext;
+  uint64_t cacheHits, cacheMisses;
+  /* Worked out the first time it is asked for */
+  TGCodeInputIdentity inputIdentity;
+  bool inputIdentified;
+} TGCodeInputContext;
 
-/* Gets the input ready to stream data in, takes opaque pointer to data store */
+/* Gets the input ready to stream data in, takes opaque pointer to data store.
+ * Regular files are memory-mapped and walked with a pointer, anything else
+ * (pipes, terminals) is read into a spool of at most GCODE_INPUT_SPOOL_SIZE
+ * bytes which can be seeked back into for as long as it holds the data.
+ * Compiled programs (see gcode-compiler.h) are recognized and run from the
+ * mapping without lexing. Gzip compressed files are inflated into the spool,
+ * seeking out of it restarts from the nearest checkpoint. */
 bool init_input(void *data);
+/* Have plain text input (neither compiled nor compressed) read by a thread
+ * ahead of the lexer instead of mapped, see gcode-reader.h. Call before
+ * init_input() */
+void enable_read_ahead_input(void);
 /* Reset input, rewinding it to the top. Next character fetched will be first
- * character of program */
+ * character of program. Returns false, quietly, if the top was dropped from
+ * the spool of a pipe */
 bool rewind_input(void);
 /* Seek input to offset. Next character fetched will be the one at
- * offset. Note that offset has no relation to N word */
+ * offset. Note that offset has no relation to N word. Returns false, after
+ * saying so and ending the input, if offset can't be gotten to (e.g. it was
+ * dropped from the spool of a pipe) */
 bool seek_input(long offset);
 /* Return current position of input as an opaque offset usable for
  * seek_input() later on */
@@ -38,21 +220,61 @@ long tell_input(void);
 char fetch_char_input(void);
 /* Fetch a complete line of input, stripped of whitespace, comments and \n;
  * returns false if there's no more input to read.
+ * Lines already in sanitized form are handed out as views straight into the
+ * mapped input, anything else is rewritten into an arena without length limit.
+ * Either way block stays valid until the next call.
  * Call with NULL if you don't care about the line's program contents and only
  * want to detect syntax errors.
- * line[] is assumed to be at most 256 characters long. */
-bool fetch_line_input(char *line);
-/* Where does O<n> start? */
-long get_program_input(uint16_t program);
+ * Blocks read again from the same place in the file (loops, subprograms) are
+ * handed out pre-decoded once cache_line_input() got to see them. */
+bool fetch_line_input(TGCodeBlockView *block);
+/* Value of the expression result (GCODE_INPUT_VALUE) at at, in the text of the
+ * block fetched last. NAN if there is none there */
+double fetch_value_input(const char *at);
+/* Replaces the text of the block fetched last from at up to end with a single
+ * GCODE_INPUT_VALUE standing for value, which also takes the place of those in
+ * between. The rest of the block moves down, the text after it is returned */
+char *replace_value_input(char *at, char *end, double value);
+/* Offers the words block was decoded into, once they passed checking. Kept
+ * if block was just fetched again from a place in the file that was read
+ * before and means the same every time (no expressions, messages and such).
+ * Parameter references stay what they are and get looked up at run time */
+void cache_line_input(const TGCodeBlockView *block, const TGCodeWord *words,
+                      size_t count);
+/* Where does O<n> start? Programs are indexed as the input is read; asking
+ * for one that wasn't seen yet scans forward for it without moving the input.
+ * Returns 0, never a program start, if there is no such program */
+long get_program_input(uint32_t program);
+/* Runs the program fast-forward (see fast_forward_machine()) from here up to
+ * the first block numbered N<number>, which runs normally and so does the rest.
+ * That block is found as the program reads on, without scanning for it first:
+ * if there is none, the whole program is fast-forwarded and done_input()
+ * complains. Runs of plain straight moves are read in one go and fed to the
+ * interpreter as a single block meanwhile, when that ends up the same (see
+ * collapsible_gcode_state()). Returns false, without fast-forwarding, if
+ * number is 0 */
+bool start_at_input(uint32_t number);
 /* Splices data into the input stream. After the call, fetch_char_input() will
- * operate on data instead of the input file (which remains otherwise open and
- * unaffected). When '\0' is read from data, input is switched back to the
- * input file and data is free()d.
- * Calling subprograms from spliced code results in undefined behavior.
- * Returns true if successful, false if already spliced. */
+ * operate on a copy of data instead of the input file (which remains otherwise
+ * open and unaffected). When the end of data is read, input is switched back to
+ * wherever it was before.
+ * Splices nest up to GCODE_INPUT_SPLICE_DEPTH deep. Spliced code may call
+ * subprograms: tell_input() gives a (negative) position inside the splice that
+ * seek_input() later returns to. Returns false if nested too deep. */
 bool splice_input(const char *data);
 /* Returns true exactly once if the end of the input splice was reached */
 bool end_of_spliced_input(void);
+/* Fills in identity with the size and CRC-32 of the file being read, as it
+ * is on disk (compiled or compressed, that is). Input that is not a regular
+ * file, e.g. a pipe, has an all zero identity. Returns false on read error */
+bool identify_input(TGCodeInputIdentity *identity);
+/* Writes where the input is and what was indexed so far to target, for
+ * gcode-checkpoint. Returns false if the input can't be resumed from where it
+ * is, i.e. in the middle of spliced text or of a compiled text record */
+bool save_input(FILE *target);
+/* Reads what save_input() wrote from source and seeks there, returns false if
+ * it can't */
+bool restore_input(FILE *source);
 bool done_input(void);
 
 
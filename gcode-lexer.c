@@ -0,0 +1,295 @@
+/*
+ ============================================================================
+ Name        : gcode-lexer.c
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Vectorized G-Code Line Sanitizer Code
+ ============================================================================
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# define GCODE_LEXER_X86
+# include <immintrin.h>
+#endif
+
+#include "gcode-commons.h"
+#include "gcode-lexer.h"
+#include "gcode-debugcon.h"
+
+
+typedef size_t (*TGCodeLexerRun)(const char *src, size_t length, char *dst,
+    size_t room, size_t *written);
+typedef size_t (*TGCodeLexerClean)(const char *src, size_t length);
+
+static TGCodeLexerKind lexerKind;
+static TGCodeLexerRun lexerRun;
+static TGCodeLexerClean lexerClean;
+
+
+/* What ends a run: end of line, comment, expression, program separator, EOF */
+static inline bool _is_special(char c) {
+  return c == '\n' || c == '\r' || c == '(' || c == '[' || c == '%' ||
+         c == (char)EOF;
+}
+
+/* True for anything the sanitizer would have to drop, rewrite or look at */
+static inline bool _is_dirty(char c) {
+  return _is_special(c) || c == ' ' || c == '\t' || (c >= 'a' && c <= 'z');
+}
+
+/* One character at a time, the same job as the vectorized ones below */
+static size_t _run_scalar(const char *src, size_t length, char *dst,
+    size_t room, size_t *written) {
+  size_t r, w = 0;
+  char c;
+
+  for(r = 0; r < length && w < room; r++) {
+    c = src[r];
+    if(c == ' ' || c == '\t') continue;
+    if(_is_special(c)) break;
+    if(dst) dst[w] = (c >= 'a' && c <= 'z' ? c - 0x20 : c);
+    w++;
+  }
+  *written = w;
+
+  return r;
+}
+
+static size_t _clean_scalar(const char *src, size_t length) {
+  size_t r = 0;
+
+  while(r < length && !_is_dirty(src[r])) r++;
+
+  return r;
+}
+
+#ifdef GCODE_LEXER_X86
+/* Copies the characters of block[0..limit) that are not blanks to dst,
+ * returns how many there were */
+static size_t _compact_block(const char *block, uint32_t blanks, size_t limit,
+    char *dst) {
+  uint32_t keep = ~blanks & (limit < 32 ? (1U << limit) - 1 : UINT32_MAX);
+  size_t w = 0;
+
+  while(keep) {
+    if(dst) dst[w] = block[__builtin_ctz(keep)];
+    w++;
+    keep &= keep - 1;
+  }
+
+  return w;
+}
+
+__attribute__((target("sse2")))
+static size_t _run_sse2(const char *src, size_t length, char *dst,
+    size_t room, size_t *written) {
+  const __m128i nl = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r'),
+      comment = _mm_set1_epi8('('), expression = _mm_set1_epi8('['),
+      separator = _mm_set1_epi8('%'), eof = _mm_set1_epi8((char)EOF),
+      space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'),
+      beforeA = _mm_set1_epi8('a' - 1), afterZ = _mm_set1_epi8('z' + 1),
+      caseBit = _mm_set1_epi8(0x20);
+  size_t r = 0, w = 0, limit;
+  uint32_t special, blanks;
+  char block[16];
+
+  while(r + 16 <= length && w + 16 <= room) {
+    __m128i v = _mm_loadu_si128((const __m128i *)&src[r]);
+
+    special = _mm_movemask_epi8(_mm_or_si128(
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, cr)),
+                     _mm_or_si128(_mm_cmpeq_epi8(v, comment),
+                                  _mm_cmpeq_epi8(v, expression))),
+        _mm_or_si128(_mm_cmpeq_epi8(v, separator), _mm_cmpeq_epi8(v, eof))));
+    blanks = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, space),
+                                            _mm_cmpeq_epi8(v, tab)));
+    /* Signed compares keep anything above 0x7F out of the a-z range */
+    v = _mm_sub_epi8(v, _mm_and_si128(
+        _mm_and_si128(_mm_cmpgt_epi8(v, beforeA), _mm_cmplt_epi8(v, afterZ)),
+        caseBit));
+
+    limit = (special ? (size_t)__builtin_ctz(special) : 16);
+    blanks &= (limit < 16 ? (1U << limit) - 1 : 0xFFFFU);
+    if(!blanks) {
+      if(dst) _mm_storeu_si128((__m128i *)&dst[w], v);
+      w += limit;
+    } else {
+      _mm_storeu_si128((__m128i *)block, v);
+      w += _compact_block(block, blanks, limit, (dst ? &dst[w] : NULL));
+    }
+    r += limit;
+    if(special) break;
+  }
+
+  *written = w;
+
+  return r;
+}
+
+__attribute__((target("sse2")))
+static size_t _clean_sse2(const char *src, size_t length) {
+  const __m128i nl = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r'),
+      comment = _mm_set1_epi8('('), expression = _mm_set1_epi8('['),
+      separator = _mm_set1_epi8('%'), eof = _mm_set1_epi8((char)EOF),
+      space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'),
+      beforeA = _mm_set1_epi8('a' - 1), afterZ = _mm_set1_epi8('z' + 1);
+  size_t r = 0;
+  uint32_t dirty;
+
+  while(r + 16 <= length) {
+    __m128i v = _mm_loadu_si128((const __m128i *)&src[r]);
+
+    dirty = _mm_movemask_epi8(_mm_or_si128(
+        _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, cr)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, comment),
+                         _mm_cmpeq_epi8(v, expression))),
+        _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, separator), _mm_cmpeq_epi8(v, eof)),
+            _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+                _mm_and_si128(_mm_cmpgt_epi8(v, beforeA),
+                              _mm_cmplt_epi8(v, afterZ))))));
+    if(dirty) return r + __builtin_ctz(dirty);
+    r += 16;
+  }
+
+  return r + _clean_scalar(&src[r], length - r);
+}
+
+__attribute__((target("avx2")))
+static size_t _run_avx2(const char *src, size_t length, char *dst,
+    size_t room, size_t *written) {
+  const __m256i nl = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r'),
+      comment = _mm256_set1_epi8('('), expression = _mm256_set1_epi8('['),
+      separator = _mm256_set1_epi8('%'), eof = _mm256_set1_epi8((char)EOF),
+      space = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t'),
+      beforeA = _mm256_set1_epi8('a' - 1), afterZ = _mm256_set1_epi8('z' + 1),
+      caseBit = _mm256_set1_epi8(0x20);
+  size_t r = 0, w = 0, limit;
+  uint32_t special, blanks;
+  char block[32];
+
+  while(r + 32 <= length && w + 32 <= room) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)&src[r]);
+
+    special = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, nl),
+                                        _mm256_cmpeq_epi8(v, cr)),
+                        _mm256_or_si256(_mm256_cmpeq_epi8(v, comment),
+                                        _mm256_cmpeq_epi8(v, expression))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, separator),
+                        _mm256_cmpeq_epi8(v, eof))));
+    blanks = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab)));
+    v = _mm256_sub_epi8(v, _mm256_and_si256(
+        _mm256_and_si256(_mm256_cmpgt_epi8(v, beforeA),
+                         _mm256_cmpgt_epi8(afterZ, v)),
+        caseBit));
+
+    limit = (special ? (size_t)__builtin_ctz(special) : 32);
+    blanks &= (limit < 32 ? (1U << limit) - 1 : UINT32_MAX);
+    if(!blanks) {
+      if(dst) _mm256_storeu_si256((__m256i *)&dst[w], v);
+      w += limit;
+    } else {
+      _mm256_storeu_si256((__m256i *)block, v);
+      w += _compact_block(block, blanks, limit, (dst ? &dst[w] : NULL));
+    }
+    r += limit;
+    if(special) break;
+  }
+
+  *written = w;
+
+  return r;
+}
+
+__attribute__((target("avx2")))
+static size_t _clean_avx2(const char *src, size_t length) {
+  const __m256i nl = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r'),
+      comment = _mm256_set1_epi8('('), expression = _mm256_set1_epi8('['),
+      separator = _mm256_set1_epi8('%'), eof = _mm256_set1_epi8((char)EOF),
+      space = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t'),
+      beforeA = _mm256_set1_epi8('a' - 1), afterZ = _mm256_set1_epi8('z' + 1);
+  size_t r = 0;
+  uint32_t dirty;
+
+  while(r + 32 <= length) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)&src[r]);
+
+    dirty = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, nl), _mm256_cmpeq_epi8(v, cr)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, comment),
+                            _mm256_cmpeq_epi8(v, expression))),
+        _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, separator),
+                            _mm256_cmpeq_epi8(v, eof)),
+            _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+                                _mm256_cmpeq_epi8(v, tab)),
+                _mm256_and_si256(_mm256_cmpgt_epi8(v, beforeA),
+                                 _mm256_cmpgt_epi8(afterZ, v))))));
+    if(dirty) return r + __builtin_ctz(dirty);
+    r += 32;
+  }
+
+  return r + _clean_scalar(&src[r], length - r);
+}
+#endif
+
+bool init_lexer(void *data) {
+  select_lexer(GCODE_LEXER_AVX2);
+
+  GCODE_DEBUG("Line sanitizer up, using the %s implementation",
+              describe_lexer(lexerKind));
+
+  return true;
+}
+
+TGCodeLexerKind select_lexer(TGCodeLexerKind kind) {
+  lexerKind = GCODE_LEXER_SCALAR;
+  lexerRun = _run_scalar;
+  lexerClean = _clean_scalar;
+#ifdef GCODE_LEXER_X86
+  __builtin_cpu_init();
+  if(kind == GCODE_LEXER_AVX2 && __builtin_cpu_supports("avx2")) {
+    lexerKind = GCODE_LEXER_AVX2;
+    lexerRun = _run_avx2;
+    lexerClean = _clean_avx2;
+  } else if(kind != GCODE_LEXER_SCALAR && __builtin_cpu_supports("sse2")) {
+    lexerKind = GCODE_LEXER_SSE2;
+    lexerRun = _run_sse2;
+    lexerClean = _clean_sse2;
+  }
+#endif
+
+  return lexerKind;
+}
+
+const char *describe_lexer(TGCodeLexerKind kind) {
+  switch(kind) {
+    case GCODE_LEXER_AVX2:
+      return "AVX2";
+    case GCODE_LEXER_SSE2:
+      return "SSE2";
+    default:
+      return "scalar";
+  }
+}
+
+size_t sanitize_run_lexer(const char *src, size_t length, char *dst,
+    size_t room, size_t *written) {
+  return lexerRun(src, length, dst, room, written);
+}
+
+size_t clean_run_lexer(const char *src, size_t length) {
+  return lexerClean(src, length);
+}
@@ -0,0 +1,50 @@
+/*
+ ============================================================================
+ Name        : gcode-lexer.h
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Vectorized G-Code Line Sanitizer API Header
+ ============================================================================
+ */
+
+#ifndef GCODE_LEXER_H_
+#define GCODE_LEXER_H_
+
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+typedef enum {
+  GCODE_LEXER_SCALAR,
+  GCODE_LEXER_SSE2,
+  GCODE_LEXER_AVX2
+} TGCodeLexerKind;
+
+
+/* Picks the widest implementation the CPU supports */
+bool init_lexer(void *data);
+/* Forces a given implementation (e.g. for benchmarking), falling back to the
+ * next narrower one if the CPU can't do it. Returns what was selected */
+TGCodeLexerKind select_lexer(TGCodeLexerKind kind);
+/* Human readable name of an implementation */
+const char *describe_lexer(TGCodeLexerKind kind);
+/* Sanitizes the plain text at the start of src[0..length) in bulk: upper-cases
+ * it and strips blanks into dst, stopping before the first character that
+ * needs gcode-input's attention (end of line, comment, expression, program
+ * separator or EOF) or when dst would run out of room. dst may be NULL if
+ * only the count is of interest. Returns how many characters of src were
+ * consumed and stores how many were written in *written.
+ * Only ever called in the middle of a block, which is why N, O and / are not
+ * special here. */
+size_t sanitize_run_lexer(const char *src, size_t length, char *dst,
+    size_t room, size_t *written);
+/* Returns how many characters at the start of src[0..length) are already in
+ * sanitized form, i.e. would come out of the sanitizer unchanged. Stops at the
+ * end of the line and at anything that would be dropped or rewritten (blanks,
+ * lower case, comments, expressions, program separators, EOF). */
+size_t clean_run_lexer(const char *src, size_t length);
+
+
+#endif /* GCODE_LEXER_H_ */
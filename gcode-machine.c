@@ -11,6 +11,7 @@
 #include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "gcode-commons.h"
 #include "gcode-machine.h"
@@ -19,13 +20,11 @@
 #include "gcode-tools.h"
 #include "gcode-queue.h"
 #include "gcode-math.h"
+#include "gcode-context.h"
 
 
-static double noMirrorX, noMirrorY;
-static TGCodeOffsetSpec old, current, beforeHome;
-static uint32_t spindleSpeed;
-static TGCodeMachineState currentMachineState;
-static bool stillRunning, servoPower;
+/* State lives in the calling thread's context, see gcode-context.h */
+#define MCH(x) (gcodeContext->machineContext.x)
 
 
 double _adjust_feed(TGCodeFeedMode mode, double F, double toGo) {
@@ -36,7 +35,7 @@ double _adjust_feed(TGCodeFeedMode mode, double F, double toGo) {
       break;
     case GCODE_FEED_PERREVOLUTION:
       /* F mm per revolution, i.e. move at (S * F) mm/min */
-      F *= spindleSpeed;
+      F *= MCH(spindleSpeed);
       break;
     case GCODE_FEED_PERMINUTE:
       /* F mm/min, i.e. already in the right format */
@@ -48,21 +47,23 @@ double _adjust_feed(TGCodeFeedMode mode, double F, double toGo) {
 }
 
 bool init_machine(void *data) {
-  current.X = current.Y = current.Z = noMirrorX = noMirrorY = beforeHome.X =
-      beforeHome.Y = beforeHome.Z = old.X = old.Y = old.Z = 0.0;
-  currentMachineState.flags = 0x00;
+  MCH(current).X = MCH(current).Y = MCH(current).Z = MCH(noMirrorX) =
+      MCH(noMirrorY) = MCH(beforeHome).X = MCH(beforeHome).Y =
+      MCH(beforeHome).Z = MCH(old).X = MCH(old).Y = MCH(old).Z = 0.0;
+  MCH(currentMachineState).flags = 0x00;
   set_spindle_speed_machine(GCODE_MACHINE_LOWEST_RPM);
   enable_override_machine(GCODE_OVERRIDE_ON);
-  stillRunning = true;
+  MCH(stillRunning) = true;
+  MCH(fastForward) = MCH(dryRun) = false;
   enable_power_machine(GCODE_SERVO_ON);
   set_parameter(GCODE_PARM_CURRENT_PALLET, 1);
   /* By default our home and zero positions are at (0, 0, 0) */
-  set_parameter(GCODE_PARM_FIRST_HOME + GCODE_AXIS_X, current.X);
-  set_parameter(GCODE_PARM_FIRST_HOME + GCODE_AXIS_Y, current.Y);
-  set_parameter(GCODE_PARM_FIRST_HOME + GCODE_AXIS_Z, current.Z);
-  set_parameter(GCODE_PARM_FIRST_ZERO + GCODE_AXIS_X, current.X);
-  set_parameter(GCODE_PARM_FIRST_ZERO + GCODE_AXIS_Y, current.Y);
-  set_parameter(GCODE_PARM_FIRST_ZERO + GCODE_AXIS_Z, current.Z);
+  set_parameter(GCODE_PARM_FIRST_HOME + GCODE_AXIS_X, MCH(current).X);
+  set_parameter(GCODE_PARM_FIRST_HOME + GCODE_AXIS_Y, MCH(current).Y);
+  set_parameter(GCODE_PARM_FIRST_HOME + GCODE_AXIS_Z, MCH(current).Z);
+  set_parameter(GCODE_PARM_FIRST_ZERO + GCODE_AXIS_X, MCH(current).X);
+  set_parameter(GCODE_PARM_FIRST_ZERO + GCODE_AXIS_Y, MCH(current).Y);
+  set_parameter(GCODE_PARM_FIRST_ZERO + GCODE_AXIS_Z, MCH(current).Z);
 
   GCODE_DEBUG("Machine is up");
 
@@ -72,14 +73,23 @@ bool init_machine(void *data) {
 bool move_machine_queue(void) {
   TGCodeMoveSpec movec;
 
-  if(!queue_size() || !servoPower) return false;
+  if(!queue_size() || !MCH(servoPower)) return false;
   else {
     dequeue_move(&movec);
-    current.X = movec.target.X;
-    current.Y = movec.target.Y;
-    current.Z = movec.target.Z;
-
-    GCODE_MACHINE_POSITION(current);
+    MCH(current).X = movec.target.X;
+    MCH(current).Y = movec.target.Y;
+    MCH(current).Z = movec.target.Z;
+
+    if(MCH(dryRun)) {
+      MCH(dryRunReport).moves++;
+      if(movec.isArc) MCH(dryRunReport).arcs++;
+      MCH(dryRunReport).min.X = fmin(MCH(dryRunReport).min.X, MCH(current).X);
+      MCH(dryRunReport).min.Y = fmin(MCH(dryRunReport).min.Y, MCH(current).Y);
+      MCH(dryRunReport).min.Z = fmin(MCH(dryRunReport).min.Z, MCH(current).Z);
+      MCH(dryRunReport).max.X = fmax(MCH(dryRunReport).max.X, MCH(current).X);
+      MCH(dryRunReport).max.Y = fmax(MCH(dryRunReport).max.Y, MCH(current).Y);
+      MCH(dryRunReport).max.Z = fmax(MCH(dryRunReport).max.Z, MCH(current).Z);
+    } else GCODE_MACHINE_POSITION(MCH(current));
 
     return true;
   }
@@ -90,21 +100,23 @@ bool move_machine_line(double X, double Y, double Z, TGCodeFeedMode feedMode,
   TGCodeMoveSpec move;
 
   /* Check for and apply machine mirroring */
-  X = mirroring_math(X, current.X, &noMirrorX, currentMachineState.mirrorX);
-  Y = mirroring_math(Y, current.Y, &noMirrorY, currentMachineState.mirrorY);
+  X = mirroring_math(X, MCH(current).X, &MCH(noMirrorX),
+                     MCH(currentMachineState).mirrorX);
+  Y = mirroring_math(Y, MCH(current).Y, &MCH(noMirrorY),
+                     MCH(currentMachineState).mirrorY);
 
   move.isArc = false;
 
   move.target.X = X;
   move.target.Y = Y;
   move.target.Z = Z;
-  move.axesMoving.X = moving_axis_math(old.X, move.target.X);
-  move.axesMoving.Y = moving_axis_math(old.Y, move.target.Y);
-  move.axesMoving.Z = moving_axis_math(old.Z, move.target.Z);
-  old = move.target;
-  move.feedValue = _adjust_feed(feedMode, F, sqrt(pow(current.X - X, 2) +
-                                                  pow(current.Y - Y, 2) +
-                                                  pow(current.Z - Z, 2)));
+  move.axesMoving.X = moving_axis_math(MCH(old).X, move.target.X);
+  move.axesMoving.Y = moving_axis_math(MCH(old).Y, move.target.Y);
+  move.axesMoving.Z = moving_axis_math(MCH(old).Z, move.target.Z);
+  MCH(old) = move.target;
+  move.feedValue = _adjust_feed(feedMode, F, sqrt(pow(MCH(current).X - X, 2) +
+                                                  pow(MCH(current).Y - Y, 2) +
+                                                  pow(MCH(current).Z - Z, 2)));
   move.radComp = radComp;
   move.corner = corner;
   /* Fully initialize the struct, keeps bugs away ;-) */
@@ -135,38 +147,46 @@ bool move_machine_arc(double X, double Y, double Z, double I, double J,
 
   switch(plane) {
     case GCODE_PLANE_XY:
-      X = mirroring_math(X, current.X, &noMirrorX, currentMachineState.mirrorX);
-      Y = mirroring_math(Y, current.Y, &noMirrorY, currentMachineState.mirrorY);
-      if(currentMachineState.mirrorX ^ currentMachineState.mirrorY) ccw = !ccw;
-      arclen = arc_math(X, Y, old.X, old.Y, &R, &I, &J, &K, ccw ^ theLongWay);
-      if(Z != current.Z) arclen = hypot(arclen, current.Z - Z);
+      X = mirroring_math(X, MCH(current).X, &MCH(noMirrorX),
+                         MCH(currentMachineState).mirrorX);
+      Y = mirroring_math(Y, MCH(current).Y, &MCH(noMirrorY),
+                         MCH(currentMachineState).mirrorY);
+      if(MCH(currentMachineState).mirrorX ^ MCH(currentMachineState).mirrorY)
+        ccw = !ccw;
+      arclen = arc_math(X, Y, MCH(old).X, MCH(old).Y, &R, &I, &J, &K,
+                        ccw ^ theLongWay);
+      if(Z != MCH(current).Z) arclen = hypot(arclen, MCH(current).Z - Z);
       break;
     case GCODE_PLANE_ZX:
-      X = mirroring_math(X, current.X, &noMirrorX, currentMachineState.mirrorX);
-      if(currentMachineState.mirrorX) ccw = !ccw;
-      arclen = arc_math(Z, X, old.Z, old.X, &R, &K, &I, &J, ccw ^ theLongWay);
-      if(Y != current.Y) arclen = hypot(arclen, current.Y - Y);
+      X = mirroring_math(X, MCH(current).X, &MCH(noMirrorX),
+                         MCH(currentMachineState).mirrorX);
+      if(MCH(currentMachineState).mirrorX) ccw = !ccw;
+      arclen = arc_math(Z, X, MCH(old).Z, MCH(old).X, &R, &K, &I, &J,
+                        ccw ^ theLongWay);
+      if(Y != MCH(current).Y) arclen = hypot(arclen, MCH(current).Y - Y);
       break;
     case GCODE_PLANE_YZ:
-      Y = mirroring_math(Y, current.Y, &noMirrorY, currentMachineState.mirrorY);
-      if(currentMachineState.mirrorY) ccw = !ccw;
-      arclen = arc_math(Y, Z, old.Y, old.Z, &R, &J, &K, &I, ccw ^ theLongWay);
-      if(X != current.X) arclen = hypot(arclen, current.X - X);
+      Y = mirroring_math(Y, MCH(current).Y, &MCH(noMirrorY),
+                         MCH(currentMachineState).mirrorY);
+      if(MCH(currentMachineState).mirrorY) ccw = !ccw;
+      arclen = arc_math(Y, Z, MCH(old).Y, MCH(old).Z, &R, &J, &K, &I,
+                        ccw ^ theLongWay);
+      if(X != MCH(current).X) arclen = hypot(arclen, MCH(current).X - X);
       break;
   }
 
   move.isArc = true;
-  move.center.X = old.X + I;
-  move.center.Y = old.Y + J;
-  move.center.Z = old.Z + K;
+  move.center.X = MCH(old).X + I;
+  move.center.Y = MCH(old).Y + J;
+  move.center.Z = MCH(old).Z + K;
   move.ccw = ccw;
   move.target.X = X;
   move.target.Y = Y;
   move.target.Z = Z;
-  move.axesMoving.X = moving_axis_math(old.X, move.target.X);
-  move.axesMoving.Y = moving_axis_math(old.Y, move.target.Y);
-  move.axesMoving.Z = moving_axis_math(old.Z, move.target.Z);
-  old = move.target;
+  move.axesMoving.X = moving_axis_math(MCH(old).X, move.target.X);
+  move.axesMoving.Y = moving_axis_math(MCH(old).Y, move.target.Y);
+  move.axesMoving.Z = moving_axis_math(MCH(old).Z, move.target.Z);
+  MCH(old) = move.target;
   move.feedValue = _adjust_feed(feedMode, F, arclen);
   move.radComp = radComp;
   move.corner = corner;
@@ -183,26 +203,28 @@ bool move_machine_arc(double X, double Y, double Z, double I, double J,
 bool move_machine_home(TGCodeCycleMode mode, double X, double Y, double Z) {
   TGCodeCompSpec noComp;
 
-  if(!servoPower) return false;
+  if(!MCH(servoPower)) return false;
 
   switch(mode) {
     case GCODE_CYCLE_HOME:
       GCODE_DEBUG("Home and recalibrate cycle for axes: %s%s%s",
-                  (X == current.X) ? "" : "X", (Y == current.Y) ? "" : "Y",
-                  (Z == current.Z) ? "" : "Z");
-      beforeHome = current;
+                  (X == MCH(current).X) ? "" : "X",
+                  (Y == MCH(current).Y) ? "" : "Y",
+                  (Z == MCH(current).Z) ? "" : "Z");
+      MCH(beforeHome) = MCH(current);
       break;
     case GCODE_CYCLE_RETURN:
       GCODE_DEBUG("Return from reference point cycle for axes: %s%s%s",
-                  (X == current.X) ? "" : "X", (Y == current.Y) ? "" : "Y",
-                  (Z == current.Z) ? "" : "Z");
+                  (X == MCH(current).X) ? "" : "X",
+                  (Y == MCH(current).Y) ? "" : "Y",
+                  (Z == MCH(current).Z) ? "" : "Z");
       break;
     case GCODE_CYCLE_ZERO:
       GCODE_DEBUG("Go to zero cycle for axes: %s%s%s",
-                  (X == current.X) ? "" : "X",
-                  (Y == current.Y) ? "" : "Y",
-                  (Z == current.Z) ? "" : "Z");
-      beforeHome = current;
+                  (X == MCH(current).X) ? "" : "X",
+                  (Y == MCH(current).Y) ? "" : "Y",
+                  (Z == MCH(current).Z) ? "" : "Z");
+      MCH(beforeHome) = MCH(current);
       break;
     default:
       return false;
@@ -225,7 +247,7 @@ bool move_machine_home(TGCodeCycleMode mode, double X, double Y, double Z) {
                         GCODE_CORNER_CHAMFER);
       break;
     case GCODE_CYCLE_RETURN:
-      move_machine_line(beforeHome.X, beforeHome.Y, beforeHome.Z,
+      move_machine_line(MCH(beforeHome).X, MCH(beforeHome).Y, MCH(beforeHome).Z,
                         GCODE_FEED_PERMINUTE, GCODE_MACHINE_FEED_TRAVERSE,
                         noComp, GCODE_CORNER_CHAMFER);
       break;
@@ -244,7 +266,7 @@ bool move_machine_home(TGCodeCycleMode mode, double X, double Y, double Z) {
 }
 
 bool move_machine_aux(TGCodeAuxiliaryMachine mode, uint32_t P) {
-  if(!servoPower) return false;
+  if(!MCH(servoPower)) return false;
 
   switch(mode) {
     case GCODE_SPINDLE_ORIENTATION:
@@ -256,7 +278,7 @@ bool move_machine_aux(TGCodeAuxiliaryMachine mode, uint32_t P) {
       break;
     case GCODE_RETRACT_Z:
       //TODO: this is wrong, should be Zmax instead or thereabouts
-      current.Z = 0;
+      MCH(current).Z = 0;
       GCODE_DEBUG("Z-axis retracted/parked");
       break;
     case GCODE_APC_1:
@@ -277,40 +299,42 @@ bool move_machine_aux(TGCodeAuxiliaryMachine mode, uint32_t P) {
 }
 
 bool start_spindle_machine(TGCodeSpindleMode direction) {
-  if(!servoPower) return false;
+  if(!MCH(servoPower)) return false;
 
-  if((currentMachineState.spindleCW && direction == GCODE_SPINDLE_CW) ||
-      (currentMachineState.spindleCCW && direction == GCODE_SPINDLE_CCW))
+  if((MCH(currentMachineState).spindleCW && direction == GCODE_SPINDLE_CW) ||
+      (MCH(currentMachineState).spindleCCW && direction == GCODE_SPINDLE_CCW))
     return true;
   if(direction == GCODE_SPINDLE_STOP) {
-    currentMachineState.spindleCW = currentMachineState.spindleCCW = false;
+    MCH(currentMachineState).spindleCW =
+        MCH(currentMachineState).spindleCCW = false;
     GCODE_DEBUG("Spindle stopped");
-  } else if(!(currentMachineState.spindleCW ||
-      currentMachineState.spindleCCW)) {
-    if(direction == GCODE_SPINDLE_CW) currentMachineState.spindleCW = true;
-    else currentMachineState.spindleCCW = true;
+  } else if(!(MCH(currentMachineState).spindleCW ||
+      MCH(currentMachineState).spindleCCW)) {
+    if(direction == GCODE_SPINDLE_CW) MCH(currentMachineState).spindleCW = true;
+    else MCH(currentMachineState).spindleCCW = true;
+    if(MCH(dryRun)) MCH(dryRunReport).spindleStarts++;
     GCODE_DEBUG("Spindle started %s at %5drpm",
         (direction == GCODE_SPINDLE_CW) ? "clockwise" : "counterclockwise",
-        spindleSpeed);
+        MCH(spindleSpeed));
   } else return false; /* Won't switch direction while running */
 
   return true;
 }
 
 bool set_spindle_speed_machine(uint32_t speed) {
-  spindleSpeed = speed;
+  MCH(spindleSpeed) = speed;
 
-  if(currentMachineState.spindleCW || currentMachineState.spindleCCW)
-    GCODE_DEBUG("Spindle now rotating at %5drpm", spindleSpeed)
-  else GCODE_DEBUG("Spindle speed preset at %5drpm", spindleSpeed);
+  if(MCH(currentMachineState).spindleCW || MCH(currentMachineState).spindleCCW)
+    GCODE_DEBUG("Spindle now rotating at %5drpm", MCH(spindleSpeed))
+  else GCODE_DEBUG("Spindle speed preset at %5drpm", MCH(spindleSpeed));
 
   return true;
 }
 
 bool orient_spindle_machine(uint16_t orientation) {
-  if(!servoPower) return false;
+  if(!MCH(servoPower)) return false;
 
-  if(currentMachineState.spindleCW || currentMachineState.spindleCCW)
+  if(MCH(currentMachineState).spindleCW || MCH(currentMachineState).spindleCCW)
     GCODE_DEBUG("Spindle currently running, cannot orient!")
   else GCODE_DEBUG("Oriented spindle at %3ddeg", orientation);
 
@@ -318,7 +342,12 @@ bool orient_spindle_machine(uint16_t orientation) {
 }
 
 void display_machine_message(char *message) {
-  printf("MSG: %s\n", message);
+  if(MCH(dryRun)) {
+    if(!strncmp(message, "WAR:", 4)) MCH(dryRunReport).warnings++;
+    else if(!strncmp(message, "PER:", 4) || !strncmp(message, "IER:", 4) ||
+            !strncmp(message, "SER:", 4)) MCH(dryRunReport).errors++;
+  }
+  fprintf(GCODE_CONSOLE, "MSG: %s\n", message);
 }
 
 bool block_delete_machine(void) {
@@ -331,18 +360,18 @@ bool optional_stop_machine(void) {
 
 uint16_t override_feed_machine(uint16_t feed) {
   /* Simulate 90% setting */
-  if(currentMachineState.overridesEnabled) return feed * 0.90;
+  if(MCH(currentMachineState).overridesEnabled) return feed * 0.90;
   else return feed;
 }
 
 uint32_t override_speed_machine(uint32_t speed) {
   /* Simulate 90% setting */
-  if(currentMachineState.overridesEnabled) return speed * 0.90;
+  if(MCH(currentMachineState).overridesEnabled) return speed * 0.90;
   else return speed;
 }
 
 bool preselect_tool_machine(uint8_t tool) {
-  if(!servoPower) return false;
+  if(!MCH(servoPower)) return false;
 
   GCODE_DEBUG("Moving tool carousel to tool %d", tool);
 
@@ -350,8 +379,9 @@ bool preselect_tool_machine(uint8_t tool) {
 }
 
 bool change_tool_machine(uint8_t tool) {
-  if(!servoPower) return false;
+  if(!MCH(servoPower)) return false;
 
+  if(MCH(dryRun)) MCH(dryRunReport).toolChanges++;
   if(tool) {
     GCODE_DEBUG("Performing ATC to tool %d", tool)
     fetch_tool(tool);
@@ -363,8 +393,10 @@ bool change_tool_machine(uint8_t tool) {
 }
 
 bool start_coolant_machine(TGCodeCoolantMode mode) {
-  if(!servoPower) return false;
+  if(!MCH(servoPower)) return false;
 
+  if(MCH(dryRun) && mode != GCODE_COOL_OFF_MF && mode != GCODE_COOL_OFF_S)
+    MCH(dryRunReport).coolantChanges++;
   switch(mode) {
     case GCODE_COOL_MIST:
       GCODE_DEBUG("Activating mist coolant");
@@ -387,82 +419,94 @@ bool start_coolant_machine(TGCodeCoolantMode mode) {
 }
 
 bool enable_override_machine(TGCodeOverrideMode mode) {
-  currentMachineState.overridesEnabled = (mode == GCODE_OVERRIDE_ON);
+  MCH(currentMachineState).overridesEnabled = (mode == GCODE_OVERRIDE_ON);
   set_parameter(
       GCODE_PARM_BITFIELD1,
       ((uint8_t)fetch_parameter(GCODE_PARM_BITFIELD1) &
           ~GCODE_MACHINE_PF_OVERRIDES) |
-      (currentMachineState.overridesEnabled ? GCODE_MACHINE_PF_OVERRIDES : 0x00));
+      (MCH(currentMachineState).overridesEnabled ?
+          GCODE_MACHINE_PF_OVERRIDES : 0x00));
 
   GCODE_DEBUG("Feed and speed override switches %s",
-              (currentMachineState.overridesEnabled ? "enabled" : "disabled"));
+              (MCH(currentMachineState).overridesEnabled ?
+                  "enabled" : "disabled"));
 
   return true;
 }
 
 bool select_probeinput_machine(TGCodeProbeInput input) {
-  currentMachineState.probeSource = (input == GCODE_PROBE_TOOL);
+  MCH(currentMachineState).probeSource = (input == GCODE_PROBE_TOOL);
 
   GCODE_DEBUG("Probe signal source set to %s",
-              currentMachineState.probeSource ? "probe tool" : "tool height sensor");
+              MCH(currentMachineState).probeSource ?
+                  "probe tool" : "tool height sensor");
 
   return true;
 }
 
 bool select_probemode_machine(TGCodeProbeMode mode) {
-  currentMachineState.probeMode = (mode == GCODE_PROBE_TWOTOUCH);
+  MCH(currentMachineState).probeMode = (mode == GCODE_PROBE_TWOTOUCH);
 
   GCODE_DEBUG("Probing mode set to %s stroke",
-              currentMachineState.probeMode ? "single" : "double");
+              MCH(currentMachineState).probeMode ? "single" : "double");
 
   return true;
 }
 
 bool enable_mirror_machine(TGCodeMirrorMachine mode) {
-  if(mode == GCODE_MIRROR_X) currentMachineState.mirrorX = true;
-  else if(mode == GCODE_MIRROR_Y) currentMachineState.mirrorY = true;
+  if(mode == GCODE_MIRROR_X) MCH(currentMachineState).mirrorX = true;
+  else if(mode == GCODE_MIRROR_Y) MCH(currentMachineState).mirrorY = true;
   else {
-    currentMachineState.mirrorX = false;
-    currentMachineState.mirrorY = false;
+    MCH(currentMachineState).mirrorX = false;
+    MCH(currentMachineState).mirrorY = false;
   }
 
-  noMirrorX = current.X;
-  noMirrorY = current.Y;
+  MCH(noMirrorX) = MCH(current).X;
+  MCH(noMirrorY) = MCH(current).Y;
 
   set_parameter(
       GCODE_PARM_BITFIELD2,
       ((uint8_t)fetch_parameter(GCODE_PARM_BITFIELD2) &
           ~(GCODE_MACHINE_PF_MIRROR_X | GCODE_MACHINE_PF_MIRROR_Y)) |
-      (currentMachineState.mirrorX ? GCODE_MACHINE_PF_MIRROR_X : 0x00) |
-      (currentMachineState.mirrorY ? GCODE_MACHINE_PF_MIRROR_Y : 0x00));
+      (MCH(currentMachineState).mirrorX ? GCODE_MACHINE_PF_MIRROR_X : 0x00) |
+      (MCH(currentMachineState).mirrorY ? GCODE_MACHINE_PF_MIRROR_Y : 0x00));
 
   GCODE_DEBUG("Machine mirroring %s%s%s",
               (mode == GCODE_MIRROR_OFF_M) ? "disabled" : "enabled for axis(es): ",
-              currentMachineState.mirrorX ? "X" : "",
-              currentMachineState.mirrorY ? "Y" : "");
+              MCH(currentMachineState).mirrorX ? "X" : "",
+              MCH(currentMachineState).mirrorY ? "Y" : "");
   return true;
 }
 
 bool select_pathmode_machine(TGCodePathControl mode) {
-  currentMachineState.exactStopCheck = (mode == GCODE_EXACTSTOPCHECK_ON);
+  MCH(currentMachineState).exactStopCheck = (mode == GCODE_EXACTSTOPCHECK_ON);
   set_parameter(
       GCODE_PARM_BITFIELD1,
       ((uint8_t)fetch_parameter(GCODE_PARM_BITFIELD1) &
           ~GCODE_MACHINE_PF_EXACTSTOP) |
-      (currentMachineState.exactStopCheck ? GCODE_MACHINE_PF_EXACTSTOP : 0x00));
+      (MCH(currentMachineState).exactStopCheck ?
+          GCODE_MACHINE_PF_EXACTSTOP : 0x00));
 
   GCODE_DEBUG("Exact stop check (path control) %s",
-              currentMachineState.exactStopCheck ? "on" : "off");
+              MCH(currentMachineState).exactStopCheck ? "on" : "off");
 
   return true;
 }
 
 bool do_stop_machine(TGCodeStopMode mode) {
+  /* Whoever fast-forwards past a stop already went through it once */
+  if(MCH(fastForward)) return false;
+  if(MCH(dryRun)) {
+    /* Acknowledged on the spot, a dry run never waits for anyone */
+    if(mode == GCODE_STOP_OPTIONAL && !optional_stop_machine()) return false;
+    MCH(dryRunReport).stops++;
+    return true;
+  }
   switch(mode) {
     case GCODE_STOP_E:
       display_machine_message("STA: Machine in E-Stop");
       break;
-    case GCODE_STOP_COMPULSORY_AS_RETURNED: /* Returned as 100 by have_gcode_word() */
+    case GCODE_STOP_COMPULSORY:
       display_machine_message("STA: Machine in compulsory stop");
       break;
     case GCODE_STOP_OPTIONAL:
@@ -476,23 +520,39 @@ bool do_stop_machine(TGCodeStopMode mode) {
   GCODE_DEBUG("Machine stopped, send EOF to abort or newline to continue ...");
   if(fgetc(stdin) == EOF) {
     GCODE_DEBUG("User-requested abort, exiting ...")
-    stillRunning = false;
+    MCH(stillRunning) = false;
   }
   return true;
 }
 
 bool machine_running(void) {
-  return stillRunning;
+  return MCH(stillRunning);
+}
+
+void fast_forward_machine(bool enable) {
+  MCH(fastForward) = enable;
+  gcodeContext->quiet = gcodeQuiet = enable || MCH(dryRun);
+  if(!enable) {
+    GCODE_DEBUG("Fast-forward done, spindle at %u RPM", MCH(spindleSpeed));
+    GCODE_MACHINE_POSITION(MCH(current));
+  }
+}
+
+void dry_run_machine(bool enable) {
+  MCH(dryRun) = enable;
+  gcodeContext->quiet = gcodeQuiet = enable || MCH(fastForward);
+  memset(&MCH(dryRunReport), 0x00, sizeof(MCH(dryRunReport)));
+  MCH(dryRunReport).min = MCH(dryRunReport).max = MCH(current);
 }
 
 bool enable_power_machine(TGCodeStopMode mode) {
   switch(mode) {
     case GCODE_SERVO_ON:
-      servoPower = true;
+      MCH(servoPower) = true;
       display_machine_message("WAR: Machine servos activated!");
       break;
     case GCODE_SERVO_OFF:
-      servoPower = false;
+      MCH(servoPower) = false;
       display_machine_message("STA: Machine servos inactive");
       break;
     default:
@@ -503,6 +563,29 @@ bool enable_power_machine(TGCodeStopMode mode) {
 }
 
 bool done_machine(void) {
+  char message[0xFF];
+
+  if(MCH(dryRun)) {
+    snprintf(message, sizeof(message),
+             "STA: Dry run: %llu moves (%llu arcs), %llu stops, %llu tool changes, %llu spindle starts, %llu coolant starts",
+             (unsigned long long)MCH(dryRunReport).moves,
+             (unsigned long long)MCH(dryRunReport).arcs,
+             (unsigned long long)MCH(dryRunReport).stops,
+             (unsigned long long)MCH(dryRunReport).toolChanges,
+             (unsigned long long)MCH(dryRunReport).spindleStarts,
+             (unsigned long long)MCH(dryRunReport).coolantChanges);
+    display_machine_message(message);
+    snprintf(message, sizeof(message),
+             "STA: Dry run: X %.2f to %.2f, Y %.2f to %.2f, Z %.2f to %.2f",
+             MCH(dryRunReport).min.X, MCH(dryRunReport).max.X,
+             MCH(dryRunReport).min.Y, MCH(dryRunReport).max.Y,
+             MCH(dryRunReport).min.Z, MCH(dryRunReport).max.Z);
+    display_machine_message(message);
+    snprintf(message, sizeof(message), "STA: Dry run: %llu warnings, %llu errors",
+             (unsigned long long)MCH(dryRunReport).warnings,
+             (unsigned long long)MCH(dryRunReport).errors);
+    display_machine_message(message);
+  }
   GCODE_DEBUG("Machine shutdown");
 
   return true;
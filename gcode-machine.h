@@ -13,6 +13,7 @@
 
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "gcode-commons.h"
 #include "gcode-state.h"
@@ -47,6 +48,24 @@ typedef union {
   };
 } TGCodeMachineState;
 
+/* What a dry run counts instead of doing it */
+typedef struct {
+  uint64_t moves, arcs, stops, toolChanges, spindleStarts, coolantChanges;
+  uint64_t warnings, errors;
+  TGCodeOffsetSpec min, max; /* Extents of every position moved to */
+} TGCodeDryRunReport;
+
+typedef struct {
+  double noMirrorX, noMirrorY;
+  TGCodeOffsetSpec old, current, beforeHome;
+  uint32_t spindleSpeed;
+  TGCodeMachineState currentMachineState;
+  bool stillRunning, servoPower;
+  bool fastForward, dryRun;
+  TGCodeDryRunReport dryRunReport;
+} TGCodeMachineContext;
+
+
 bool init_machine(void *data);
 /* Examine the movement queue and perform the next scheduled move, if any, as
  * appropriate. Returns false if the movement queue was empty. */
@@ -114,6 +133,16 @@ bool do_stop_machine(TGCodeStopMode mode);
 /* Returns true if the machine is (or should still be) running, false if we
  * should abort */
 bool machine_running(void);
+/* While fast-forwarding the program runs as usual, state and position are kept
+ * up to date, but nothing moves: no output other than machine messages and no
+ * stopping. Leaving it reports where the machine should be by then */
+void fast_forward_machine(bool enable);
+/* A dry run computes every position and parameter as usual, but has no side
+ * effects: no debug output, no positions output, stops acknowledged on the
+ * spot and moves, stops, tool changes, spindle and coolant starts counted
+ * instead. Machine messages still go out and are counted too. done_machine()
+ * reports the counts and the extents of all positions moved to */
+void dry_run_machine(bool enable);
 /* Enables or disables power to the machine movement */
 bool enable_power_machine(TGCodeStopMode mode);
 bool done_machine(void);
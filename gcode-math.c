@@ -342,7 +342,7 @@ double _slope_math(double x1, double y1, double x2, double y2) {
 }
 
 double _constant_math(double slope, double x1, double y1) {
-  if isinf(slope)
+  if(isinf(slope))
     return x1;
   else
     return y1 - slope * x1;
@@ -16,38 +16,32 @@
 #include "gcode-parameters.h"
 #include "gcode-debugcon.h"
 #include "gcode-machine.h"
+#include "gcode-context.h"
 
 
-typedef struct {
-  uint16_t index;
-  double value;
-} TGCodePendingParameterUpdate;
-
-static FILE *parameterStore;
-static double parameters[GCODE_PARAMETER_COUNT] = {0.0};
-static TGCodePendingParameterUpdate parameterUpdates[GCODE_PARAMETER_UPDATES];
-static uint8_t parameterUpdateCount;
+/* State lives in the calling thread's context, see gcode-context.h */
+#define PAR(x) (gcodeContext->parametersContext.x)
 
 
 bool init_parameters(void *data) {
-  char *line = (char *)malloc(0xFF), *key;
+  char *line = (char *)malloc(0xFF), *key, *rest;
   int i;
 
-  parameterStore = (FILE *)data;
+  PAR(parameterStore) = (FILE *)data;
 
   /* binary 0x00 may not always result in float +0.0E+0, so do it by hand */
-  for(i = 0; i < GCODE_PARAMETER_COUNT; i++) parameters[i] = 0.0;
+  for(i = 0; i < GCODE_PARAMETER_COUNT; i++) PAR(parameters)[i] = 0.0;
   for(i = 0; i < GCODE_PARAMETER_UPDATES; i++) {
-    parameterUpdates[i].index = 0;
-    parameterUpdates[i].value = 0.0;
+    PAR(parameterUpdates)[i].index = 0;
+    PAR(parameterUpdates)[i].value = 0.0;
   }
 
-  if(parameterStore) {
-    rewind(parameterStore);
+  if(PAR(parameterStore)) {
+    rewind(PAR(parameterStore));
     i = 0;
-    while(fgets(line, 0xFF, parameterStore)) {
-      key = strtok(line, ","); // Force execution order
-      parameters[atoi(key)] = atof(strtok(NULL, ","));
+    while(fgets(line, 0xFF, PAR(parameterStore))) {
+      key = strtok_r(line, ",", &rest); // Force execution order
+      PAR(parameters)[atoi(key)] = atof(strtok_r(NULL, ",", &rest));
       i++;
     }
     GCODE_DEBUG("%d parameters restored from non-volatile storage, %d available",
@@ -56,25 +50,27 @@ bool init_parameters(void *data) {
   free(line);
 
   /* Now handle the special cases */
-  parameters[0] = +0.0E+0; /* #0 is always zero */
+  PAR(parameters)[0] = +0.0E+0; /* #0 is always zero */
   /* #3004,3007,5161-5169,5181-5189: will be set by init_machine() */
   /* #71,3005,4001-4018,5211-5219,5220: will be set by init_gcode_state() */
+  PAR(parameterWrites) = 0;
+  touch_parameters();
 
   return true;
 }
 
 double fetch_parameter(uint16_t index) {
-  return parameters[index];
+  return PAR(parameters)[index];
 }
 
 bool update_parameter(uint16_t index, double newValue) {
   // #0 is readonly and there's only 5400 of them
   if(!index || index > GCODE_PARAMETER_COUNT - 1) return false;
 
-  if(parameterUpdateCount < GCODE_PARAMETER_UPDATES) {
-    parameterUpdateCount++;
-    parameterUpdates[parameterUpdateCount - 1].index = index;
-    parameterUpdates[parameterUpdateCount - 1].value = newValue;
+  if(PAR(parameterUpdateCount) < GCODE_PARAMETER_UPDATES) {
+    PAR(parameterUpdateCount)++;
+    PAR(parameterUpdates)[PAR(parameterUpdateCount) - 1].index = index;
+    PAR(parameterUpdates)[PAR(parameterUpdateCount) - 1].value = newValue;
 
     return true;
   } else {
@@ -88,7 +84,8 @@ bool set_parameter(uint16_t index, double newValue) {
   // #0 is readonly and there's only 5400 of them
   if(!index || index > GCODE_PARAMETER_COUNT - 1) return false;
 
-  parameters[index] = newValue;
+  PAR(parameters)[index] = newValue;
+  PAR(parameterVersions)[index] = ++PAR(parameterWrites);
 
   return true;
 }
@@ -96,32 +93,53 @@ bool set_parameter(uint16_t index, double newValue) {
 bool commit_parameters(void){
   int i;
 
-  for(i = 0; i < parameterUpdateCount; i++) {
-    parameters[parameterUpdates[i].index] = parameterUpdates[i].value;
-    GCODE_DEBUG("#%d = %4.2f", parameterUpdates[i].index,
-                parameterUpdates[i].value);
+  for(i = 0; i < PAR(parameterUpdateCount); i++) {
+    PAR(parameters)[PAR(parameterUpdates)[i].index] =
+        PAR(parameterUpdates)[i].value;
+    PAR(parameterVersions)[PAR(parameterUpdates)[i].index] =
+        ++PAR(parameterWrites);
+    GCODE_DEBUG("#%d = %4.2f", PAR(parameterUpdates)[i].index,
+                PAR(parameterUpdates)[i].value);
   }
-  parameterUpdateCount = 0;
+  PAR(parameterUpdateCount) = 0;
 
   return true;
 }
 
+uint64_t fetch_parameters_version(void) {
+  return PAR(parameterWrites);
+}
+
+uint64_t fetch_parameter_version(uint16_t index) {
+  return PAR(parameterVersions)[index];
+}
+
+void touch_parameters(void) {
+  int i;
+
+  PAR(parameterWrites)++;
+  for(i = 0; i < GCODE_PARAMETER_COUNT; i++)
+    PAR(parameterVersions)[i] = PAR(parameterWrites);
+}
+
 bool done_parameters(void) {
   int i, j = 0;
 
-  parameterStore = freopen(GCODE_PARAMETER_STORE, "w", parameterStore);
+  PAR(parameterStore) = freopen(GCODE_PARAMETER_STORE, "w",
+                                PAR(parameterStore));
   for(i = 500; i < GCODE_PARAMETER_COUNT; i++)
     /* Our parameter store defaults to 0.0E+0 on initialization so we wouldn't
      * want to write a file full of zeros. Therefore we extend the standard's
      * convention for integer-float equivalence to the special case of 0.0E+0:
      * if the value stored in a parameter is closer than 0.0001 to 0.0E+0 then
      * we coerce it to 0.0E+0 and subsequently don't save it */
-    if(parameters[i] > GCODE_INTEGER_THRESHOLD ||
-       parameters[i] < -GCODE_INTEGER_THRESHOLD) {
-      fprintf(parameterStore, "%4d," GCODE_REAL_FORMAT "\n", i, parameters[i]);
+    if(PAR(parameters)[i] > GCODE_INTEGER_THRESHOLD ||
+       PAR(parameters)[i] < -GCODE_INTEGER_THRESHOLD) {
+      fprintf(PAR(parameterStore), "%4d," GCODE_REAL_FORMAT "\n", i,
+              PAR(parameters)[i]);
       j++;
     }
   GCODE_DEBUG("Saved %d non-null parameter values to non-volatile storage for shutdown", j);
 
-  return fclose(parameterStore) ? false : true;
+  return fclose(PAR(parameterStore)) ? false : true;
 }
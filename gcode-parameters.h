@@ -16,6 +16,23 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
+
+
+typedef struct {
+  uint16_t index;
+  double value;
+} TGCodePendingParameterUpdate;
+
+typedef struct {
+  FILE *parameterStore;
+  double parameters[GCODE_PARAMETER_COUNT];
+  TGCodePendingParameterUpdate parameterUpdates[GCODE_PARAMETER_UPDATES];
+  uint8_t parameterUpdateCount;
+  /* Writes so far and the one that last changed each parameter */
+  uint64_t parameterWrites;
+  uint64_t parameterVersions[GCODE_PARAMETER_COUNT];
+} TGCodeParameterContext;
 
 
 /* Initialize parameter store, takes anonymous pointer to opaque data store,
@@ -32,6 +49,15 @@ bool set_parameter(uint16_t index, double newValue);
 /* Commit all update_parameter() changes to permanent store, returns false if
  * any error occurred when accessing the data store */
 bool commit_parameters(void);
+/* Every set_parameter() and every parameter commit_parameters() changes counts
+ * as a write. Returns how many there were so far, a result worked out from
+ * parameters is still good as long as this stays the same */
+uint64_t fetch_parameters_version(void);
+/* Returns which of the above last changed parameter index, so that a result
+ * is still good as long as none of the parameters it read changed after it */
+uint64_t fetch_parameter_version(uint16_t index);
+/* Counts all parameters as written, for when they were replaced wholesale */
+void touch_parameters(void);
 /* Save all persistent parameters to data store in preparation for shutdown,
  * returns false if any errors occur */
 bool done_parameters(void);
@@ -19,46 +19,45 @@
 #include "gcode-debugcon.h"
 #include "gcode-math.h"
 #include "gcode-machine.h"
+#include "gcode-context.h"
 
 
-static uint8_t qHead, qTail;
-static TGCodeMoveSpec queue[GCODE_LOOKAHEAD_DEPTH], buffer;
-static bool bufferValid;
-static TGCodeOffsetSpec lastRawTarget, lastCompTarget;
+/* State lives in the calling thread's context, see gcode-context.h */
+#define QUE(x) (gcodeContext->queueContext.x)
 
 
 static bool _enqueue_nonull_move(TGCodeMoveSpec move, uint8_t where) {
-  /* Comparing floating point values for equality is asking for trouble,
-  * however we're simply treating them as opaque data and actually asking
-  * "is THIS equal to THE ONE BEFORE?" as opposed to "is 1.2 equal to 1.2?".
-  *
-  * Since the data we previously fed in went through the same transformations
-  * and obeys the same limitations of the storage type, we can safely conclude
-  * we'll always be comparing apples to apples. */
+  /* Comparing floating point values for equality is asking for trouble:
+  * expression results reach us at full precision, so two ways of getting to
+  * the same place (e.g. TAN[60] and SQRT[3]) may still differ in the last
+  * bit. Anything closer than the machine resolves is the same place. */
 #ifdef DEBUG
-  printf("Asked to enqueue (%4.2f, %4.2f, %4.2f)\n", move.target.X, move.target.Y, move.target.Z);
+  GCODE_DEBUG_RAW("Asked to enqueue (%4.2f, %4.2f, %4.2f)", move.target.X, move.target.Y, move.target.Z);
 #endif
 
-  if(memcmp(&lastCompTarget, &move.target, sizeof(TGCodeOffsetSpec))) {
-    queue[qHead] = move;
-    qHead = where;
+  if(moving_axis_math(QUE(lastCompTarget).X, move.target.X) ||
+     moving_axis_math(QUE(lastCompTarget).Y, move.target.Y) ||
+     moving_axis_math(QUE(lastCompTarget).Z, move.target.Z)) {
+    QUE(queue)[QUE(qHead)] = move;
+    QUE(qHead) = where;
 
-    lastCompTarget = move.target;
+    QUE(lastCompTarget) = move.target;
     if(move.radComp.mode == GCODE_COMP_RAD_OFF)
-      lastRawTarget = move.target;
+      QUE(lastRawTarget) = move.target;
 
     return true;
   } else return false;
 }
 
 static uint8_t _next_head(void) {
-  uint8_t nHead = (qHead + 1) == GCODE_LOOKAHEAD_DEPTH ? 0 : (qHead + 1);
+  uint8_t nHead = (QUE(qHead) + 1) == GCODE_LOOKAHEAD_DEPTH ?
+                  0 : (QUE(qHead) + 1);
 
-  if(nHead != qTail) return nHead;
+  if(nHead != QUE(qTail)) return nHead;
   else {
     display_machine_message("QER: Movement queue overflow!");
 
-    return qHead;
+    return QUE(qHead);
   }
 }
 
@@ -71,24 +70,25 @@ static void _do_radcomp(TGCodeMoveSpec move) {
 
 #ifdef DEBUG
   GCODE_DEBUG("Asked to compensate before (%4.2f, %4.2f, %4.2f)", move.target.X, move.target.Y, move.target.Z);
-  GCODE_DEBUG("Natural previous (%4.2f, %4.2f)->(%4.2f, %4.2f)", lastRawTarget.X, lastRawTarget.Y, buffer.target.X, buffer.target.Y);
+  GCODE_DEBUG("Natural previous (%4.2f, %4.2f)->(%4.2f, %4.2f)", QUE(lastRawTarget).X, QUE(lastRawTarget).Y, QUE(buffer).target.X, QUE(buffer).target.Y);
 #endif
   /* (lastRawTarget -> buffer) is the first segment */
-  movep.target = lastRawTarget;
-  movep = offset_math(movep, buffer, buffer.radComp, &opX, &opY);
+  movep.target = QUE(lastRawTarget);
+  movep = offset_math(movep, QUE(buffer), QUE(buffer).radComp, &opX, &opY);
 #ifdef DEBUG
   GCODE_DEBUG("Compensated previous (%4.2f, %4.2f)->(%4.2f, %4.2f)", opX, opY, movep.target.X, movep.target.Y);
-  GCODE_DEBUG("Natural current (%4.2f, %4.2f)->(%4.2f, %4.2f)", buffer.target.X, buffer.target.Y, move.target.X, move.target.Y);
+  GCODE_DEBUG("Natural current (%4.2f, %4.2f)->(%4.2f, %4.2f)", QUE(buffer).target.X, QUE(buffer).target.Y, move.target.X, move.target.Y);
 #endif
   /* (buffer -> move) is the second segment, as if radComp were constant,
    * we only need the starting point anyway. */
-  movec = offset_math(buffer, move, buffer.radComp, &ocX, &ocY);
+  movec = offset_math(QUE(buffer), move, QUE(buffer).radComp, &ocX, &ocY);
 #ifdef DEBUG
   GCODE_DEBUG("Compensated current (%4.2f, %4.2f)->(%4.2f, %4.2f)", ocX, ocY, movec.target.X, movec.target.Y);
 #endif
 
-  arcFlag = inside_corner_math(lastRawTarget.X, lastRawTarget.Y, buffer, move,
-                               buffer.radComp) ||
+  arcFlag = inside_corner_math(QUE(lastRawTarget).X, QUE(lastRawTarget).Y,
+                               QUE(buffer), move,
+                               QUE(buffer).radComp) ||
             (move.corner == GCODE_CORNER_CHAMFER);
   if(arcFlag) {
     /* Trim/extend the first move to the intersection point */
@@ -100,27 +100,27 @@ static void _do_radcomp(TGCodeMoveSpec move) {
   }
 
   /* Make sure axes that are not supposed to move in this move (!) stay put */
-  if(!buffer.axesMoving.X) movep.target.X = lastCompTarget.X;
-  if(!buffer.axesMoving.Y) movep.target.Y = lastCompTarget.Y;
-  if(!buffer.axesMoving.Z) movep.target.Z = lastCompTarget.Z;
+  if(!QUE(buffer).axesMoving.X) movep.target.X = QUE(lastCompTarget).X;
+  if(!QUE(buffer).axesMoving.Y) movep.target.Y = QUE(lastCompTarget).Y;
+  if(!QUE(buffer).axesMoving.Z) movep.target.Z = QUE(lastCompTarget).Z;
 
   /* Enqueue first (and maybe only) compensated move */
   _enqueue_nonull_move(movep, _next_head());
   /* Save last real target */
-  lastRawTarget = buffer.target;
+  QUE(lastRawTarget) = QUE(buffer).target;
 
   if(!arcFlag) {
     TGCodeMoveSpec arcMove;
 
     /* Create an arc around the corner */
-    arcMove.ccw = buffer.radComp.mode == GCODE_COMP_RAD_R;
-    arcMove.center = buffer.target;
-    arcMove.feedValue = buffer.feedValue;
+    arcMove.ccw = QUE(buffer).radComp.mode == GCODE_COMP_RAD_R;
+    arcMove.center = QUE(buffer).target;
+    arcMove.feedValue = QUE(buffer).feedValue;
     arcMove.isArc = true;
-    arcMove.radComp = buffer.radComp;
+    arcMove.radComp = QUE(buffer).radComp;
     arcMove.target.X = ocX;
     arcMove.target.Y = ocY;
-    arcMove.target.Z = buffer.target.Z;
+    arcMove.target.Z = QUE(buffer).target.Z;
     /* Enqueue second compensated move */
     _enqueue_nonull_move(arcMove, _next_head());
     /* We just circled around a single point, no need to update the last
@@ -129,26 +129,27 @@ static void _do_radcomp(TGCodeMoveSpec move) {
 }
 
 void init_queue(void) {
-  qHead = qTail = 0;
-  bufferValid = false;
-  lastRawTarget.X = lastRawTarget.Y = lastRawTarget.Z = +0.0E+0;
-  lastCompTarget.X = lastCompTarget.Y = lastCompTarget.Z = +0.0E+0;
+  QUE(qHead) = QUE(qTail) = 0;
+  QUE(bufferValid) = false;
+  QUE(lastRawTarget).X = QUE(lastRawTarget).Y = QUE(lastRawTarget).Z = +0.0E+0;
+  QUE(lastCompTarget).X = QUE(lastCompTarget).Y = QUE(lastCompTarget).Z =
+      +0.0E+0;
 
   GCODE_DEBUG("Movement queue ready, %d steps deep", GCODE_LOOKAHEAD_DEPTH);
 }
 
 bool enqueue_move(TGCodeMoveSpec move) {
-  if(bufferValid) _do_radcomp(move);
+  if(QUE(bufferValid)) _do_radcomp(move);
 
   if(move.radComp.mode != GCODE_COMP_RAD_OFF) {
-    buffer = move;
-    bufferValid = true;
+    QUE(buffer) = move;
+    QUE(bufferValid) = true;
 
     return true;
   } else {
-    if(bufferValid) {
+    if(QUE(bufferValid)) {
       /* Returning to non-compensated mode */
-      bufferValid = false;
+      QUE(bufferValid) = false;
     }
 
     return _enqueue_nonull_move(move, _next_head());
@@ -156,25 +157,26 @@ bool enqueue_move(TGCodeMoveSpec move) {
 }
 
 TGCodeMoveSpec peek_move(void) {
-  return queue[qTail];
+  return QUE(queue)[QUE(qTail)];
 }
 
 bool dequeue_move(TGCodeMoveSpec *move) {
   /* Empty queue? */
-  if(qHead == qTail) return false;
+  if(QUE(qHead) == QUE(qTail)) return false;
   else {
     *move = peek_move();
-    qTail = (qTail + 1) == GCODE_LOOKAHEAD_DEPTH ? 0 : (qTail + 1);
+    QUE(qTail) = (QUE(qTail) + 1) == GCODE_LOOKAHEAD_DEPTH ?
+                 0 : (QUE(qTail) + 1);
 
     return true;
   }
 }
 
 uint8_t queue_size(void) {
-  if(qHead >= qTail)
-    return qHead - qTail;
+  if(QUE(qHead) >= QUE(qTail))
+    return QUE(qHead) - QUE(qTail);
   else
-    return qHead + GCODE_LOOKAHEAD_DEPTH - qTail;
+    return QUE(qHead) + GCODE_LOOKAHEAD_DEPTH - QUE(qTail);
 }
 
 bool done_queue(void) {
@@ -30,6 +30,13 @@ typedef struct {
   } axesMoving;
 } TGCodeMoveSpec;
 
+typedef struct {
+  uint8_t qHead, qTail;
+  TGCodeMoveSpec queue[GCODE_LOOKAHEAD_DEPTH], buffer;
+  bool bufferValid;
+  TGCodeOffsetSpec lastRawTarget, lastCompTarget;
+} TGCodeQueueContext;
+
 /* Start the show */
 void init_queue(void);
 /* Adds move to the tail of the queue, returns false if queue is full */
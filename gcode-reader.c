@@ -0,0 +1,214 @@
+/*
+ ============================================================================
+ Name        : gcode-reader.c
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Read-Ahead Input Thread Code
+ ============================================================================
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gcode-commons.h"
+#include "gcode-reader.h"
+#include "gcode-debugcon.h"
+#include "gcode-machine.h"
+#include "gcode-context.h"
+
+
+/* State lives in the calling thread's context, see gcode-context.h */
+#define RDR(x) (gcodeContext->readerContext.x)
+
+
+/* Waiting is rare enough not to be worth a lock, so just nap. Each nap in a
+ * row is twice as long as the one before, up to a limit */
+static void _nap_reader(long *nap) {
+  struct timespec length = {0, *nap};
+
+  nanosleep(&length, NULL);
+  if(*nap < GCODE_READER_NAP_MAX_NS) *nap *= 2;
+}
+
+static uint64_t _now_reader(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void *_run_reader(void *data) {
+  TGCodeReaderBuffer *buffer;
+  unsigned int seen = 0, current;
+  long offset;
+  uint8_t fill = 0;
+  bool atEOF = false;
+  ssize_t got;
+  uint64_t since;
+  long nap = GCODE_READER_NAP_NS;
+
+  /* Runs on behalf of whoever started it, with their state */
+  select_context((TGCodeContext *)data);
+  offset = RDR(readerStart);
+
+  while(!atomic_load_explicit(&RDR(stopping), memory_order_acquire)) {
+    current = atomic_load_explicit(&RDR(restartGeneration),
+                                   memory_order_acquire);
+    if(current != seen) {
+      seen = current;
+      offset = atomic_load_explicit(&RDR(restartOffset), memory_order_relaxed);
+      atEOF = false;
+    }
+    buffer = &RDR(buffers)[fill];
+    if(atEOF) {
+      /* Nothing more to read unless we get restarted */
+      _nap_reader(&nap);
+      continue;
+    }
+    if(atomic_load_explicit(&buffer->full, memory_order_acquire)) {
+      /* The parser is the bottleneck */
+      since = _now_reader();
+      _nap_reader(&nap);
+      RDR(readerStall) += _now_reader() - since;
+      continue;
+    }
+    nap = GCODE_READER_NAP_NS;
+
+    /* One read per buffer, so that a slow pipe isn't held up filling it */
+    do
+      got = (RDR(readerSeekable) ?
+             pread(RDR(readerFd), buffer->data, GCODE_READER_BUFFER_SIZE,
+                   offset) :
+             read(RDR(readerFd), buffer->data, GCODE_READER_BUFFER_SIZE));
+    while(got < 0 && errno == EINTR);
+    if(got <= 0) {
+      got = 0;
+      atEOF = true;
+    }
+    offset += got;
+    buffer->length = got;
+    buffer->generation = seen;
+    RDR(buffersRead)++;
+    atomic_store_explicit(&buffer->full, true, memory_order_release);
+    fill ^= 1;
+  }
+
+  return NULL;
+}
+
+/* Hands the buffer being taken from back to the thread */
+static void _release_reader(void) {
+  atomic_store_explicit(&RDR(buffers)[RDR(takeFrom)].full, false,
+                        memory_order_release);
+  RDR(takeFrom) ^= 1;
+  RDR(takeAt) = 0;
+}
+
+bool init_reader(void *data) {
+  uint8_t i;
+
+  RDR(readerFd) = fileno((FILE *)data);
+  RDR(readerStart) = lseek(RDR(readerFd), 0, SEEK_CUR);
+  RDR(readerSeekable) = (RDR(readerStart) != -1);
+  if(!RDR(readerSeekable)) RDR(readerStart) = 0;
+  for(i = 0; i < 2; i++) {
+    RDR(buffers)[i].data = (char *)malloc(GCODE_READER_BUFFER_SIZE);
+    RDR(buffers)[i].length = 0;
+    RDR(buffers)[i].generation = 0;
+    atomic_init(&RDR(buffers)[i].full, false);
+  }
+  atomic_init(&RDR(restartGeneration), 0);
+  atomic_init(&RDR(restartOffset), 0);
+  atomic_init(&RDR(stopping), false);
+  RDR(consumerGeneration) = 0;
+  RDR(takeFrom) = 0;
+  RDR(takeAt) = 0;
+  RDR(consumerStall) = RDR(readerStall) = RDR(buffersRead) = 0;
+
+  if(!RDR(buffers)[0].data || !RDR(buffers)[1].data ||
+     pthread_create(&RDR(reader), NULL, _run_reader, gcodeContext)) {
+    display_machine_message("IER: Unable to start reading ahead, reading in line!");
+    free(RDR(buffers)[0].data);
+    free(RDR(buffers)[1].data);
+    RDR(buffers)[0].data = RDR(buffers)[1].data = NULL;
+    return false;
+  }
+
+  GCODE_DEBUG("Reading ahead into 2 buffers of %lu bytes, input %s seekable",
+              (unsigned long)GCODE_READER_BUFFER_SIZE,
+              (RDR(readerSeekable) ? "is" : "is not"));
+
+  return true;
+}
+
+size_t fetch_data_reader(char *dst, size_t room) {
+  TGCodeReaderBuffer *buffer;
+  uint64_t since = 0;
+  long nap = GCODE_READER_NAP_NS;
+  size_t got;
+
+  while(true) {
+    buffer = &RDR(buffers)[RDR(takeFrom)];
+    if(!atomic_load_explicit(&buffer->full, memory_order_acquire)) {
+      /* I/O is the bottleneck */
+      if(!since) since = _now_reader();
+      _nap_reader(&nap);
+    } else if(buffer->generation != RDR(consumerGeneration))
+      _release_reader(); /* Read before the last restart */
+    else break;
+  }
+  if(since) RDR(consumerStall) += _now_reader() - since;
+
+  if(!buffer->length) {
+    _release_reader();
+    return 0;
+  }
+  got = buffer->length - RDR(takeAt);
+  if(got > room) got = room;
+  memcpy(dst, &buffer->data[RDR(takeAt)], got);
+  RDR(takeAt) += got;
+  if(RDR(takeAt) == buffer->length) _release_reader();
+
+  return got;
+}
+
+bool restart_reader(long offset) {
+  if(!RDR(readerSeekable)) return false;
+
+  atomic_store_explicit(&RDR(restartOffset), offset, memory_order_relaxed);
+  atomic_store_explicit(&RDR(restartGeneration), ++RDR(consumerGeneration),
+                        memory_order_release);
+  /* Whatever is left of the current buffer is stale now as well */
+  RDR(takeAt) = 0;
+
+  return true;
+}
+
+bool seekable_reader(void) {
+  return RDR(readerSeekable);
+}
+
+bool done_reader(void) {
+  atomic_store_explicit(&RDR(stopping), true, memory_order_release);
+  pthread_join(RDR(reader), NULL);
+
+  GCODE_DEBUG("Read-ahead: %llu buffers read, parser waited %.3fs for input, reader waited %.3fs for parser",
+              (unsigned long long)RDR(buffersRead), RDR(consumerStall) / 1e9,
+              RDR(readerStall) / 1e9);
+  free(RDR(buffers)[0].data);
+  free(RDR(buffers)[1].data);
+  RDR(buffers)[0].data = RDR(buffers)[1].data = NULL;
+
+  return true;
+}
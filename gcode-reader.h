@@ -0,0 +1,67 @@
+/*
+ ============================================================================
+ Name        : gcode-reader.h
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Read-Ahead Input Thread API Header
+ ============================================================================
+ */
+
+#ifndef GCODE_READER_H_
+#define GCODE_READER_H_
+
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* Filled by the thread, emptied by its consumer. Whoever sees full in the
+ * state it expects owns the rest of the buffer until it flips full */
+typedef struct {
+  char *data;
+  size_t length; /* 0 marks the end of input */
+  unsigned int generation; /* Restarts requested before this was read */
+  atomic_bool full;
+} TGCodeReaderBuffer;
+
+typedef struct {
+  TGCodeReaderBuffer buffers[2];
+  pthread_t reader;
+  int readerFd;
+  bool readerSeekable;
+  long readerStart;
+  /* Restarts: the consumer sets restartOffset, then bumps restartGeneration */
+  atomic_uint restartGeneration;
+  atomic_long restartOffset;
+  atomic_bool stopping;
+  /* Consumer side */
+  unsigned int consumerGeneration;
+  uint8_t takeFrom;
+  size_t takeAt;
+  uint64_t consumerStall;
+  /* Thread side, only looked at after it has been joined */
+  uint64_t readerStall, buffersRead;
+} TGCodeReaderContext;
+
+/* Starts a thread reading the file descriptor pointed to by data ahead of
+ * its consumer into two buffers of GCODE_READER_BUFFER_SIZE bytes, which are
+ * handed over without locking. Reading starts at the current file position.
+ * Returns false if the thread could not be started */
+bool init_reader(void *data);
+/* Copies up to room bytes of what was read ahead to dst, waiting for the
+ * thread if it has nothing yet. Returns how many, 0 on end of input */
+size_t fetch_data_reader(char *dst, size_t room);
+/* Throws away whatever was read ahead and has the thread carry on from offset
+ * instead. Returns false if the input can't be seeked (e.g. a pipe) */
+bool restart_reader(long offset);
+/* Whether restart_reader() can work at all */
+bool seekable_reader(void);
+/* Stops the thread and reports how long each side waited for the other */
+bool done_reader(void);
+
+
+#endif /* GCODE_READER_H_ */
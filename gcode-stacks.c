@@ -17,15 +17,15 @@
 #include "gcode-stacks.h"
 #include "gcode-debugcon.h"
 #include "gcode-parameters.h"
+#include "gcode-context.h"
 
 
-static double *parametersStack[GCODE_MACRO_COUNT];
-static TProgramPointer *programStack[GCODE_SUBPROGRAM_COUNT];
-static uint8_t paSP, prSP;
+/* State lives in the calling thread's context, see gcode-context.h */
+#define STK(x) (gcodeContext->stacksContext.x)
 
 
 bool init_stacks(void *data) {
-  paSP = prSP = 0;
+  STK(paSP) = STK(prSP) = 0;
 
   GCODE_DEBUG("Stacks initialized, %d nested calls (%d of which macro-capable) supported",
               GCODE_SUBPROGRAM_COUNT, GCODE_MACRO_COUNT);
@@ -34,31 +34,31 @@ bool init_stacks(void *data) {
 }
 
 bool stacks_push_parameters(void) {
-  if(paSP < GCODE_MACRO_COUNT - 1) {
+  if(STK(paSP) < GCODE_MACRO_COUNT - 1) {
     double *params = (double *)malloc(sizeof(double) * 33);
     uint8_t i;
 
     for(i = 0; i < 33; i++) params[i] = fetch_parameter(i + 1);
-    parametersStack[++paSP] = params;
+    STK(parametersStack)[++STK(paSP)] = params;
 
     return true;
   } else return false;
 }
 
 bool stacks_push_program(const TProgramPointer *state) {
-  if(prSP < GCODE_SUBPROGRAM_COUNT - 1) {
+  if(STK(prSP) < GCODE_SUBPROGRAM_COUNT - 1) {
     TProgramPointer *pptr = (TProgramPointer *)malloc(sizeof(TProgramPointer));
 
     *pptr = *state;
-    programStack[++prSP] = pptr;
+    STK(programStack)[++STK(prSP)] = pptr;
 
     return true;
   } else return false;
 }
 
 bool stacks_pop_parameters(void) {
-  if(paSP) {
-    double *params = parametersStack[paSP--];
+  if(STK(paSP)) {
+    double *params = STK(parametersStack)[STK(paSP)--];
     uint8_t i;
 
     for(i = 0; i < 33; i++) update_parameter(i + 1, params[i]);
@@ -70,14 +70,73 @@ bool stacks_pop_parameters(void) {
 }
 
 bool stacks_pop_program(TProgramPointer *state) {
-  if(prSP && state) {
-    *state = *(programStack[prSP--]);
-    free(programStack[prSP + 1]);
+  if(STK(prSP) && state) {
+    *state = *(STK(programStack)[STK(prSP)--]);
+    free(STK(programStack)[STK(prSP) + 1]);
 
     return true;
   } else return false;
 }
 
+long stacks_oldest_program(void) {
+  long oldest = -1;
+  uint8_t i;
+
+  /* Positions inside spliced text are negative, those aren't in the input */
+  for(i = 1; i <= STK(prSP); i++)
+    if(STK(programStack)[i]->programCounter >= 0 &&
+       (oldest < 0 || STK(programStack)[i]->programCounter < oldest))
+      oldest = STK(programStack)[i]->programCounter;
+
+  return oldest;
+}
+
+bool save_stacks(FILE *target) {
+  uint8_t i;
+
+  if(fwrite(&STK(paSP), sizeof(STK(paSP)), 1, target) != 1 ||
+     fwrite(&STK(prSP), sizeof(STK(prSP)), 1, target) != 1) return false;
+  /* Both grow from 1 up */
+  for(i = 1; i <= STK(paSP); i++)
+    if(fwrite(STK(parametersStack)[i], sizeof(double), 33, target) != 33)
+      return false;
+  for(i = 1; i <= STK(prSP); i++)
+    if(fwrite(STK(programStack)[i], sizeof(TProgramPointer), 1, target) != 1)
+      return false;
+
+  return true;
+}
+
+bool restore_stacks(FILE *source) {
+  uint8_t pa, pr;
+
+  if(fread(&pa, sizeof(pa), 1, source) != 1 ||
+     fread(&pr, sizeof(pr), 1, source) != 1 ||
+     pa >= GCODE_MACRO_COUNT || pr >= GCODE_SUBPROGRAM_COUNT) return false;
+  while(STK(paSP)) free(STK(parametersStack)[STK(paSP)--]);
+  while(STK(prSP)) free(STK(programStack)[STK(prSP)--]);
+  for(; STK(paSP) < pa; STK(paSP)++) {
+    double *params = (double *)malloc(sizeof(double) * 33);
+
+    if(!params || fread(params, sizeof(double), 33, source) != 33) {
+      free(params);
+      return false;
+    }
+    STK(parametersStack)[STK(paSP) + 1] = params;
+  }
+  for(; STK(prSP) < pr; STK(prSP)++) {
+    TProgramPointer *pptr = (TProgramPointer *)malloc(sizeof(TProgramPointer));
+
+    if(!pptr || fread(pptr, sizeof(TProgramPointer), 1, source) != 1) {
+      free(pptr);
+      return false;
+    }
+    STK(programStack)[STK(prSP) + 1] = pptr;
+  }
+
+  return true;
+}
+
 bool done_stacks(void) {
   GCODE_DEBUG("Stacks done");
 
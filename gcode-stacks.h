@@ -14,6 +14,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #include "gcode-commons.h"
 
@@ -24,6 +25,12 @@ typedef struct {
     uint16_t repeatCount;
 } TProgramPointer;
 
+typedef struct {
+  double *parametersStack[GCODE_MACRO_COUNT];
+  TProgramPointer *programStack[GCODE_SUBPROGRAM_COUNT];
+  uint8_t paSP, prSP;
+} TGCodeStackContext;
+
 
 bool init_stacks(void *data);
 /* Pushes #1-33 on stack for G65 */
@@ -34,6 +41,12 @@ bool stacks_push_program(const TProgramPointer *state);
 bool stacks_pop_parameters(void);
 /* Pops current state of program */
 bool stacks_pop_program(TProgramPointer *state);
+/* Oldest input offset a pushed program state goes back to, -1 if none */
+long stacks_oldest_program(void);
+/* Writes both stacks to target, for gcode-checkpoint */
+bool save_stacks(FILE *target);
+/* Replaces both stacks with what save_stacks() wrote to source */
+bool restore_stacks(FILE *source);
 bool done_stacks(void);
 
 
@@ -11,7 +11,6 @@
 #include <ctype.h>
 #include <limits.h>
 #include <math.h>
-#include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -27,10 +26,15 @@
 #include "gcode-math.h"
 #include "gcode-stacks.h"
 #include "gcode-cycles.h"
+#include "gcode-subprogram.h"
+#include "gcode-checkpoint.h"
+#include "gcode-context.h"
 
 
-static TGCodeWordCache parseCache;
-static TGCodeState currentGCodeState = {
+/* State lives in the calling thread's context, see gcode-context.h */
+#define ST(x) (gcodeContext->stateContext.x)
+
+static const TGCodeState defaultGCodeState = {
   GCODE_FEED_PERMINUTE,
   {
     GCODE_PLANE_XY,
@@ -106,12 +110,11 @@ static TGCodeState currentGCodeState = {
   0,
   0
 };
-static bool stillRunning;
 
 
 static TGCodeMotionMode _map_move_to_motion(TGCodeMoveMode mode, bool *ccw) {
   switch(mode) {
-    case GCODE_MOVE_RAPID_AS_RETURNED: /* Returned as 100 by have_gcode_word() */
+    case GCODE_MOVE_RAPID:
       return RAPID;
     case GCODE_MOVE_FEED:
       return LINEAR;
@@ -128,14 +131,140 @@ static TGCodeMotionMode _map_move_to_motion(TGCodeMoveMode mode, bool *ccw) {
   }
 }
 
-static bool _refresh_gcode_parse_cache(char word) {
-  if(parseCache.word != word) { /* Not in cache */
-    parseCache.word = word;
-    /* Position at first occurrence */
-    parseCache.at = strchr(parseCache.line, word);
+int gcode_letter_slot(char letter) {
+  if(letter >= 'A' && letter <= 'Z') return letter - 'A';
+  else if(letter == '#') return 26;
+  else if(letter == '=') return 27;
+  else return -1;
+}
+
+/* Next word with the given letter at or after from */
+static const TGCodeWord *_find_gcode_word(const TGCodeWord *from, char word) {
+  for(; from < ST(wordTable).wordsEnd; from++)
+    if(from->letter == word) return from;
+
+  return NULL;
+}
+
+/* These read decoded arguments exactly like read_gcode_*() read text */
+static uint32_t _gcode_word_integer(const TGCodeWord *word) {
+  uint32_t result = word->integer;
+  uint8_t i;
+
+  for(i = 0; i < word->indirection; i++)
+    result = (uint32_t)fetch_parameter(result);
+
+  return result;
+}
+
+static double _gcode_word_real(const TGCodeWord *word) {
+  uint32_t index;
+  uint8_t i;
+
+  if(!word->indirection) return word->value;
+  index = word->integer;
+  for(i = 1; i < word->indirection; i++)
+    index = (uint32_t)fetch_parameter(index);
+
+  return fetch_parameter(index);
+}
+
+/* Decodes block into wordTable, the only pass over it update_gcode_state()
+ * makes. What gcode-checker looks at is gathered on the way */
+static bool _load_gcode_word_table(const TGCodeBlockView *block) {
+  const TGCodeWord *word;
+  const char *text = block->text;
+  size_t count, length = block->length;
+  uint32_t bit;
+  int slot;
+
+  memset(&ST(wordTable), 0x00, sizeof(ST(wordTable)));
+  ST(wordTable).line = block->text;
+  ST(wordTable).end = &block->text[block->length];
+  ST(wordTable).clean = true;
+  if((ST(wordTable).compiled = (block->words != NULL))) {
+    ST(wordTable).words = block->words;
+    count = block->wordCount;
+  } else {
+    if(ST(textWordsRoom) < block->length) {
+      TGCodeWord *grown = (TGCodeWord *)realloc(ST(textWords), block->length *
+                                                sizeof(TGCodeWord));
+
+      if(!grown) {
+        display_machine_message("IER: Out of memory decoding block!");
+        return false;
+      }
+      ST(textWords) = grown;
+      ST(textWordsRoom) = block->length;
+    }
+    /* Block delete marker, the only thing allowed in front of a word */
+    if(length && *text == '/') {
+      text++;
+      length--;
+    }
+    ST(wordTable).words = ST(textWords);
+    count = decode_gcode_words(text, length, ST(textWords),
+                               &ST(wordTable).clean);
   }
+  ST(wordTable).wordsEnd = &ST(wordTable).words[count];
 
-  return parseCache.at;
+  for(word = ST(wordTable).words; word < ST(wordTable).wordsEnd; word++) {
+    if((slot = gcode_letter_slot(word->letter)) < 0) continue;
+    bit = (uint32_t)1 << slot;
+    ST(wordTable).repeated |= ST(wordTable).letters & bit;
+    ST(wordTable).letters |= bit;
+    if(!ST(wordTable).first[slot]) ST(wordTable).first[slot] = word;
+    if(word->letter != 'G' && word->letter != 'M') continue;
+    if(word->indirection) {
+      if(word->letter == 'G') ST(wordTable).indirectG = true;
+      else ST(wordTable).indirectM = true;
+    } else if((uint8_t)word->integer < 128) {
+      TGCodeCodeMask code = GCODE_CODE((uint8_t)word->integer);
+
+      if(word->letter == 'G') {
+        if(ST(wordTable).G & code) ST(wordTable).repeatedG = true;
+        ST(wordTable).G |= code;
+      } else {
+        if(ST(wordTable).M & code) ST(wordTable).repeatedM = true;
+        ST(wordTable).M |= code;
+      }
+    }
+  }
+
+  return true;
+}
+
+const TGCodeWordTable *load_gcode_words(const TGCodeBlockView *block) {
+  if(!_load_gcode_word_table(block)) return NULL;
+  ST(wordTable).pending = true;
+
+  return &ST(wordTable);
+}
+
+/* First word with the given letter, NULL if there is none */
+static const TGCodeWord *_first_gcode_word(char word) {
+  int slot = gcode_letter_slot(word);
+
+  return (slot < 0 ? NULL : ST(wordTable).first[slot]);
+}
+
+/* Codes given on the block as arguments of word, G or M. Those given through
+ * parameters are only known now */
+static TGCodeCodeMask _gcode_codes(char word) {
+  const TGCodeWord *found;
+  TGCodeCodeMask codes;
+  uint8_t code;
+
+  if(word == 'G' && !ST(wordTable).indirectG) return ST(wordTable).G;
+  if(word == 'M' && !ST(wordTable).indirectM) return ST(wordTable).M;
+
+  codes = 0;
+  for(found = _first_gcode_word(word); found;
+      found = _find_gcode_word(&found[1], word))
+    if((code = (uint8_t)_gcode_word_integer(found)) < 128)
+      codes |= GCODE_CODE(code);
+
+  return codes;
 }
 
 /* Used to jump over parameters and their arguments after being processed.
@@ -150,23 +279,35 @@ const char *skip_gcode_digits(const char *string) {
   return string;
 }
 
+const char *skip_gcode_number(const char *string) {
+  const char *at = string;
+
+  while(*at == '#') at++;
+  if(*at == '+' || *at == '-') at++;
+  if(*at == GCODE_INPUT_VALUE) return &at[1];
+  else return skip_gcode_digits(string);
+}
+
 bool init_gcode_state(void *data) {
-  stillRunning = true;
+  ST(currentGCodeState) = defaultGCodeState;
+  ST(stillRunning) = true;
 
   set_parameter(GCODE_PARM_SCALING, +1.0E+0); /* Unity scaling */
   set_parameter(
       GCODE_PARM_BITFIELD2,
       ((uint8_t)fetch_parameter(GCODE_PARM_BITFIELD2) &
           ~(GCODE_STATE_PF_ABSOLUTE | GCODE_STATE_PF_IMPERIAL)) |
-      (currentGCodeState.system.absolute == GCODE_ABSOLUTE ? GCODE_STATE_PF_ABSOLUTE : 0x00) |
-      (currentGCodeState.system.units == GCODE_UNITS_INCH ? GCODE_STATE_PF_IMPERIAL : 0x00));
+      (ST(currentGCodeState).system.absolute == GCODE_ABSOLUTE ?
+          GCODE_STATE_PF_ABSOLUTE : 0x00) |
+      (ST(currentGCodeState).system.units == GCODE_UNITS_INCH ?
+          GCODE_STATE_PF_IMPERIAL : 0x00));
   /* By default, logical origin == G-Code origin */
   set_parameter(GCODE_PARM_FIRST_LOCAL + GCODE_AXIS_X,
-                currentGCodeState.system.gX);
+                ST(currentGCodeState).system.gX);
   set_parameter(GCODE_PARM_FIRST_LOCAL + GCODE_AXIS_Y,
-                currentGCodeState.system.gY);
+                ST(currentGCodeState).system.gY);
   set_parameter(GCODE_PARM_FIRST_LOCAL + GCODE_AXIS_Z,
-                currentGCodeState.system.gZ);
+                ST(currentGCodeState).system.gZ);
   /* WCS #1 is selected */
   set_parameter(GCODE_PARM_CURRENT_WCS, 1);
 
@@ -175,297 +316,296 @@ bool init_gcode_state(void *data) {
   return true;
 }
 
-bool update_gcode_state(char *line) {
+bool update_gcode_state(const TGCodeBlockView *block) {
   uint8_t arg;
-  //TODO: consider whether these three should be moved to currentGCodeState
-  static double cX, cY, cZ;
   double wX, wY, wZ;
   bool nullMove = true, toRFirst;
-  static double lastZ;
-
-  parseCache.line = line;
-   /* because space is not a G-Code word and all spaces have already been
-    * stripped from line */
-  parseCache.word = ' ';
-  parseCache.at = NULL;
-
-  if((arg = have_gcode_word('G', 3, GCODE_FEED_INVTIME, GCODE_FEED_PERMINUTE,
-                            GCODE_FEED_PERREVOLUTION)))
-    currentGCodeState.feedMode = arg;
-  if(have_gcode_word('F', 0)) {
-    if(currentGCodeState.feedMode != GCODE_FEED_INVTIME)
-      currentGCodeState.F = inch_math(
+
+  /* Compiled subprograms come decoded, gcode-checker may have done it too */
+  if(block->table) ST(wordTable) = *block->table;
+  else if(!ST(wordTable).pending || ST(wordTable).line != block->text ||
+          ST(wordTable).end != &block->text[block->length] ||
+          ST(wordTable).compiled != (block->words != NULL)) {
+    if(!_load_gcode_word_table(block)) return false;
+  }
+  ST(wordTable).pending = false;
+  record_subprogram(&ST(wordTable));
+
+  if(have_gcode_code('G', GCODE_GROUP_FEED, &arg))
+    ST(currentGCodeState).feedMode = arg;
+  if(have_gcode_word('F')) {
+    if(ST(currentGCodeState).feedMode != GCODE_FEED_INVTIME)
+      ST(currentGCodeState).F = inch_math(
           override_feed_machine(get_gcode_word_real('F')),
-          (currentGCodeState.system.units == GCODE_UNITS_INCH));
+          (ST(currentGCodeState).system.units == GCODE_UNITS_INCH));
     else
-      currentGCodeState.F = get_gcode_word_real('F');
+      ST(currentGCodeState).F = get_gcode_word_real('F');
   }
-  if(have_gcode_word('S', 0))
+  if(have_gcode_word('S'))
     set_spindle_speed_machine(override_speed_machine(get_gcode_word_integer('S')));
-  if(have_gcode_word('T', 0)) {
-    currentGCodeState.T = get_gcode_word_integer('T');
-    preselect_tool_machine(currentGCodeState.T);
+  if(have_gcode_word('T')) {
+    ST(currentGCodeState).T = get_gcode_word_integer('T');
+    preselect_tool_machine(ST(currentGCodeState).T);
   }
-  if(have_gcode_word('M', 1, 6)) change_tool_machine(currentGCodeState.T);
-  if(have_gcode_word('M', 1, 52)) change_tool_machine(GCODE_MACHINE_NO_TOOL);
-  if((arg = have_gcode_word('M', 2, GCODE_PROBE_PART, GCODE_PROBE_TOOL)))
+  if(have_gcode_code('M', GCODE_CODE(6), NULL))
+    change_tool_machine(ST(currentGCodeState).T);
+  if(have_gcode_code('M', GCODE_CODE(52), NULL))
+    change_tool_machine(GCODE_MACHINE_NO_TOOL);
+  if(have_gcode_code('M', GCODE_GROUP_PROBE_INPUT, &arg))
     select_probeinput_machine(arg);
-  if((arg = have_gcode_word('M', 2, GCODE_PROBE_ONETOUCH,
-                            GCODE_PROBE_TWOTOUCH)))
+  if(have_gcode_code('M', GCODE_GROUP_PROBE_MODE, &arg))
     select_probemode_machine(arg);
-  if((arg = have_gcode_word('M', 3, GCODE_SPINDLE_CW, GCODE_SPINDLE_CCW,
-                            GCODE_SPINDLE_STOP)))
+  if(have_gcode_code('M', GCODE_GROUP_SPINDLE, &arg))
     start_spindle_machine(arg);
-  if((arg = have_gcode_word('M', 5, GCODE_COOL_MIST, GCODE_COOL_FLOOD,
-                            GCODE_COOL_OFF_MF, GCODE_COOL_SHOWER,
-                            GCODE_COOL_OFF_S))) start_coolant_machine(arg);
-  if((arg = have_gcode_word('M', 2, GCODE_COOLSPIN_CW, GCODE_COOLSPIN_CCW))) {
+  if(have_gcode_code('M', GCODE_GROUP_COOLANT, &arg))
+    start_coolant_machine(arg);
+  if(have_gcode_code('M', GCODE_GROUP_COOLANT_AND_SPINDLE, &arg)) {
     start_coolant_machine(GCODE_COOL_FLOOD);
     start_spindle_machine((arg == GCODE_COOLSPIN_CW) ? GCODE_SPINDLE_CW : GCODE_SPINDLE_CCW);
   }
-  if((arg = have_gcode_word('M', 2, GCODE_OVERRIDE_ON, GCODE_OVERRIDE_OFF)))
+  if(have_gcode_code('M', GCODE_GROUP_OVERRIDE, &arg))
     enable_override_machine(arg);
-  if(have_gcode_word('G', 1, 4))
+  if(have_gcode_code('G', GCODE_CODE(4), NULL))
     GCODE_DEBUG("Would dwell for %4.2f seconds.", get_gcode_word_real('P'));
-  if((arg = have_gcode_word('G', 3, GCODE_PLANE_XY, GCODE_PLANE_ZX,
-                            GCODE_PLANE_YZ)))
-    currentGCodeState.system.plane = arg;
-  if((arg = have_gcode_word('G', 2, GCODE_UNITS_INCH, GCODE_UNITS_METRIC)))
-    currentGCodeState.system.units = arg;
-  if((arg = have_gcode_word('G', 3, GCODE_COMP_RAD_OFF, GCODE_COMP_RAD_L,
-                            GCODE_COMP_RAD_R))) {
-    currentGCodeState.system.radComp.mode = arg;
+  if(have_gcode_code('G', GCODE_GROUP_PLANE, &arg))
+    ST(currentGCodeState).system.plane = arg;
+  if(have_gcode_code('G', GCODE_GROUP_UNITS, &arg))
+    ST(currentGCodeState).system.units = arg;
+  if(have_gcode_code('G', GCODE_GROUP_RAD_COMP, &arg)) {
+    ST(currentGCodeState).system.radComp.mode = arg;
     if(arg != GCODE_COMP_RAD_OFF) {
-      if(have_gcode_word('D', 0))
-        currentGCodeState.system.radComp.offset = radiusof_tool(
+      if(have_gcode_word('D'))
+        ST(currentGCodeState).system.radComp.offset = radiusof_tool(
             get_gcode_word_integer('D'));
-      else currentGCodeState.system.radComp.offset = radiusof_tool(
-          currentGCodeState.T);
+      else ST(currentGCodeState).system.radComp.offset = radiusof_tool(
+          ST(currentGCodeState).T);
     }
   }
-  if((arg = have_gcode_word('G', 2, GCODE_CORNER_CHAMFER, GCODE_CORNER_FILLET)))
-    currentGCodeState.system.corner = arg;
-  if((arg = have_gcode_word('G', 3, GCODE_COMP_LEN_OFF, GCODE_COMP_LEN_N,
-                            GCODE_COMP_LEN_P))) {
-    currentGCodeState.system.lenComp.mode = arg;
+  if(have_gcode_code('G', GCODE_GROUP_CORNER, &arg))
+    ST(currentGCodeState).system.corner = arg;
+  if(have_gcode_code('G', GCODE_GROUP_LEN_COMP, &arg)) {
+    ST(currentGCodeState).system.lenComp.mode = arg;
     if(arg != GCODE_COMP_LEN_OFF) {
-      if(have_gcode_word('H', 0))
-        currentGCodeState.system.lenComp.offset = lengthof_tool(
+      if(have_gcode_word('H'))
+        ST(currentGCodeState).system.lenComp.offset = lengthof_tool(
             get_gcode_word_integer('H'));
-      else currentGCodeState.system.lenComp.offset = lengthof_tool(
-          currentGCodeState.T);
+      else ST(currentGCodeState).system.lenComp.offset = lengthof_tool(
+          ST(currentGCodeState).T);
       set_parameter(GCODE_PARM_FIRST_OFFSET + GCODE_AXIS_Z,
-                    currentGCodeState.system.lenComp.offset);
+                    ST(currentGCodeState).system.lenComp.offset);
     }
   }
-  if((arg = have_gcode_word('G', 7, GCODE_MCS, GCODE_WCS_1, GCODE_WCS_2,
-                            GCODE_WCS_3, GCODE_WCS_4, GCODE_WCS_5,
-                            GCODE_WCS_6))) {
+  if(have_gcode_code('G', GCODE_GROUP_SYSTEM, &arg)) {
     if(arg == GCODE_MCS)
-      currentGCodeState.system.oldCurrent = currentGCodeState.system.current;
-    currentGCodeState.system.current = arg;
-    set_parameter(GCODE_PARM_CURRENT_WCS, currentGCodeState.system.current);
+      ST(currentGCodeState).system.oldCurrent =
+          ST(currentGCodeState).system.current;
+    ST(currentGCodeState).system.current = arg;
+    set_parameter(GCODE_PARM_CURRENT_WCS, ST(currentGCodeState).system.current);
   }
-  if((arg = have_gcode_word('M', 3, GCODE_MIRROR_X, GCODE_MIRROR_Y,
-                            GCODE_MIRROR_OFF_M))) enable_mirror_machine(arg);
-  if((arg = have_gcode_word('G', 2, GCODE_MIRROR_ON, GCODE_MIRROR_OFF_S))) {
+  if(have_gcode_code('M', GCODE_GROUP_MIRROR_MACHINE, &arg))
+    enable_mirror_machine(arg);
+  if(have_gcode_code('G', GCODE_GROUP_MIRROR, &arg)) {
     //TODO: investigate whether it's worth merging with M21-M23 to avoid duplicating code
-    currentGCodeState.system.mirror.mode = arg;
-    currentGCodeState.system.mirror.X = do_G_coordinate_math(
-        &currentGCodeState.system, get_gcode_word_real('X'),
-        currentGCodeState.system.offset.X, currentGCodeState.system.gX,
+    ST(currentGCodeState).system.mirror.mode = arg;
+    ST(currentGCodeState).system.mirror.X = do_G_coordinate_math(
+        &ST(currentGCodeState).system, get_gcode_word_real('X'),
+        ST(currentGCodeState).system.offset.X, ST(currentGCodeState).system.gX,
         GCODE_AXIS_X);
-    currentGCodeState.system.mirror.Y = do_G_coordinate_math(
-        &currentGCodeState.system, get_gcode_word_real('Y'),
-        currentGCodeState.system.offset.Y, currentGCodeState.system.gY,
+    ST(currentGCodeState).system.mirror.Y = do_G_coordinate_math(
+        &ST(currentGCodeState).system, get_gcode_word_real('Y'),
+        ST(currentGCodeState).system.offset.Y, ST(currentGCodeState).system.gY,
         GCODE_AXIS_Y);
-    currentGCodeState.system.mirror.Z = do_G_coordinate_math(
-        &currentGCodeState.system, get_gcode_word_real('Z'),
-        currentGCodeState.system.offset.Z, currentGCodeState.system.gZ,
+    ST(currentGCodeState).system.mirror.Z = do_G_coordinate_math(
+        &ST(currentGCodeState).system, get_gcode_word_real('Z'),
+        ST(currentGCodeState).system.offset.Z, ST(currentGCodeState).system.gZ,
         GCODE_AXIS_Z);
-    currentGCodeState.axisWordsConsumed = true;
+    ST(currentGCodeState).axisWordsConsumed = true;
   }
-  if((arg = have_gcode_word('G', 2, GCODE_ROTATION_ON, GCODE_ROTATION_OFF))) {
-    currentGCodeState.system.rotation.mode = arg;
-    currentGCodeState.system.rotation.X = do_G_coordinate_math(
-        &currentGCodeState.system, get_gcode_word_real('X'),
-        currentGCodeState.system.offset.X, currentGCodeState.system.gX,
+  if(have_gcode_code('G', GCODE_GROUP_ROTATION, &arg)) {
+    ST(currentGCodeState).system.rotation.mode = arg;
+    ST(currentGCodeState).system.rotation.X = do_G_coordinate_math(
+        &ST(currentGCodeState).system, get_gcode_word_real('X'),
+        ST(currentGCodeState).system.offset.X, ST(currentGCodeState).system.gX,
         GCODE_AXIS_X);
-    currentGCodeState.system.rotation.Y = do_G_coordinate_math(
-        &currentGCodeState.system, get_gcode_word_real('Y'),
-        currentGCodeState.system.offset.Y, currentGCodeState.system.gY,
+    ST(currentGCodeState).system.rotation.Y = do_G_coordinate_math(
+        &ST(currentGCodeState).system, get_gcode_word_real('Y'),
+        ST(currentGCodeState).system.offset.Y, ST(currentGCodeState).system.gY,
         GCODE_AXIS_Y);
-    currentGCodeState.system.rotation.Z = do_G_coordinate_math(
-        &currentGCodeState.system, get_gcode_word_real('Z'),
-        currentGCodeState.system.offset.Z, currentGCodeState.system.gZ,
+    ST(currentGCodeState).system.rotation.Z = do_G_coordinate_math(
+        &ST(currentGCodeState).system, get_gcode_word_real('Z'),
+        ST(currentGCodeState).system.offset.Z, ST(currentGCodeState).system.gZ,
         GCODE_AXIS_Z);
-    currentGCodeState.system.rotation.R = get_gcode_word_integer('R');
-    currentGCodeState.axisWordsConsumed = true;
+    ST(currentGCodeState).system.rotation.R = get_gcode_word_integer('R');
+    ST(currentGCodeState).axisWordsConsumed = true;
   }
-  if((arg = have_gcode_word('G', 2, GCODE_EXACTSTOPCHECK_ON,
-                            GCODE_EXACTSTOPCHECK_OFF))) {
-    currentGCodeState.oldPathMode = arg;
-    select_pathmode_machine(currentGCodeState.oldPathMode);
+  if(have_gcode_code('G', GCODE_GROUP_PATH, &arg)) {
+    ST(currentGCodeState).oldPathMode = arg;
+    select_pathmode_machine(ST(currentGCodeState).oldPathMode);
   }
-  if(have_gcode_word('G', 1, 9)) {
-    currentGCodeState.nonModalPathMode = true;
+  if(have_gcode_code('G', GCODE_CODE(9), NULL)) {
+    ST(currentGCodeState).nonModalPathMode = true;
     select_pathmode_machine(GCODE_EXACTSTOPCHECK_ON);
   }
-  if((arg = have_gcode_word('G', 2, GCODE_ABSOLUTE, GCODE_RELATIVE)))
-    currentGCodeState.system.absolute = arg;
-  if((arg = have_gcode_word('G', 2, GCODE_CARTESIAN, GCODE_POLAR)))
-    currentGCodeState.system.cartesian = arg;
-  if((arg = have_gcode_word('G', 2, GCODE_SCALING_ON, GCODE_SCALING_OFF))) {
-    currentGCodeState.system.scaling.mode = arg;
-    currentGCodeState.system.scaling.X = do_G_coordinate_math(
-        &currentGCodeState.system, get_gcode_word_real('X'),
-        currentGCodeState.system.offset.X, currentGCodeState.system.gX,
+  if(have_gcode_code('G', GCODE_GROUP_ABSOLUTE, &arg))
+    ST(currentGCodeState).system.absolute = arg;
+  if(have_gcode_code('G', GCODE_GROUP_POLAR, &arg))
+    ST(currentGCodeState).system.cartesian = arg;
+  if(have_gcode_code('G', GCODE_GROUP_SCALING, &arg)) {
+    ST(currentGCodeState).system.scaling.mode = arg;
+    ST(currentGCodeState).system.scaling.X = do_G_coordinate_math(
+        &ST(currentGCodeState).system, get_gcode_word_real('X'),
+        ST(currentGCodeState).system.offset.X, ST(currentGCodeState).system.gX,
         GCODE_AXIS_X);
-    currentGCodeState.system.scaling.Y = do_G_coordinate_math(
-        &currentGCodeState.system, get_gcode_word_real('Y'),
-        currentGCodeState.system.offset.Y, currentGCodeState.system.gY,
+    ST(currentGCodeState).system.scaling.Y = do_G_coordinate_math(
+        &ST(currentGCodeState).system, get_gcode_word_real('Y'),
+        ST(currentGCodeState).system.offset.Y, ST(currentGCodeState).system.gY,
         GCODE_AXIS_Y);
-    currentGCodeState.system.scaling.Z = do_G_coordinate_math(
-        &currentGCodeState.system, get_gcode_word_real('Z'),
-        currentGCodeState.system.offset.Z, currentGCodeState.system.gZ,
+    ST(currentGCodeState).system.scaling.Z = do_G_coordinate_math(
+        &ST(currentGCodeState).system, get_gcode_word_real('Z'),
+        ST(currentGCodeState).system.offset.Z, ST(currentGCodeState).system.gZ,
         GCODE_AXIS_Z);
-    currentGCodeState.axisWordsConsumed = true;
-    currentGCodeState.system.scaling.I = get_gcode_word_real('P');
-    if(isnan(currentGCodeState.system.scaling.I)) { /* No P word */
-      currentGCodeState.system.scaling.I = get_gcode_word_real_default('I', +1.0E+0);
-      currentGCodeState.system.scaling.J = get_gcode_word_real_default('J', +1.0E+0);
-      currentGCodeState.system.scaling.K = get_gcode_word_real_default('K', +1.0E+0);
+    ST(currentGCodeState).axisWordsConsumed = true;
+    ST(currentGCodeState).system.scaling.I = get_gcode_word_real('P');
+    if(isnan(ST(currentGCodeState).system.scaling.I)) { /* No P word */
+      ST(currentGCodeState).system.scaling.I =
+          get_gcode_word_real_default('I', +1.0E+0);
+      ST(currentGCodeState).system.scaling.J =
+          get_gcode_word_real_default('J', +1.0E+0);
+      ST(currentGCodeState).system.scaling.K =
+          get_gcode_word_real_default('K', +1.0E+0);
     } else
-      currentGCodeState.system.scaling.J = currentGCodeState.system.scaling.K =
-          currentGCodeState.system.scaling.I;
-  }
-  if((arg = have_gcode_word('G', 2, GCODE_RETRACT_LAST, GCODE_RETRACT_R)))
-    currentGCodeState.retractMode = arg;
-  if((arg = have_gcode_word('G', 4, GCODE_CYCLE_HOME, GCODE_CYCLE_RETURN,
-                            GCODE_CYCLE_ZERO, GCODE_CYCLE_CANCEL))) {
-    currentGCodeState.motionMode = OFF;
+      ST(currentGCodeState).system.scaling.J =
+          ST(currentGCodeState).system.scaling.K =
+          ST(currentGCodeState).system.scaling.I;
+  }
+  if(have_gcode_code('G', GCODE_GROUP_RETRACT, &arg))
+    ST(currentGCodeState).retractMode = arg;
+  if(have_gcode_code('G', GCODE_GROUP_HOME, &arg)) {
+    ST(currentGCodeState).motionMode = OFF;
     if(arg != GCODE_CYCLE_CANCEL) {
-      move_math(&currentGCodeState.system, get_gcode_word_real('X'),
+      move_math(&ST(currentGCodeState).system, get_gcode_word_real('X'),
                 get_gcode_word_real('Y'), get_gcode_word_real('Z'));
-      move_machine_home(arg, currentGCodeState.system.X,
-                        currentGCodeState.system.Y, currentGCodeState.system.Z);
-      currentGCodeState.axisWordsConsumed = true;
+      move_machine_home(arg, ST(currentGCodeState).system.X,
+                        ST(currentGCodeState).system.Y,
+                        ST(currentGCodeState).system.Z);
+      ST(currentGCodeState).axisWordsConsumed = true;
     }
   }
-  if((arg = have_gcode_word('G', 2, GCODE_DATA_ON, GCODE_DATA_OFF))) {
+  if(have_gcode_code('G', GCODE_GROUP_DATA, &arg)) {
     if(arg == GCODE_DATA_ON) {
-      currentGCodeState.oldMotionMode = currentGCodeState.motionMode;
-      currentGCodeState.motionMode = STORE;
-    } else currentGCodeState.motionMode = currentGCodeState.oldMotionMode;
-  }
-  if(have_gcode_word('G', 2, 52, 92)) {
-    currentGCodeState.system.offset.X = do_G_coordinate_math(
-        &currentGCodeState.system, get_gcode_word_real('X'),
-        currentGCodeState.system.offset.X, currentGCodeState.system.gX,
+      ST(currentGCodeState).oldMotionMode = ST(currentGCodeState).motionMode;
+      ST(currentGCodeState).motionMode = STORE;
+    } else
+      ST(currentGCodeState).motionMode = ST(currentGCodeState).oldMotionMode;
+  }
+  if(have_gcode_code('G', GCODE_GROUP_OFFSET, NULL)) {
+    ST(currentGCodeState).system.offset.X = do_G_coordinate_math(
+        &ST(currentGCodeState).system, get_gcode_word_real('X'),
+        ST(currentGCodeState).system.offset.X, ST(currentGCodeState).system.gX,
         GCODE_AXIS_X);
-    currentGCodeState.system.offset.Y = do_G_coordinate_math(
-        &currentGCodeState.system, get_gcode_word_real('Y'),
-        currentGCodeState.system.offset.Y, currentGCodeState.system.gY,
+    ST(currentGCodeState).system.offset.Y = do_G_coordinate_math(
+        &ST(currentGCodeState).system, get_gcode_word_real('Y'),
+        ST(currentGCodeState).system.offset.Y, ST(currentGCodeState).system.gY,
         GCODE_AXIS_Y);
-    currentGCodeState.system.offset.Z = do_G_coordinate_math(
-        &currentGCodeState.system, get_gcode_word_real('Z'),
-        currentGCodeState.system.offset.Z, currentGCodeState.system.gZ,
+    ST(currentGCodeState).system.offset.Z = do_G_coordinate_math(
+        &ST(currentGCodeState).system, get_gcode_word_real('Z'),
+        ST(currentGCodeState).system.offset.Z, ST(currentGCodeState).system.gZ,
         GCODE_AXIS_Z);
-    currentGCodeState.axisWordsConsumed = true;
+    ST(currentGCodeState).axisWordsConsumed = true;
     update_parameter(GCODE_PARM_FIRST_LOCAL + GCODE_AXIS_X,
-                     currentGCodeState.system.offset.X);
+                     ST(currentGCodeState).system.offset.X);
     update_parameter(GCODE_PARM_FIRST_LOCAL + GCODE_AXIS_Y,
-                     currentGCodeState.system.offset.Y);
+                     ST(currentGCodeState).system.offset.Y);
     update_parameter(GCODE_PARM_FIRST_LOCAL + GCODE_AXIS_Z,
-                     currentGCodeState.system.offset.Z);
+                     ST(currentGCodeState).system.offset.Z);
     commit_parameters();
   }
-  if((arg = have_gcode_word('G', 6, GCODE_MOVE_RAPID, GCODE_MOVE_FEED,
-                            GCODE_MODE_ARC_CW, GCODE_MODE_ARC_CCW,
-                            GCODE_MODE_CIRCLE_CW, GCODE_MODE_CIRCLE_CCW))) {
+  if(have_gcode_code('G', GCODE_GROUP_MOVE, &arg)) {
     if(arg != GCODE_MOVE_RAPID && arg != GCODE_MOVE_FEED &&
-       currentGCodeState.motionMode != ARC) {
+       ST(currentGCodeState).motionMode != ARC) {
       /* Switching TO circular interpolation, ensure sane defaults */
-      currentGCodeState.I = currentGCodeState.J = currentGCodeState.K = 0.0;
-      currentGCodeState.R = NAN;
+      ST(currentGCodeState).I = ST(currentGCodeState).J =
+          ST(currentGCodeState).K = 0.0;
+      ST(currentGCodeState).R = NAN;
     }
-    currentGCodeState.motionMode = _map_move_to_motion(arg, &currentGCodeState.ccw);
-  }
-  if((arg = have_gcode_word('G', 13, GCODE_CYCLE_PROBE_IN,
-                            GCODE_CYCLE_PROBE_OUT, GCODE_CYCLE_DRILL_PP,
-                            GCODE_CYCLE_TAP_LH, GCODE_CYCLE_DRILL_ND,
-                            GCODE_CYCLE_DRILL_WD, GCODE_CYCLE_DRILL_PF,
-                            GCODE_CYCLE_TAP_RH, GCODE_CYCLE_BORING_ND_NS,
-                            GCODE_CYCLE_BORING_WD_WS, GCODE_CYCLE_BORING_BACK,
-                            GCODE_CYCLE_BORING_MANUAL,
-                            GCODE_CYCLE_BORING_WD_NS))) {
-    currentGCodeState.motionMode = CYCLE;
-    currentGCodeState.cycle = arg;
-  }
-  if((arg = have_gcode_word('M', 3, GCODE_SPINDLE_ORIENTATION,
-                            GCODE_INDEXER_STEP, GCODE_RETRACT_Z)))
+    ST(currentGCodeState).motionMode =
+        _map_move_to_motion(arg, &ST(currentGCodeState).ccw);
+  }
+  if(have_gcode_code('G', GCODE_GROUP_CYCLE, &arg)) {
+    ST(currentGCodeState).motionMode = CYCLE;
+    ST(currentGCodeState).cycle = arg;
+  }
+  if(have_gcode_code('M', GCODE_GROUP_AUXILIARY, &arg))
     move_machine_aux(arg, get_gcode_word_integer('P'));
-  if(have_gcode_word('G', 1, 65)) {
-    currentGCodeState.motionMode = MACRO;
-    currentGCodeState.macroCall = true;
+  if(have_gcode_code('G', GCODE_CODE(65), NULL)) {
+    ST(currentGCodeState).motionMode = MACRO;
+    ST(currentGCodeState).macroCall = true;
   }
   /* Sequence point: we read the axis words here and do the WCS math. All
    * axis-word-eating commands MUST be above this line and set
    * axisWordsConsumed to true.
    * Everything below this line will use whatever results from pushing the axis
    * word arguments through the current coordinate transformation. */
-  if(!currentGCodeState.axisWordsConsumed) {
-    if(currentGCodeState.motionMode != STORE &&
-       currentGCodeState.motionMode != MACRO &&
-       currentGCodeState.motionMode != OFF) {
+  if(!ST(currentGCodeState).axisWordsConsumed) {
+    if(ST(currentGCodeState).motionMode != STORE &&
+       ST(currentGCodeState).motionMode != MACRO &&
+       ST(currentGCodeState).motionMode != OFF) {
       wX = get_gcode_word_real('X');
       wY = get_gcode_word_real('Y');
       wZ = get_gcode_word_real('Z');
       if(isnan(wX) && isnan(wY) && isnan(wZ)) nullMove = true;
       else {
         nullMove = false;
-        if(currentGCodeState.motionMode == CYCLE) {
+        if(ST(currentGCodeState).motionMode == CYCLE) {
           /* Now pump the axis words through the start of the math pipeline */
           wX = current_or_zero_math(
-              wX, currentGCodeState.system.cX,
-              (currentGCodeState.system.absolute == GCODE_ABSOLUTE), isnan(wX));
+              wX, ST(currentGCodeState).system.cX,
+              (ST(currentGCodeState).system.absolute == GCODE_ABSOLUTE),
+              isnan(wX));
           wY = current_or_zero_math(
-              wY, currentGCodeState.system.cY,
-              (currentGCodeState.system.absolute == GCODE_ABSOLUTE), isnan(wY));
-          wZ = current_or_last_math(wZ, currentGCodeState.system.cZ);
-        } else move_math(&currentGCodeState.system, wX, wY, wZ);
+              wY, ST(currentGCodeState).system.cY,
+              (ST(currentGCodeState).system.absolute == GCODE_ABSOLUTE),
+              isnan(wY));
+          wZ = current_or_last_math(wZ, ST(currentGCodeState).system.cZ);
+        } else move_math(&ST(currentGCodeState).system, wX, wY, wZ);
       }
     }
 
-    switch(currentGCodeState.motionMode) {
+    switch(ST(currentGCodeState).motionMode) {
       case CYCLE:
         /* It's a canned cycle, fetch I,J,K,L,P,Q,R now for later */
-        if(!(currentGCodeState.cycle == GCODE_CYCLE_PROBE_IN ||
-             currentGCodeState.cycle == GCODE_CYCLE_PROBE_OUT)) {
+        if(!(ST(currentGCodeState).cycle == GCODE_CYCLE_PROBE_IN ||
+             ST(currentGCodeState).cycle == GCODE_CYCLE_PROBE_OUT)) {
           /* Number of repeats or "exactly once" if unspecified */
-          currentGCodeState.L = get_gcode_word_integer_default('L', 1);
+          ST(currentGCodeState).L = get_gcode_word_integer_default('L', 1);
           /* Retract level */
-          currentGCodeState.R = get_gcode_word_real_default('R', currentGCodeState.R);
-          if(currentGCodeState.cycle == GCODE_CYCLE_TAP_LH ||
-             currentGCodeState.cycle == GCODE_CYCLE_TAP_RH)
+          ST(currentGCodeState).R =
+              get_gcode_word_real_default('R', ST(currentGCodeState).R);
+          if(ST(currentGCodeState).cycle == GCODE_CYCLE_TAP_LH ||
+             ST(currentGCodeState).cycle == GCODE_CYCLE_TAP_RH)
             /* pitch of thread in units of length per revolution */
-            currentGCodeState.K = get_gcode_word_real_default('K', currentGCodeState.K);
-          if(currentGCodeState.cycle == GCODE_CYCLE_DRILL_WD ||
-             currentGCodeState.cycle == GCODE_CYCLE_BORING_WD_WS ||
-             currentGCodeState.cycle == GCODE_CYCLE_BORING_MANUAL ||
-             currentGCodeState.cycle == GCODE_CYCLE_BORING_WD_NS)
+            ST(currentGCodeState).K =
+                get_gcode_word_real_default('K', ST(currentGCodeState).K);
+          if(ST(currentGCodeState).cycle == GCODE_CYCLE_DRILL_WD ||
+             ST(currentGCodeState).cycle == GCODE_CYCLE_BORING_WD_WS ||
+             ST(currentGCodeState).cycle == GCODE_CYCLE_BORING_MANUAL ||
+             ST(currentGCodeState).cycle == GCODE_CYCLE_BORING_WD_NS)
             /* Dwell time */
-            currentGCodeState.P = get_gcode_word_real('P');
-          if(currentGCodeState.cycle == GCODE_CYCLE_DRILL_PP ||
-             currentGCodeState.cycle == GCODE_CYCLE_DRILL_PF)
+            ST(currentGCodeState).P = get_gcode_word_real('P');
+          if(ST(currentGCodeState).cycle == GCODE_CYCLE_DRILL_PP ||
+             ST(currentGCodeState).cycle == GCODE_CYCLE_DRILL_PF)
             /* Delta distance for chip breaking */
-            currentGCodeState.Q = get_gcode_word_real_default('Q', currentGCodeState.Q);
-          if(currentGCodeState.cycle == GCODE_CYCLE_BORING_BACK) {
+            ST(currentGCodeState).Q =
+                get_gcode_word_real_default('Q', ST(currentGCodeState).Q);
+          if(ST(currentGCodeState).cycle == GCODE_CYCLE_BORING_BACK) {
             /* How deep the back bore should be */
-            currentGCodeState.K = get_gcode_word_real_default('K', currentGCodeState.K);
+            ST(currentGCodeState).K =
+                get_gcode_word_real_default('K', ST(currentGCodeState).K);
             /* Where to enter the hole at so that the tool fits */
-            currentGCodeState.I = get_gcode_word_real_default('I', currentGCodeState.I);
-            currentGCodeState.J = get_gcode_word_real_default('J', currentGCodeState.J);
+            ST(currentGCodeState).I =
+                get_gcode_word_real_default('I', ST(currentGCodeState).I);
+            ST(currentGCodeState).J =
+                get_gcode_word_real_default('J', ST(currentGCodeState).J);
           }
         }
         break;
@@ -476,7 +616,7 @@ bool update_gcode_state(char *line) {
 
             tool.diameter = inch_math(
                 get_gcode_word_real('R'),
-                (currentGCodeState.system.units == GCODE_UNITS_INCH)) * 2.0;
+                (ST(currentGCodeState).system.units == GCODE_UNITS_INCH)) * 2.0;
             update_tool(tool);
           } break;
           case 2: {
@@ -485,38 +625,38 @@ bool update_gcode_state(char *line) {
             //TODO: consider whether G10 L2 should ignore previous G92 values
             update_parameter(
                 GCODE_PARM_FIRST_WCS + wcs + GCODE_AXIS_X,
-                do_G_coordinate_math(&currentGCodeState.system,
+                do_G_coordinate_math(&ST(currentGCodeState).system,
                                      get_gcode_word_real('X'),
-                                     currentGCodeState.system.offset.X,
-                                     currentGCodeState.system.gX,
+                                     ST(currentGCodeState).system.offset.X,
+                                     ST(currentGCodeState).system.gX,
                                      GCODE_AXIS_X));
             update_parameter(
                 GCODE_PARM_FIRST_WCS + wcs + GCODE_AXIS_Y,
-                do_G_coordinate_math(&currentGCodeState.system,
+                do_G_coordinate_math(&ST(currentGCodeState).system,
                                      get_gcode_word_real('Y'),
-                                     currentGCodeState.system.offset.Y,
-                                     currentGCodeState.system.gY,
+                                     ST(currentGCodeState).system.offset.Y,
+                                     ST(currentGCodeState).system.gY,
                                      GCODE_AXIS_Y));
             update_parameter(
                 GCODE_PARM_FIRST_WCS + wcs + GCODE_AXIS_Z,
-                do_G_coordinate_math(&currentGCodeState.system,
+                do_G_coordinate_math(&ST(currentGCodeState).system,
                                      get_gcode_word_real('Z'),
-                                     currentGCodeState.system.offset.Z,
-                                     currentGCodeState.system.gZ,
+                                     ST(currentGCodeState).system.offset.Z,
+                                     ST(currentGCodeState).system.gZ,
                                      GCODE_AXIS_Z));
             commit_parameters();
           } break;
           case 3: {
             TGCodeTool tool = fetch_tool(get_gcode_word_integer('P'));
 
-            if(have_gcode_word('H', 0))
+            if(have_gcode_word('H'))
               tool.length = inch_math(
                   get_gcode_word_real('H'),
-                  (currentGCodeState.system.units == GCODE_UNITS_INCH));
-            if(have_gcode_word('D', 0))
+                  (ST(currentGCodeState).system.units == GCODE_UNITS_INCH));
+            if(have_gcode_word('D'))
               tool.diameter = inch_math(
                   get_gcode_word_real('D'),
-                  (currentGCodeState.system.units == GCODE_UNITS_INCH));
+                  (ST(currentGCodeState).system.units == GCODE_UNITS_INCH));
             update_tool(tool);
           } break;
           default:
@@ -547,18 +687,22 @@ bool update_gcode_state(char *line) {
         break;
       case ARC:
         /* It's an arc or circle, fetch I,J,K,R */
-        currentGCodeState.I = inch_math(
-            current_or_last_math(get_gcode_word_real('I'), currentGCodeState.I),
-            (currentGCodeState.system.units == GCODE_UNITS_INCH));
-        currentGCodeState.J = inch_math(
-            current_or_last_math(get_gcode_word_real('J'), currentGCodeState.J),
-            (currentGCodeState.system.units == GCODE_UNITS_INCH));
-        currentGCodeState.K = inch_math(
-            current_or_last_math(get_gcode_word_real('K'), currentGCodeState.K),
-            (currentGCodeState.system.units == GCODE_UNITS_INCH));
-        currentGCodeState.R = inch_math(
-            current_or_last_math(get_gcode_word_real('R'), currentGCodeState.R),
-            (currentGCodeState.system.units == GCODE_UNITS_INCH));
+        ST(currentGCodeState).I = inch_math(
+            current_or_last_math(get_gcode_word_real('I'),
+                                 ST(currentGCodeState).I),
+            (ST(currentGCodeState).system.units == GCODE_UNITS_INCH));
+        ST(currentGCodeState).J = inch_math(
+            current_or_last_math(get_gcode_word_real('J'),
+                                 ST(currentGCodeState).J),
+            (ST(currentGCodeState).system.units == GCODE_UNITS_INCH));
+        ST(currentGCodeState).K = inch_math(
+            current_or_last_math(get_gcode_word_real('K'),
+                                 ST(currentGCodeState).K),
+            (ST(currentGCodeState).system.units == GCODE_UNITS_INCH));
+        ST(currentGCodeState).R = inch_math(
+            current_or_last_math(get_gcode_word_real('R'),
+                                 ST(currentGCodeState).R),
+            (ST(currentGCodeState).system.units == GCODE_UNITS_INCH));
         break;
       case OFF:
       case RAPID:
@@ -566,109 +710,117 @@ bool update_gcode_state(char *line) {
         /* Nothing extra to read from the command line */
         break;
     }
-  } else currentGCodeState.axisWordsConsumed = false;
+  } else ST(currentGCodeState).axisWordsConsumed = false;
 
   if(!nullMove) {
-   if(currentGCodeState.motionMode == RAPID ||
-     currentGCodeState.motionMode == LINEAR ||
-     currentGCodeState.motionMode == ARC) {
+   if(ST(currentGCodeState).motionMode == RAPID ||
+     ST(currentGCodeState).motionMode == LINEAR ||
+     ST(currentGCodeState).motionMode == ARC) {
       /* Otherwise, we don't know where the machine will be after this block */
-      update_parameter(GCODE_PARM_FIRST_CEOB + GCODE_AXIS_X, currentGCodeState.system.gX);
-      update_parameter(GCODE_PARM_FIRST_CEOB + GCODE_AXIS_Y, currentGCodeState.system.gY);
-      update_parameter(GCODE_PARM_FIRST_CEOB + GCODE_AXIS_Z, currentGCodeState.system.gZ);
+      update_parameter(GCODE_PARM_FIRST_CEOB + GCODE_AXIS_X,
+                       ST(currentGCodeState).system.gX);
+      update_parameter(GCODE_PARM_FIRST_CEOB + GCODE_AXIS_Y,
+                       ST(currentGCodeState).system.gY);
+      update_parameter(GCODE_PARM_FIRST_CEOB + GCODE_AXIS_Z,
+                       ST(currentGCodeState).system.gZ);
       commit_parameters();
     }
 
-    switch(currentGCodeState.motionMode) {
+    switch(ST(currentGCodeState).motionMode) {
       case RAPID:
-        move_machine_line(currentGCodeState.system.X,
-                          currentGCodeState.system.Y,
-                          currentGCodeState.system.Z, GCODE_FEED_PERMINUTE,
+        move_machine_line(ST(currentGCodeState).system.X,
+                          ST(currentGCodeState).system.Y,
+                          ST(currentGCodeState).system.Z, GCODE_FEED_PERMINUTE,
                           GCODE_MACHINE_FEED_TRAVERSE,
-                          currentGCodeState.system.radComp,
-                          currentGCodeState.system.corner);
+                          ST(currentGCodeState).system.radComp,
+                          ST(currentGCodeState).system.corner);
         break;
       case LINEAR:
-        move_machine_line(currentGCodeState.system.X,
-                          currentGCodeState.system.Y,
-                          currentGCodeState.system.Z,
-                          currentGCodeState.feedMode,
-                          currentGCodeState.F, currentGCodeState.system.radComp,
-                          currentGCodeState.system.corner);
+        move_machine_line(ST(currentGCodeState).system.X,
+                          ST(currentGCodeState).system.Y,
+                          ST(currentGCodeState).system.Z,
+                          ST(currentGCodeState).feedMode,
+                          ST(currentGCodeState).F,
+                          ST(currentGCodeState).system.radComp,
+                          ST(currentGCodeState).system.corner);
         break;
       case ARC:
         //TODO: implement full-circle as a repeat of arcs, add new move_machine_ call for that
-        move_machine_arc(currentGCodeState.system.X, currentGCodeState.system.Y,
-                         currentGCodeState.system.Z, currentGCodeState.I,
-                         currentGCodeState.J, currentGCodeState.K,
-                         currentGCodeState.R, currentGCodeState.ccw,
-                         currentGCodeState.system.plane,
-                         currentGCodeState.feedMode, currentGCodeState.F,
-                         currentGCodeState.system.radComp,
-                         currentGCodeState.system.corner);
+        move_machine_arc(ST(currentGCodeState).system.X,
+                         ST(currentGCodeState).system.Y,
+                         ST(currentGCodeState).system.Z,
+                         ST(currentGCodeState).I,
+                         ST(currentGCodeState).J, ST(currentGCodeState).K,
+                         ST(currentGCodeState).R, ST(currentGCodeState).ccw,
+                         ST(currentGCodeState).system.plane,
+                         ST(currentGCodeState).feedMode,
+                         ST(currentGCodeState).F,
+                         ST(currentGCodeState).system.radComp,
+                         ST(currentGCodeState).system.corner);
         break;
       case CYCLE:
         /* Save contents of c[XYZ] to restore them when the cycle is done */
-        cX = wX;
-        cY = wY;
-        cZ = wZ;
+        ST(cycleX) = wX;
+        ST(cycleY) = wY;
+        ST(cycleZ) = wZ;
 
         /* Save lastZ in case we're in G98 */
-        if(currentGCodeState.system.absolute == GCODE_ABSOLUTE)
-          lastZ = currentGCodeState.system.cZ;
+        if(ST(currentGCodeState).system.absolute == GCODE_ABSOLUTE)
+          ST(lastZ) = ST(currentGCodeState).system.cZ;
         else
-          lastZ = (fpclassify(currentGCodeState.R) == FP_ZERO ?
-                   0.0 : -currentGCodeState.R);
+          ST(lastZ) = (fpclassify(ST(currentGCodeState).R) == FP_ZERO ?
+                       0.0 : -ST(currentGCodeState).R);
 
         /* Determine whether we need the initial preparatory move */
-        if(currentGCodeState.system.absolute == GCODE_ABSOLUTE)
-          if(currentGCodeState.system.cZ < currentGCodeState.R)
+        if(ST(currentGCodeState).system.absolute == GCODE_ABSOLUTE)
+          if(ST(currentGCodeState).system.cZ < ST(currentGCodeState).R)
             toRFirst = true;
           else
             toRFirst = false;
-        else if(currentGCodeState.R > 0.0)
+        else if(ST(currentGCodeState).R > 0.0)
             toRFirst = true;
           else
             toRFirst = false;
         /* And then do it if we do */
         if(toRFirst) {
-          move_math(&currentGCodeState.system, NAN, NAN, currentGCodeState.R);
-          move_machine_line(currentGCodeState.system.X,
-                            currentGCodeState.system.Y,
-                            currentGCodeState.system.Z, GCODE_FEED_PERMINUTE,
+          move_math(&ST(currentGCodeState).system, NAN, NAN,
+                    ST(currentGCodeState).R);
+          move_machine_line(ST(currentGCodeState).system.X,
+                            ST(currentGCodeState).system.Y,
+                            ST(currentGCodeState).system.Z,
+                            GCODE_FEED_PERMINUTE,
                             GCODE_MACHINE_FEED_TRAVERSE,
-                            currentGCodeState.system.radComp,
-                            currentGCodeState.system.corner);
+                            ST(currentGCodeState).system.radComp,
+                            ST(currentGCodeState).system.corner);
           /* Erase our tracks */
-          if(currentGCodeState.system.absolute == GCODE_RELATIVE)
-            currentGCodeState.R = 0; /* Since we're now at R */
+          if(ST(currentGCodeState).system.absolute == GCODE_RELATIVE)
+            ST(currentGCodeState).R = 0; /* Since we're now at R */
         }
 
         /* Insert the cycle */
-        splice_input(generate_cycles(currentGCodeState, wX, wY, wZ));
+        splice_input(generate_cycles(ST(currentGCodeState), wX, wY, wZ));
         break;
       default:
         /*NOP*/;
         break;
     }
   }
-  if(currentGCodeState.nonModalPathMode && currentGCodeState.motionMode != OFF) {
-    select_pathmode_machine(currentGCodeState.oldPathMode);
-    currentGCodeState.nonModalPathMode = false;
+  if(ST(currentGCodeState).nonModalPathMode &&
+     ST(currentGCodeState).motionMode != OFF) {
+    select_pathmode_machine(ST(currentGCodeState).oldPathMode);
+    ST(currentGCodeState).nonModalPathMode = false;
   }
-  if(currentGCodeState.system.current == GCODE_MCS) {
-    currentGCodeState.system.current = currentGCodeState.system.oldCurrent;
-    set_parameter(GCODE_PARM_CURRENT_WCS, currentGCodeState.system.current);
+  if(ST(currentGCodeState).system.current == GCODE_MCS) {
+    ST(currentGCodeState).system.current =
+        ST(currentGCodeState).system.oldCurrent;
+    set_parameter(GCODE_PARM_CURRENT_WCS, ST(currentGCodeState).system.current);
   }
   process_gcode_parameters();
-  if((arg = have_gcode_word('M', 10, GCODE_STOP_COMPULSORY, GCODE_STOP_OPTIONAL,
-                            GCODE_STOP_END, GCODE_SERVO_ON, GCODE_SERVO_OFF,
-                            GCODE_STOP_RESET, GCODE_STOP_E, GCODE_APC_1,
-                            GCODE_APC_2, GCODE_APC_SWAP)))
+  if(have_gcode_code('M', GCODE_GROUP_STOP, &arg))
     switch(arg) {
       case GCODE_STOP_E:
         enable_power_machine(GCODE_SERVO_OFF);
-      case GCODE_STOP_COMPULSORY + 100: /* Returned as 100 by have_gcode_word() */
+      case GCODE_STOP_COMPULSORY:
       case GCODE_STOP_OPTIONAL:
         do_stop_machine(arg);
         break;
@@ -676,7 +828,7 @@ bool update_gcode_state(char *line) {
         rewind_input();
       case GCODE_STOP_END:
         GCODE_DEBUG("Reached end of program flow, exiting ...")
-        stillRunning = false;
+        ST(stillRunning) = false;
         break;
       case GCODE_SERVO_ON:
       case GCODE_SERVO_OFF:
@@ -689,28 +841,41 @@ bool update_gcode_state(char *line) {
         do_stop_machine(GCODE_STOP_COMPULSORY);
         break;
     }
-  if(have_gcode_word('M', 1, 47)) rewind_input();
-  if(have_gcode_word('M', 1, 98)) {
+  if(have_gcode_code('M', GCODE_CODE(GCODE_CHECKPOINT_CODE), NULL))
+    request_checkpoint();
+  if(have_gcode_code('M', GCODE_CODE(47), NULL) && !rewind_input()) {
+    // Ending here is all M30 does anyway, M47 can't go on from anywhere else
+    display_machine_message("PER: Unable to go back to the start of the program!");
+    ST(stillRunning) = false;
+  }
+  if(have_gcode_code('M', GCODE_CODE(98), NULL)) {
     TProgramPointer programState;
+    long offset;
 
     // Set current offset (which is after the line containing the M98)
     programState.programCounter = tell_input();
     // Set current status
-    programState.macroCall = currentGCodeState.macroCall;
+    programState.macroCall = ST(currentGCodeState).macroCall;
     // We don't care about this repeatCount, the next one is checked
     programState.repeatCount = 0;
     stacks_push_program(&programState);
-    seek_input(get_program_input(get_gcode_word_integer('P')));
+    // Going on anywhere else would be worse than stopping, input said why
+    if(!(offset = get_program_input(get_gcode_word_integer('P'))) ||
+       !seek_input(offset)) {
+      ST(stillRunning) = false;
+      return false;
+    }
     // Reset our status
-    currentGCodeState.macroCall = false;
+    ST(currentGCodeState).macroCall = false;
     // Set the repeat count, note that we're still working on the original line
     // even if the input has been fseek()-ed elsewhere.
-    programState.repeatCount = (have_gcode_word('L', 0) ? get_gcode_word_integer('L') : 1);
+    programState.repeatCount = (have_gcode_word('L') ? get_gcode_word_integer('L') : 1);
     // Set current line for a possible repeat
     programState.programCounter = tell_input();
     stacks_push_program(&programState);
+    call_subprogram(programState.programCounter);
   }
-  if(have_gcode_word('M', 1, 99)) {
+  if(have_gcode_code('M', GCODE_CODE(99), NULL)) {
     TProgramPointer programState;
 
     // Either way, we have to look
@@ -719,12 +884,19 @@ bool update_gcode_state(char *line) {
       // We still have iterations to go, push updated repeatCount back ...
       stacks_push_program(&programState);
       // ... and jump
-      seek_input(programState.programCounter);
+      if(!seek_input(programState.programCounter)) {
+        ST(stillRunning) = false;
+        return false;
+      }
+      call_subprogram(programState.programCounter);
     } else {
       // Done looping, pop previous status
       stacks_pop_program(&programState);
       // Return to caller
-      seek_input(programState.programCounter);
+      if(!seek_input(programState.programCounter)) {
+        ST(stillRunning) = false;
+        return false;
+      }
       // ... and since we restore #1-33 here, we don't care about restoring
       // currenGCodeState.macroCall as well
       if(programState.macroCall) stacks_pop_parameters();
@@ -733,31 +905,61 @@ bool update_gcode_state(char *line) {
  /* Have we just popped back to the real world? */
   if(end_of_spliced_input()) {
     /* We were only spliced during a cycle, hence we always return to CYCLE */
-    currentGCodeState.motionMode = CYCLE;
+    ST(currentGCodeState).motionMode = CYCLE;
 
     /* The cycle left us at R, but G98 mandates a return to last Z */
-    if(currentGCodeState.retractMode == GCODE_RETRACT_LAST) {
-      move_math(&currentGCodeState.system, NAN, NAN, lastZ);
-      move_machine_line(currentGCodeState.system.X, currentGCodeState.system.Y,
-                        currentGCodeState.system.Z, GCODE_FEED_PERMINUTE,
+    if(ST(currentGCodeState).retractMode == GCODE_RETRACT_LAST) {
+      move_math(&ST(currentGCodeState).system, NAN, NAN, ST(lastZ));
+      move_machine_line(ST(currentGCodeState).system.X,
+                        ST(currentGCodeState).system.Y,
+                        ST(currentGCodeState).system.Z, GCODE_FEED_PERMINUTE,
                         GCODE_MACHINE_FEED_TRAVERSE,
-                        currentGCodeState.system.radComp,
-                        currentGCodeState.system.corner);
+                        ST(currentGCodeState).system.radComp,
+                        ST(currentGCodeState).system.corner);
     }
 
     /* Restore contents of c[XYZ] to what they were during the cycle block */
-    currentGCodeState.system.cX = cX;
-    currentGCodeState.system.cY = cY;
-    currentGCodeState.system.cZ = cZ;
+    ST(currentGCodeState).system.cX = ST(cycleX);
+    ST(currentGCodeState).system.cY = ST(cycleY);
+    ST(currentGCodeState).system.cZ = ST(cycleZ);
   }
 
   return true;
 }
 
+/* An expression result, maybe signed, in place of a number. Those used to be
+ * printed into the block, what didn't print as a number still reads as 0 */
+static bool _read_gcode_value(const char *line, double *value) {
+  bool negative = false;
+
+  if(*line == '+' || *line == '-') negative = (*line++ == '-');
+  if(*line != GCODE_INPUT_VALUE) return false;
+  *value = fetch_value_input(line);
+  if(!isfinite(*value)) *value = 0.0;
+  else if(negative) *value = -*value;
+
+  return true;
+}
+
+/* Expression results where an integer is expected: within
+ * GCODE_INTEGER_THRESHOLD of one they are that one, anything else is cut
+ * short like a literal. Saturates like atol() */
+static uint32_t _gcode_value_integer(double value) {
+  double whole = nearbyint(value);
+
+  if(fabs(value - whole) >= GCODE_INTEGER_THRESHOLD) whole = trunc(value);
+  if(whole >= (double)LONG_MAX) return (uint32_t)LONG_MAX;
+  else if(whole <= (double)LONG_MIN) return (uint32_t)LONG_MIN;
+  else return (uint32_t)(long)whole;
+}
+
 /* This handles using a parameter in lieu of a numeric value transparently */
 uint32_t read_gcode_integer(const char *line) {
+  double value;
+
   if(line[0] == '#')
     return (uint32_t)fetch_parameter(read_gcode_integer(&line[1]));
+  else if(_read_gcode_value(line, &value)) return _gcode_value_integer(value);
   else
     /* atol() calls strtol() with an explicit base of 10, therefore (1) any
      * non-digit character will stop the conversion and (2) an initial 0 will
@@ -765,68 +967,161 @@ uint32_t read_gcode_integer(const char *line) {
     return atol(line);
 }
 
+/* Falls back to strtod() for what _parse_gcode_real() can't do exactly */
+static double _strtod_gcode_real(const char *line, const char *end) {
+  /* This is needed because strtod() guesses at the base of the number it
+   * parses (yes, there is such a thing as a hex-encoded floating point
+   * number!) and would take a following E word for an exponent, so we need to
+   * explicitly force it to only look at what we fed it by terminating the
+   * string where the G-Code-style number ends. */
+  char buffer[GCODE_REAL_DIGITS + 1], *theNumber = buffer;
+  double result;
+
+  if(end - line > GCODE_REAL_DIGITS &&
+     !(theNumber = calloc(end - line + 1, 1))) {
+    /* Read what fits, it still is a number */
+    display_machine_message("IER: Out of memory reading number!");
+    theNumber = buffer;
+    end = &line[GCODE_REAL_DIGITS];
+  }
+  memcpy(theNumber, line, end - line);
+  theNumber[end - line] = '\0';
+
+  result = strtod(theNumber, (char **)NULL);
+
+  if(theNumber != buffer) free(theNumber);
+
+  return result;
+}
+
+/* Reads [+-]digits[.digits] straight from line. The digits, less leading and
+ * trailing zeros, make up an integer mantissa and a power of ten; as long as
+ * both are exact doubles a single multiplication or division rounds exactly
+ * like strtod() does (Clinger's fast path). Anything else goes to strtod() */
+static double _parse_gcode_real(const char *line) {
+  static const double powers[] = {
+    1.0E+0, 1.0E+1, 1.0E+2, 1.0E+3, 1.0E+4, 1.0E+5, 1.0E+6, 1.0E+7, 1.0E+8,
+    1.0E+9, 1.0E+10, 1.0E+11, 1.0E+12, 1.0E+13, 1.0E+14, 1.0E+15, 1.0E+16,
+    1.0E+17, 1.0E+18, 1.0E+19, 1.0E+20, 1.0E+21, 1.0E+22
+  };
+  const char *at = line;
+  uint64_t mantissa = 0;
+  /* Significant digits, zeros not yet known to be significant, digits after
+   * the decimal point */
+  int digits = 0, zeros = 0, fraction = 0, exponent;
+  bool negative = false, fractional = false, seen = false, exact = true;
+  double result;
+
+  if(*at == '+' || *at == '-') negative = (*at++ == '-');
+  for(;; at++) {
+    if(*at == '.' && !fractional) {
+      fractional = true;
+      continue;
+    } else if(*at < '0' || *at > '9') break;
+
+    seen = true;
+    if(fractional) fraction++;
+    if(*at == '0') zeros++;
+    else {
+      /* Zeros in between count after all, leading ones never do. 19 digits
+       * always fit in 64 bits */
+      if(!digits) zeros = 0;
+      if(digits + zeros + 1 > 19) exact = false;
+      else {
+        digits += zeros + 1;
+        for(; zeros; zeros--) mantissa *= 10;
+        mantissa = mantissa * 10 + (*at - '0');
+      }
+      zeros = 0;
+    }
+  }
+  /* strtod() says 0 if it didn't find any digits at all */
+  if(!seen) return 0.0;
+  if(!mantissa) return (negative ? -0.0 : 0.0);
+
+  /* Trailing zeros are a power of ten */
+  exponent = zeros - fraction;
+  if(exact && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+    result = (exponent < 0 ? (double)mantissa / powers[-exponent] :
+                             (double)mantissa * powers[exponent]);
+    return (negative ? -result : result);
+  } else return _strtod_gcode_real(line, at);
+}
+
 /* This handles using a parameter in lieu of a numeric value transparently */
 double read_gcode_real(const char *line) {
+  double value;
+
   if(line[0] == '#') return fetch_parameter(read_gcode_integer(&line[1]));
-  else {
-    /* This is needed because strtod() guesses at the base of the number it
-     * parses (yes, there is such a thing as a hex-encoded floating point
-     * number!) so we need to explicitly force it to only look at what we fed
-     * it by terminating the string where the G-Code-style number ends. */
-    char *theNumber;
-    const char *endPtr;
-    double result;
+  else if(_read_gcode_value(line, &value)) return value;
+  else return _parse_gcode_real(line);
+}
+
+size_t decode_gcode_words(const char *text, size_t length, TGCodeWord *words,
+                          bool *clean) {
+  const char *at = text, *end = &text[length], *literal;
+  TGCodeWord *word;
+  size_t w = 0;
 
-    endPtr = skip_gcode_digits(line);
-    theNumber = calloc(endPtr - line + 1, 1);
-    strncpy(theNumber, line, endPtr - line);
+  *clean = true;
+  while(at < end) {
+    if(gcode_letter_slot(*at) < 0) {
+      *clean = false;
+      at++;
+      continue;
+    }
+    word = &words[w++];
+    word->letter = *at++;
+    word->indirection = 0;
+    for(literal = at; *literal == '#'; literal++) word->indirection++;
+    /* What read_gcode_integer() and read_gcode_real() end up reading */
+    if(_read_gcode_value(literal, &word->value)) {
+      word->integer = _gcode_value_integer(word->value);
+      if(word->indirection) word->value = word->integer;
+    } else {
+      word->integer = (uint32_t)atol(literal);
+      word->value = (word->indirection ? word->integer :
+                     _parse_gcode_real(literal));
+    }
+    /* Never skips a letter, so every one of them starts a word */
+    at = skip_gcode_number(at);
+  }
 
-    result = strtod(theNumber, (char **)NULL);
+  return w;
+}
 
-    free(theNumber);
+bool paired_gcode_words(const TGCodeWord *words, size_t count) {
+  const TGCodeWord *word;
 
-    return result;
+  for(word = words; word < &words[count]; word++) {
+    if(word->letter == '=' && (word == words || word[-1].letter != '#'))
+      return false;
+    if(word->letter != '=' && word > words && word[-1].letter == '#')
+      return false;
   }
+
+  return !count || words[count - 1].letter != '#';
 }
 
-uint8_t have_gcode_word(char word, uint8_t argc, ...) {
-  va_list argv;
-  uint8_t result;
-  bool found = false;
-  char *last;
-
-  if(!_refresh_gcode_parse_cache(word)) return false; /* No such word */
-  else if(!argc) return true; /* We were only testing presence */
-  else if(argc == 1) { /* Special case: single target, no need to loop */
-    va_start(argv, argc);
-    result = ((uint8_t)read_gcode_integer(&parseCache.at[1]) == (uint8_t)va_arg(argv, int));
-    va_end(argv);
-
-    return result;
-  } else { /* Generic case: loop through targets */
-    va_start(argv, argc);
-
-    while(!found && argc--) {
-      last = parseCache.at;
-      result = (uint8_t)va_arg(argv, int);
-      while(last){
-        if((uint8_t)read_gcode_integer(&last[1]) == result) {
-          if(!result) result = 100; /* Special case: tell 0 apart from false */
-          found = true;
-          break;
-        }
-        last = strchr(&last[1], word);
-      }
-    }
+bool have_gcode_word(char word) {
+  return _first_gcode_word(word) != NULL;
+}
 
-    va_end(argv);
-    return (found ? result : false);
-  }
+bool have_gcode_code(char word, TGCodeCodeMask group, uint8_t *code) {
+  TGCodeCodeMask found = _gcode_codes(word) & group;
+
+  if(!found) return false;
+  if(code)
+    *code = ((uint64_t)found ? __builtin_ctzll((uint64_t)found) :
+             64 + __builtin_ctzll((uint64_t)(found >> 64)));
+
+  return true;
 }
 
 double get_gcode_word_real(char word) {
-  if(!_refresh_gcode_parse_cache(word)) return NAN;
-  else return read_gcode_real(&parseCache.at[1]);
+  const TGCodeWord *first = _first_gcode_word(word);
+
+  return (first ? _gcode_word_real(first) : NAN);
 }
 
 double get_gcode_word_real_default(char word, double defVal) {
@@ -837,8 +1132,9 @@ double get_gcode_word_real_default(char word, double defVal) {
 }
 
 uint32_t get_gcode_word_integer(char word) {
-  if(!_refresh_gcode_parse_cache(word)) return UINT32_MAX;
-  else return read_gcode_integer(&parseCache.at[1]);
+  const TGCodeWord *first = _first_gcode_word(word);
+
+  return (first ? _gcode_word_integer(first) : UINT32_MAX);
 }
 
 uint32_t get_gcode_word_integer_default(char word, uint32_t defVal) {
@@ -851,27 +1147,40 @@ uint32_t get_gcode_word_integer_default(char word, uint32_t defVal) {
 /* This handles parameter assignments */
 bool process_gcode_parameters(void) {
   const char *cchr;
+  const TGCodeWord *word;
   uint16_t param;
   double value = NAN;
 
   /* Is there any work for us to do? */
-  if(have_gcode_word('=', 0) && have_gcode_word('#', 0)) {
+  if(have_gcode_word('=')) {
     // Potentially ... (we could have something like "G01 X#12 #3=2")
     // We cannot make use of read_gcode_* because we could have multiple
     // occurrences of "#"
-    // The last have_gcode_word() call left parseCache.at pointing at the
-    // first parameter reference, that's where we begin
-    cchr = parseCache.at;
-    while(cchr) {
+    if(ST(wordTable).compiled) {
+      // gcode-compiler only decodes lines where these come in strict pairs
+      for(word = _first_gcode_word('#'); word &&
+          &word[1] < ST(wordTable).wordsEnd;
+          word++)
+        if(word->letter == '#' && word[1].letter == '=') {
+          value = _gcode_word_real(&word[1]);
+          update_parameter(_gcode_word_integer(word), value);
+          word++;
+        }
+      cchr = NULL;
+    } else // Text is scanned from the first parameter reference on
+      cchr = (const char *)memchr(ST(wordTable).line, '#',
+                                  ST(wordTable).end - ST(wordTable).line);
+    while(cchr && cchr < ST(wordTable).end) {
       /* This is parameter-aware, indirection "just works" */
       param = read_gcode_integer(&cchr[1]);
-      cchr = skip_gcode_digits(&cchr[1]);
+      cchr = skip_gcode_number(&cchr[1]);
       if(*cchr == '=') { // Is this an assignment?
         /* This is also parameter-aware, indirection "just works" */
         value = read_gcode_real(&cchr[1]);
-        cchr = skip_gcode_digits(&cchr[1]);
+        cchr = skip_gcode_number(&cchr[1]);
         update_parameter(param, value);
-      } else cchr = strchr(cchr, '#'); // No, move on to the next parameter
+      } else // No, move on to the next parameter
+        cchr = (const char *)memchr(cchr, '#', ST(wordTable).end - cchr);
     }
     if(!isnan(value)) {
       commit_parameters(); // We set at least one
@@ -881,5 +1190,14 @@ bool process_gcode_parameters(void) {
 }
 
 bool gcode_running(void) {
-  return stillRunning;
+  return ST(stillRunning);
+}
+
+bool collapsible_gcode_state(void) {
+  /* Where a straight move ends then only depends on its own axis words */
+  return (ST(currentGCodeState).motionMode == RAPID ||
+          ST(currentGCodeState).motionMode == LINEAR) &&
+         ST(currentGCodeState).system.absolute == GCODE_ABSOLUTE &&
+         ST(currentGCodeState).system.cartesian == GCODE_CARTESIAN &&
+         ST(currentGCodeState).system.radComp.mode == GCODE_COMP_RAD_OFF;
 }
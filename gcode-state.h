@@ -16,11 +16,15 @@
 #include <stdint.h>
 
 #include "gcode-commons.h"
+#include "gcode-input.h"
 
 
 #define GCODE_STATE_PF_ABSOLUTE 0x40
 #define GCODE_STATE_PF_IMPERIAL 0x10
 
+/* Word letters there is a slot for in a TGCodeWordTable */
+#define GCODE_STATE_LETTERS 28
+
 
 typedef enum {
   OFF,
@@ -56,8 +60,7 @@ typedef enum {
   GCODE_MODE_ARC_CW = 2,
   GCODE_MODE_ARC_CCW = 3,
   GCODE_MODE_CIRCLE_CW = 12,
-  GCODE_MODE_CIRCLE_CCW = 13,
-  GCODE_MOVE_RAPID_AS_RETURNED = 100
+  GCODE_MODE_CIRCLE_CCW = 13
 } TGCodeMoveMode;
 
 typedef enum {
@@ -86,8 +89,7 @@ typedef enum {
   GCODE_STOP_E = 36,
   GCODE_APC_1 = 57,
   GCODE_APC_2 = 58,
-  GCODE_APC_SWAP = 60,
-  GCODE_STOP_COMPULSORY_AS_RETURNED = 100
+  GCODE_APC_SWAP = 60
 } TGCodeStopMode;
 
 typedef enum {
@@ -206,6 +208,84 @@ typedef enum {
   GCODE_CYCLE_PROBE_OUT = 38
 } TGCodeAuxiliaryMachine;
 
+/* A set of G or M codes, bit per code. Everything we act upon is below 128 */
+typedef unsigned __int128 TGCodeCodeMask;
+
+#define GCODE_CODE(code) ((TGCodeCodeMask)1 << (code))
+
+/* Codes update_gcode_state() looks for together, mostly modal groups */
+#define GCODE_GROUP_FEED (GCODE_CODE(GCODE_FEED_INVTIME) | \
+    GCODE_CODE(GCODE_FEED_PERMINUTE) | GCODE_CODE(GCODE_FEED_PERREVOLUTION))
+#define GCODE_GROUP_PROBE_INPUT (GCODE_CODE(GCODE_PROBE_TOOL) | \
+    GCODE_CODE(GCODE_PROBE_PART))
+#define GCODE_GROUP_PROBE_MODE (GCODE_CODE(GCODE_PROBE_ONETOUCH) | \
+    GCODE_CODE(GCODE_PROBE_TWOTOUCH))
+#define GCODE_GROUP_SPINDLE (GCODE_CODE(GCODE_SPINDLE_CW) | \
+    GCODE_CODE(GCODE_SPINDLE_CCW) | GCODE_CODE(GCODE_SPINDLE_STOP))
+#define GCODE_GROUP_COOLANT (GCODE_CODE(GCODE_COOL_MIST) | \
+    GCODE_CODE(GCODE_COOL_FLOOD) | GCODE_CODE(GCODE_COOL_OFF_MF) | \
+    GCODE_CODE(GCODE_COOL_SHOWER) | GCODE_CODE(GCODE_COOL_OFF_S))
+#define GCODE_GROUP_COOLANT_AND_SPINDLE (GCODE_CODE(GCODE_COOLSPIN_CW) | \
+    GCODE_CODE(GCODE_COOLSPIN_CCW))
+#define GCODE_GROUP_OVERRIDE (GCODE_CODE(GCODE_OVERRIDE_ON) | \
+    GCODE_CODE(GCODE_OVERRIDE_OFF))
+#define GCODE_GROUP_PLANE (GCODE_CODE(GCODE_PLANE_XY) | \
+    GCODE_CODE(GCODE_PLANE_ZX) | GCODE_CODE(GCODE_PLANE_YZ))
+#define GCODE_GROUP_UNITS (GCODE_CODE(GCODE_UNITS_INCH) | \
+    GCODE_CODE(GCODE_UNITS_METRIC))
+#define GCODE_GROUP_RAD_COMP (GCODE_CODE(GCODE_COMP_RAD_OFF) | \
+    GCODE_CODE(GCODE_COMP_RAD_L) | GCODE_CODE(GCODE_COMP_RAD_R))
+#define GCODE_GROUP_CORNER (GCODE_CODE(GCODE_CORNER_CHAMFER) | \
+    GCODE_CODE(GCODE_CORNER_FILLET))
+#define GCODE_GROUP_LEN_COMP (GCODE_CODE(GCODE_COMP_LEN_N) | \
+    GCODE_CODE(GCODE_COMP_LEN_P) | GCODE_CODE(GCODE_COMP_LEN_OFF))
+#define GCODE_GROUP_SYSTEM (GCODE_CODE(GCODE_MCS) | GCODE_CODE(GCODE_WCS_1) | \
+    GCODE_CODE(GCODE_WCS_2) | GCODE_CODE(GCODE_WCS_3) | \
+    GCODE_CODE(GCODE_WCS_4) | GCODE_CODE(GCODE_WCS_5) | GCODE_CODE(GCODE_WCS_6))
+#define GCODE_GROUP_MIRROR_MACHINE (GCODE_CODE(GCODE_MIRROR_X) | \
+    GCODE_CODE(GCODE_MIRROR_Y) | GCODE_CODE(GCODE_MIRROR_OFF_M))
+#define GCODE_GROUP_MIRROR (GCODE_CODE(GCODE_MIRROR_ON) | \
+    GCODE_CODE(GCODE_MIRROR_OFF_S))
+#define GCODE_GROUP_ROTATION (GCODE_CODE(GCODE_ROTATION_ON) | \
+    GCODE_CODE(GCODE_ROTATION_OFF))
+#define GCODE_GROUP_PATH (GCODE_CODE(GCODE_EXACTSTOPCHECK_ON) | \
+    GCODE_CODE(GCODE_EXACTSTOPCHECK_OFF))
+#define GCODE_GROUP_ABSOLUTE (GCODE_CODE(GCODE_ABSOLUTE) | \
+    GCODE_CODE(GCODE_RELATIVE))
+#define GCODE_GROUP_POLAR (GCODE_CODE(GCODE_CARTESIAN) | \
+    GCODE_CODE(GCODE_POLAR))
+#define GCODE_GROUP_SCALING (GCODE_CODE(GCODE_SCALING_OFF) | \
+    GCODE_CODE(GCODE_SCALING_ON))
+#define GCODE_GROUP_RETRACT (GCODE_CODE(GCODE_RETRACT_LAST) | \
+    GCODE_CODE(GCODE_RETRACT_R))
+#define GCODE_GROUP_HOME (GCODE_CODE(GCODE_CYCLE_HOME) | \
+    GCODE_CODE(GCODE_CYCLE_RETURN) | GCODE_CODE(GCODE_CYCLE_ZERO) | \
+    GCODE_CODE(GCODE_CYCLE_CANCEL))
+#define GCODE_GROUP_DATA (GCODE_CODE(GCODE_DATA_ON) | GCODE_CODE(GCODE_DATA_OFF))
+/* G52 and G92 */
+#define GCODE_GROUP_OFFSET (GCODE_CODE(52) | GCODE_CODE(92))
+#define GCODE_GROUP_MOVE (GCODE_CODE(GCODE_MOVE_RAPID) | \
+    GCODE_CODE(GCODE_MOVE_FEED) | GCODE_CODE(GCODE_MODE_ARC_CW) | \
+    GCODE_CODE(GCODE_MODE_ARC_CCW) | GCODE_CODE(GCODE_MODE_CIRCLE_CW) | \
+    GCODE_CODE(GCODE_MODE_CIRCLE_CCW))
+#define GCODE_GROUP_CYCLE (GCODE_CODE(GCODE_CYCLE_PROBE_IN) | \
+    GCODE_CODE(GCODE_CYCLE_PROBE_OUT) | GCODE_CODE(GCODE_CYCLE_DRILL_PP) | \
+    GCODE_CODE(GCODE_CYCLE_TAP_LH) | GCODE_CODE(GCODE_CYCLE_DRILL_ND) | \
+    GCODE_CODE(GCODE_CYCLE_DRILL_WD) | GCODE_CODE(GCODE_CYCLE_DRILL_PF) | \
+    GCODE_CODE(GCODE_CYCLE_TAP_RH) | GCODE_CODE(GCODE_CYCLE_BORING_ND_NS) | \
+    GCODE_CODE(GCODE_CYCLE_BORING_WD_WS) | \
+    GCODE_CODE(GCODE_CYCLE_BORING_BACK) | \
+    GCODE_CODE(GCODE_CYCLE_BORING_MANUAL) | \
+    GCODE_CODE(GCODE_CYCLE_BORING_WD_NS))
+#define GCODE_GROUP_AUXILIARY (GCODE_CODE(GCODE_SPINDLE_ORIENTATION) | \
+    GCODE_CODE(GCODE_INDEXER_STEP) | GCODE_CODE(GCODE_RETRACT_Z))
+#define GCODE_GROUP_STOP (GCODE_CODE(GCODE_STOP_COMPULSORY) | \
+    GCODE_CODE(GCODE_STOP_OPTIONAL) | GCODE_CODE(GCODE_STOP_END) | \
+    GCODE_CODE(GCODE_SERVO_ON) | GCODE_CODE(GCODE_SERVO_OFF) | \
+    GCODE_CODE(GCODE_STOP_RESET) | GCODE_CODE(GCODE_STOP_E) | \
+    GCODE_CODE(GCODE_APC_1) | GCODE_CODE(GCODE_APC_2) | \
+    GCODE_CODE(GCODE_APC_SWAP))
+
 typedef struct {
   TGCodeMirrorSystem mode;
   double X, Y, Z;
@@ -271,35 +351,69 @@ typedef struct {
   uint8_t T;
 } TGCodeState;
 
+/* Every block is decoded once into this and all word queries are answered
+ * from it. Words either come pre-decoded or get split out of the text */
+typedef struct TGCodeWordTable {
+  const char *line, *end; /* Object of analysis */
+  const TGCodeWord *words, *wordsEnd;
+  const TGCodeWord *first[GCODE_STATE_LETTERS]; /* A to Z, # and =, or NULL */
+  TGCodeCodeMask G, M; /* Codes present, bit per (uint8_t) argument */
+  bool indirectG, indirectM; /* Some codes are only known at query time */
+  bool compiled; /* Words came pre-decoded */
+  /* Gathered while decoding, for gcode-checker. Bit per slot of first */
+  uint32_t letters, repeated;
+  bool repeatedG, repeatedM; /* Same code given twice */
+  bool clean; /* Nothing but words */
+  bool pending; /* Loaded ahead of update_gcode_state() */
+} TGCodeWordTable;
+
 typedef struct {
-  char *line; /* Object of last analysis */
-  char word; /* Last word requested */
-  char *at; /* If found, where in line? */
-} TGCodeWordCache;
+  TGCodeWordTable wordTable;
+  /* Words split out of text blocks, reused for every block */
+  TGCodeWord *textWords;
+  size_t textWordsRoom;
+  TGCodeState currentGCodeState;
+  bool stillRunning;
+  /* c[XYZ] of the block that started a canned cycle and its G98 level */
+  double cycleX, cycleY, cycleZ, lastZ;
+} TGCodeStateContext;
 
 
 bool init_gcode_state(void *data);
-/* Process one line of G-Code. Note that line has already been sanitized by
+/* Process one block of G-Code. Note that block has already been sanitized by
  * gcode-input. Returns false on error */
-bool update_gcode_state(char *line);
+bool update_gcode_state(const TGCodeBlockView *block);
+/* Decodes block into the word table the next update_gcode_state() on it will
+ * use, so that it can be looked at first. Returns NULL if out of memory */
+const TGCodeWordTable *load_gcode_words(const TGCodeBlockView *block);
+/* Slot of a word letter in TGCodeWordTable.first, -1 if it isn't one */
+int gcode_letter_slot(char letter);
 /* Returns string pointing at the first non-numeric-value character after the
  * initial pointer value. */
 const char *skip_gcode_digits(const char *string);
+/* Same for block text, where an expression result (GCODE_INPUT_VALUE) may
+ * stand in for the number */
+const char *skip_gcode_number(const char *string);
+/* Splits sanitized text into words the way the word queries below read it:
+ * every letter, '#' and '=' starts a word. words must have room for length
+ * entries. Anything else is skipped, *clean tells whether there was any.
+ * Returns the number of words */
+size_t decode_gcode_words(const char *text, size_t length, TGCodeWord *words,
+                          bool *clean);
+/* Returns true if the parameter assignments among words come in strict #, =
+ * pairs, which is all process_gcode_parameters() looks for in blocks that
+ * come pre-decoded */
+bool paired_gcode_words(const TGCodeWord *words, size_t count);
 /* Read from line and interpret as number transparently handling parameter
- * references; return number */
+ * references and expression results; return number */
 double read_gcode_real(const char *line);
 uint32_t read_gcode_integer(const char *line);
-/* If called with 2 arguments and argc of 0, return true if said word was
- * present in the line.
- * If called with 3 arguments and argc of 1, return true if said word was
- * present in the line and had said argument.
- * If called with more than 3 arguments, return the argument which was
- * found on the line attached to the given word or false if none. A single
- * match is assumed (the first one). If an argument of zero is passed (like
- * when searching for G00 or M00) and found on the line, it will be returned
- * as 100 instead of zero (which would evaluate to false and mis-signal that
- * no match has been found). */
-uint8_t have_gcode_word(char word, uint8_t argc, ...);
+/* Return true if said word was present in the line */
+bool have_gcode_word(char word);
+/* Return true if any of the codes in group was present in the line as the
+ * argument of said word (G or M). The lowest one found is stored in *code,
+ * unless code is NULL */
+bool have_gcode_code(char word, TGCodeCodeMask group, uint8_t *code);
 /* Return the argument of the given word as a real number or NaN if no such
  * word was on the line */
 double get_gcode_word_real(char word);
@@ -318,6 +432,10 @@ bool process_gcode_parameters(void);
 /* Returns true if we are still (or should be) processing the current part
  * program, false if program flow ended and we should exit or reset */
 bool gcode_running(void);
+/* Returns true if a run of plain G0/G1 blocks with literal X, Y, Z and F words
+ * would leave the state the same as their last values in a single block would
+ * (absolute, Cartesian, no radius compensation), see fast_forward_machine() */
+bool collapsible_gcode_state(void);
 
 
 #endif /* GCODE_STATE_H_ */
@@ -0,0 +1,288 @@
+/*
+ ============================================================================
+ Name        : gcode-subprogram.c
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Hot Subprogram Compiler Code
+ ============================================================================
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gcode-commons.h"
+#include "gcode-subprogram.h"
+#include "gcode-debugcon.h"
+#include "gcode-context.h"
+
+
+/* State lives in the calling thread's context, see gcode-context.h */
+#define SUB(x) (gcodeContext->subprogramContext.x)
+
+
+static uint32_t _hash_subprogram(long start) {
+  /* Same mix as the block cache, offsets are just as clustered here */
+  return (uint32_t)(((uint64_t)start * 0x9E3779B97F4A7C15ULL) >> 32) &
+         (SUB(subprogramSlots) - 1);
+}
+
+/* Returns the slot holding start, or the empty slot where it would go */
+static TGCodeSubprogram **_probe_subprogram(long start) {
+  uint32_t slot = _hash_subprogram(start);
+
+  while(SUB(subprograms)[slot] && SUB(subprograms)[slot]->start != start)
+    slot = (slot + 1) & (SUB(subprogramSlots) - 1);
+
+  return &SUB(subprograms)[slot];
+}
+
+static TGCodeSubprogram *_add_subprogram(long start) {
+  TGCodeSubprogram **slot, *subprogram;
+
+  /* Keep the load factor under 1/2 so that probe sequences stay short */
+  if(2 * (SUB(subprogramUsed) + 1) > SUB(subprogramSlots)) {
+    TGCodeSubprogram **old = SUB(subprograms);
+    uint32_t i, oldSlots = SUB(subprogramSlots);
+
+    SUB(subprograms) = (TGCodeSubprogram **)calloc(2 * oldSlots,
+                                                   sizeof(TGCodeSubprogram *));
+    if(!SUB(subprograms)) {
+      SUB(subprograms) = old;
+      return NULL;
+    }
+    SUB(subprogramSlots) = 2 * oldSlots;
+    for(i = 0; i < oldSlots; i++)
+      if(old[i]) *_probe_subprogram(old[i]->start) = old[i];
+    free(old);
+  }
+  if(!(subprogram = (TGCodeSubprogram *)calloc(1, sizeof(TGCodeSubprogram))))
+    return NULL;
+  subprogram->start = start;
+  subprogram->status = GCODE_SUBPROGRAM_COLD;
+  slot = _probe_subprogram(start);
+  *slot = subprogram;
+  SUB(subprogramUsed)++;
+
+  return subprogram;
+}
+
+/* Gives up on the subprogram being recorded, it is never tried again */
+static void _reject_subprogram(void) {
+  GCODE_DEBUG("Subprogram at offset %ld left as text after %u blocks",
+              SUB(recording)->start, SUB(recordCount));
+  SUB(recording)->status = GCODE_SUBPROGRAM_REJECTED;
+  SUB(recording) = NULL;
+  SUB(fetched) = false;
+}
+
+/* Moves what was recorded into the subprogram, pointing the tables at their
+ * own copy of the words */
+static void _finish_subprogram(void) {
+  TGCodeInstruction *code;
+  TGCodeWord *words = NULL;
+  const TGCodeWord *word;
+  uint32_t i;
+  int slot;
+
+  code = (TGCodeInstruction *)malloc(SUB(recordCount) *
+                                     sizeof(TGCodeInstruction));
+  if(SUB(recordWordsUsed))
+    words = (TGCodeWord *)malloc(SUB(recordWordsUsed) * sizeof(TGCodeWord));
+  if(!code || (SUB(recordWordsUsed) && !words)) {
+    free(code);
+    free(words);
+    _reject_subprogram();
+    return;
+  }
+  memcpy(code, SUB(recordCode), SUB(recordCount) * sizeof(TGCodeInstruction));
+  if(SUB(recordWordsUsed))
+    memcpy(words, SUB(recordWords), SUB(recordWordsUsed) * sizeof(TGCodeWord));
+  /* While recording, words and wordsEnd hold where the instruction's words
+   * start and how many there are */
+  for(i = 0; i < SUB(recordCount); i++) {
+    TGCodeWordTable *table = &code[i].table;
+    size_t count = (uintptr_t)table->wordsEnd;
+
+    table->words = &words[(uintptr_t)table->words];
+    table->wordsEnd = &table->words[count];
+    memset(table->first, 0x00, sizeof(table->first));
+    for(word = table->words; word < table->wordsEnd; word++)
+      if((slot = gcode_letter_slot(word->letter)) >= 0 && !table->first[slot])
+        table->first[slot] = word;
+  }
+  SUB(recording)->code = code;
+  SUB(recording)->count = SUB(recordCount);
+  SUB(recording)->words = words;
+  SUB(recording)->status = GCODE_SUBPROGRAM_COMPILED;
+  SUB(subprogramsCompiled)++;
+  GCODE_DEBUG("Subprogram at offset %ld compiled into %u instructions",
+              SUB(recording)->start, SUB(recordCount));
+  SUB(recording) = NULL;
+  SUB(fetched) = false;
+}
+
+bool init_subprogram(void *data) {
+  SUB(hotCalls) = (data ? *(uint32_t *)data : GCODE_SUBPROGRAM_HOT_CALLS);
+  SUB(subprogramSlots) = GCODE_PROGRAM_CAPACITY;
+  SUB(subprograms) = (TGCodeSubprogram **)calloc(SUB(subprogramSlots),
+                                                 sizeof(TGCodeSubprogram *));
+  if(!SUB(subprograms)) {
+    SUB(hotCalls) = SUB(subprogramSlots) = 0;
+    display_machine_message("WAR: No memory for compiling subprograms!");
+    return false;
+  }
+  SUB(subprogramUsed) = SUB(subprogramsCompiled) = 0;
+  SUB(recording) = SUB(running) = NULL;
+  SUB(recordCode) = NULL;
+  SUB(recordWords) = NULL;
+  SUB(recordCount) = SUB(recordRoom) = 0;
+  SUB(recordWordsUsed) = SUB(recordWordsRoom) = 0;
+  SUB(fetched) = false;
+  SUB(cursor) = 0;
+  SUB(instructionsRun) = 0;
+  GCODE_DEBUG("Subprograms compiled after %u calls", SUB(hotCalls));
+
+  return true;
+}
+
+void call_subprogram(long start) {
+  TGCodeSubprogram **slot, *subprogram;
+
+  if(!SUB(hotCalls)) return;
+  slot = _probe_subprogram(start);
+  if(!(subprogram = (*slot ? *slot : _add_subprogram(start)))) return;
+  /* One at a time: calling out of it into text leaves it as text anyway */
+  if(subprogram->status != GCODE_SUBPROGRAM_COLD ||
+     ++subprogram->calls < SUB(hotCalls) || SUB(recording)) return;
+
+  subprogram->status = GCODE_SUBPROGRAM_RECORDING;
+  SUB(recording) = subprogram;
+  SUB(recordNext) = start;
+  SUB(recordCount) = 0;
+  SUB(recordWordsUsed) = 0;
+  SUB(fetched) = false;
+}
+
+const TGCodeInstruction *fetch_subprogram(long offset, bool jumped) {
+  TGCodeSubprogram *subprogram;
+
+  if(!SUB(subprogramsCompiled)) return NULL;
+  if(jumped) {
+    subprogram = *_probe_subprogram(offset);
+    SUB(running) = (subprogram &&
+                    subprogram->status == GCODE_SUBPROGRAM_COMPILED ?
+                    subprogram : NULL);
+    SUB(cursor) = 0;
+  }
+  /* Anything but the next instruction means we left the subprogram */
+  if(!SUB(running) || SUB(cursor) >= SUB(running)->count ||
+     SUB(running)->code[SUB(cursor)].offset != offset) {
+    SUB(running) = NULL;
+    return NULL;
+  }
+  SUB(instructionsRun)++;
+
+  return &SUB(running)->code[SUB(cursor)++];
+}
+
+void fetched_subprogram(long offset, long next, bool cacheable) {
+  if(!SUB(recording)) return;
+  /* Went somewhere else than the next block, or what it found may change */
+  if(offset != SUB(recordNext) || !cacheable) {
+    _reject_subprogram();
+    return;
+  }
+  SUB(fetchedOffset) = offset;
+  SUB(fetchedNext) = next;
+  SUB(fetched) = true;
+}
+
+void record_subprogram(const TGCodeWordTable *table) {
+  TGCodeInstruction *instruction;
+  size_t count;
+
+  /* Spliced blocks (canned cycles) run in between, they are not recorded */
+  if(!SUB(recording) || !SUB(fetched)) return;
+  SUB(fetched) = false;
+  count = table->wordsEnd - table->words;
+  /* Run the same way process_gcode_parameters() runs pre-decoded blocks */
+  if(!table->clean || !paired_gcode_words(table->words, count) ||
+     SUB(recordCount) == GCODE_SUBPROGRAM_INSTRUCTIONS) {
+    _reject_subprogram();
+    return;
+  }
+
+  if(SUB(recordCount) == SUB(recordRoom)) {
+    uint32_t room = (SUB(recordRoom) ?
+                     2 * SUB(recordRoom) : GCODE_PROGRAM_CAPACITY);
+    TGCodeInstruction *grown = (TGCodeInstruction *)realloc(
+        SUB(recordCode), room * sizeof(TGCodeInstruction));
+
+    if(!grown) {
+      _reject_subprogram();
+      return;
+    }
+    SUB(recordCode) = grown;
+    SUB(recordRoom) = room;
+  }
+  if(SUB(recordWordsUsed) + count > SUB(recordWordsRoom)) {
+    size_t room = (SUB(recordWordsRoom) ?
+                   SUB(recordWordsRoom) : GCODE_PROGRAM_CAPACITY);
+    TGCodeWord *grown;
+
+    while(SUB(recordWordsUsed) + count > room) room *= 2;
+    if(!(grown = (TGCodeWord *)realloc(SUB(recordWords),
+                                       room * sizeof(TGCodeWord)))) {
+      _reject_subprogram();
+      return;
+    }
+    SUB(recordWords) = grown;
+    SUB(recordWordsRoom) = room;
+  }
+
+  instruction = &SUB(recordCode)[SUB(recordCount)++];
+  instruction->offset = SUB(fetchedOffset);
+  instruction->next = SUB(recordNext) = SUB(fetchedNext);
+  instruction->table = *table;
+  instruction->table.line = instruction->table.end = "";
+  instruction->table.compiled = true;
+  instruction->table.pending = false;
+  /* Made into pointers once the words stop moving */
+  instruction->table.words =
+      (const TGCodeWord *)(uintptr_t)SUB(recordWordsUsed);
+  instruction->table.wordsEnd = (const TGCodeWord *)(uintptr_t)count;
+  memcpy(&SUB(recordWords)[SUB(recordWordsUsed)], table->words,
+         count * sizeof(TGCodeWord));
+  SUB(recordWordsUsed) += count;
+
+  if(!table->indirectM && (table->M & GCODE_CODE(99))) _finish_subprogram();
+}
+
+bool done_subprogram(void) {
+  uint32_t i;
+
+  GCODE_DEBUG("Subprograms: %u called, %u compiled, %llu instructions run",
+              SUB(subprogramUsed), SUB(subprogramsCompiled),
+              (unsigned long long)SUB(instructionsRun));
+  for(i = 0; i < SUB(subprogramSlots); i++)
+    if(SUB(subprograms)[i]) {
+      free(SUB(subprograms)[i]->code);
+      free(SUB(subprograms)[i]->words);
+      free(SUB(subprograms)[i]);
+    }
+  free(SUB(subprograms));
+  free(SUB(recordCode));
+  free(SUB(recordWords));
+  SUB(subprograms) = NULL;
+  SUB(recordCode) = NULL;
+  SUB(recordWords) = NULL;
+  SUB(subprogramSlots) = SUB(subprogramUsed) = SUB(subprogramsCompiled) = 0;
+  SUB(hotCalls) = 0;
+  SUB(recording) = SUB(running) = NULL;
+
+  return true;
+}
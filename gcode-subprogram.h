@@ -0,0 +1,91 @@
+/*
+ ============================================================================
+ Name        : gcode-subprogram.h
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Hot Subprogram Compiler API Header
+ ============================================================================
+ */
+
+#ifndef GCODE_SUBPROGRAM_H_
+#define GCODE_SUBPROGRAM_H_
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gcode-commons.h"
+#include "gcode-input.h"
+#include "gcode-state.h"
+
+
+/* One block of a compiled subprogram, exactly as update_gcode_state() decodes
+ * it: words (parameter references included, by parameter number) and the G
+ * and M codes it acts upon */
+typedef struct {
+  long offset, next; /* Where its fetch started and left off */
+  TGCodeWordTable table;
+} TGCodeInstruction;
+
+typedef enum {
+  GCODE_SUBPROGRAM_COLD, /* Still counting calls */
+  GCODE_SUBPROGRAM_RECORDING, /* Being compiled as it runs */
+  GCODE_SUBPROGRAM_COMPILED,
+  GCODE_SUBPROGRAM_REJECTED /* Has blocks that must be read as text */
+} TGCodeSubprogramStatus;
+
+typedef struct {
+  long start; /* First block after the O word */
+  uint32_t calls;
+  TGCodeSubprogramStatus status;
+  /* Up to and including the M99, only once compiled */
+  TGCodeInstruction *code;
+  uint32_t count;
+  TGCodeWord *words;
+} TGCodeSubprogram;
+
+typedef struct {
+  uint32_t hotCalls; /* Compiled on this call, 0: never */
+  /* Open addressing hash table keyed by start, entries stay where they are */
+  TGCodeSubprogram **subprograms;
+  uint32_t subprogramSlots, subprogramUsed, subprogramsCompiled;
+  /* The one being compiled, what was fetched for it last and where the next
+   * block of it has to come from */
+  TGCodeSubprogram *recording;
+  TGCodeInstruction *recordCode;
+  uint32_t recordCount, recordRoom;
+  TGCodeWord *recordWords;
+  size_t recordWordsUsed, recordWordsRoom;
+  long recordNext, fetchedOffset, fetchedNext;
+  bool fetched;
+  /* The one being run and its next instruction */
+  TGCodeSubprogram *running;
+  uint32_t cursor;
+  uint64_t instructionsRun;
+} TGCodeSubprogramContext;
+
+
+/* Gets ready to compile subprograms, takes pointer to the number of calls
+ * (uint32_t) after which one is compiled, NULL for GCODE_SUBPROGRAM_HOT_CALLS.
+ * A subprogram is compiled while it runs on that call: if every block it runs
+ * up to its M99 could be served pre-decoded from the block cache, later calls
+ * run from the instructions instead of the text. Without init_subprogram(),
+ * nothing is ever compiled */
+bool init_subprogram(void *data);
+/* The subprogram starting at start (see get_program_input()) is being run,
+ * either called or repeated */
+void call_subprogram(long start);
+/* Next instruction to run if the block at offset is part of a compiled
+ * subprogram, NULL otherwise. jumped tells whether offset is not where the
+ * previous block left off */
+const TGCodeInstruction *fetch_subprogram(long offset, bool jumped);
+/* A block was fetched as text or from the block cache from offset up to next.
+ * cacheable is false if it may read differently next time */
+void fetched_subprogram(long offset, long next, bool cacheable);
+/* The block fetched last was decoded into table and is about to be run */
+void record_subprogram(const TGCodeWordTable *table);
+bool done_subprogram(void);
+
+
+#endif /* GCODE_SUBPROGRAM_H_ */
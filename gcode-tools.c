@@ -15,9 +15,11 @@
 #include "gcode-tools.h"
 #include "gcode-debugcon.h"
 #include "gcode-parameters.h"
+#include "gcode-context.h"
 
 
-static TGCodeTool currentTool;
+/* State lives in the calling thread's context, see gcode-context.h */
+#define TLS(x) (gcodeContext->toolsContext.x)
 
 
 bool init_tools(void *data) {
@@ -30,36 +32,38 @@ bool init_tools(void *data) {
 }
 
 TGCodeTool fetch_tool(uint8_t index) {
-  if(index != currentTool.index) {
-    currentTool.index = index;
-    currentTool.type = fetch_parameter(GCODE_TOOL_TYPE_BASE + index);
-    currentTool.diameter = fetch_parameter(GCODE_TOOL_DIAM_BASE + index);
-    currentTool.length = fetch_parameter(GCODE_TOOL_LEN_BASE + index);
+  if(index != TLS(currentTool).index) {
+    TLS(currentTool).index = index;
+    TLS(currentTool).type = fetch_parameter(GCODE_TOOL_TYPE_BASE + index);
+    TLS(currentTool).diameter = fetch_parameter(GCODE_TOOL_DIAM_BASE + index);
+    TLS(currentTool).length = fetch_parameter(GCODE_TOOL_LEN_BASE + index);
   }
 
-  return currentTool;
+  return TLS(currentTool);
 }
 
 bool update_tool(TGCodeTool tool) {
-  if(tool.index == currentTool.index) currentTool = tool;
+  if(tool.index == TLS(currentTool).index) TLS(currentTool) = tool;
 
-  return set_parameter(GCODE_TOOL_TYPE_BASE + tool.index, currentTool.type) &&
-    set_parameter(GCODE_TOOL_DIAM_BASE + tool.index, currentTool.diameter) &&
-    set_parameter(GCODE_TOOL_LEN_BASE + tool.index, currentTool.length);
+  return set_parameter(GCODE_TOOL_TYPE_BASE + tool.index,
+                       TLS(currentTool).type) &&
+    set_parameter(GCODE_TOOL_DIAM_BASE + tool.index,
+                  TLS(currentTool).diameter) &&
+    set_parameter(GCODE_TOOL_LEN_BASE + tool.index, TLS(currentTool).length);
 }
 
 double radiusof_tool(uint8_t index) {
   if(!index) return 0.0;
-  if(index != currentTool.index)
+  if(index != TLS(currentTool).index)
     return fetch_parameter(GCODE_TOOL_DIAM_BASE + index) / 2.0;
-  else return currentTool.diameter / 2.0;
+  else return TLS(currentTool).diameter / 2.0;
 }
 
 double lengthof_tool(uint8_t index) {
   if(!index) return 0.0;
-  if(index != currentTool.index)
+  if(index != TLS(currentTool).index)
     return fetch_parameter(GCODE_TOOL_LEN_BASE + index);
-  else return currentTool.length;
+  else return TLS(currentTool).length;
 }
 
 bool done_tools(void) {
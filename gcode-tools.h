@@ -38,6 +38,10 @@ typedef struct {
   /* Other/extended information would go here */
 } TGCodeTool;
 
+typedef struct {
+  TGCodeTool currentTool;
+} TGCodeToolContext;
+
 
 /* Initialize the tool engine, takes an opaque pointer to a data store/effector,
  * returns true if all ok */
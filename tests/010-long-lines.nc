@@ -0,0 +1,8 @@
+(testing blocks longer than 255 characters)
+G21 G90 G01 F600
+(MSG,this message is well over two hundred and fifty five characters long, which used to overflow the comment buffer; it goes on and on it goes on and on it goes on and on it goes on and on it goes on and on it goes on and on it goes on and on it goes on and on it goes on and on it goes on and on it goes on and on it goes on and on and ends here)
+G01                                                                                                                                                                                                                                                                                                            X1 (padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding padding ) Y2 (X SHOULD BE 1, Y 2)
+X[1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1] (X SHOULD BE 150)
+G1X3Y4
+N20G1X5Y6
+M02
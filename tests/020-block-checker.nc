@@ -0,0 +1,14 @@
+(testing the block checker, every rejected block is skipped whole)
+G21 G90 G01 F600
+X1 Y1
+X2 X3 (SAME WORD TWICE)
+G00 G01 X4 (TWO MOTION MODES)
+G01 G01 X5 (SAME CODE TWICE)
+G17 G18 (TWO PLANES)
+M03 M04 S1000 (TWO SPINDLE DIRECTIONS)
+G01 X6 Y6 $ (NOT A WORD)
+X7 N70 (LINE NUMBER IN THE MIDDLE)
+G91 G01 X1 Y1 F300 M08 (FINE, DIFFERENT GROUPS)
+#1=5 #2=6 (FINE, ASSIGNMENTS)
+G90 X#1 Y#2
+M02
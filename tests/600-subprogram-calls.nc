@@ -0,0 +1,17 @@
+(testing subprogram calls, programs are defined after their first call)
+G21 G90 G01 F600
+X1 Y1 Z0
+M98 P1000 L2 (X SHOULD STEP TO 2, THEN 3)
+X2 Y2
+M98 P2000 (GOES TO 5,5 THEN STEPS X TO 6)
+X0 Y0
+M02
+
+O1000
+G91 X1
+G90 M99
+
+O2000
+X5 Y5
+M98 P1000
+M99
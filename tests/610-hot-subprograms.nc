@@ -0,0 +1,22 @@
+(testing subprograms run often enough to be compiled, results must not change)
+G21 G90 G17 G01 F600
+X0 Y0 Z0
+#1=1 #3=0 #4=3
+M98 P3000 L10 (STEPS X AND Y BY 1, COMPILED ON THE 8TH RUN)
+#1=-2 (STEPS BACK BY 2 NOW, SAME INSTRUCTIONS)
+M98 P3000 L3
+G90 X0 Y0
+M98 P4000 L9 (DRILLS AT 0,0 FIRST, AT 3,0 FROM THEN ON)
+M98 P4000
+M02
+
+O3000
+G91 X#1
+Y#1 #2=#1
+G90 M99
+
+O4000
+G99 G81 X#3 Y0 Z-1 R1 F300
+#3=#4
+G80 G00 Z5
+M99
@@ -0,0 +1,16 @@
+(testing restarting mid-program, see 620-start-at.args)
+G21 G90 G01 F600
+#1=2
+(MSG,SKIPPED BLOCKS STILL SHOW THEIR MESSAGES)
+N10 X1 Y1
+M00 (NO STOPPING WHILE FAST-FORWARDING)
+G91
+N20 X#1 Y1
+M98 P5000 L3 (STARTS IN THE FIRST REPEAT)
+N30 G90 X0 Y0
+M02
+
+O5000
+N50 X1
+N60 Y#1 #1=[#1+1]
+M99
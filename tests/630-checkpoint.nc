@@ -0,0 +1,19 @@
+(testing checkpoints, see 630-checkpoint.args)
+(the differential run resumes from the first one and must carry on the same)
+G21 G90 G17 G01 F600
+M06 T1
+#1=1 #2=0
+G01 X10 Y10
+G41 Y20 (COMPENSATED MOVE STILL QUEUED AT THE CHECKPOINT)
+M98 P7000 L3
+G40 X0 Y0
+G99 G81 X5 Y5 Z-1 R1 F300
+X#2 M76 (NOT INSIDE THE CYCLE, AFTER IT)
+G80 G00 Z5
+M02
+
+O7000
+G91 X#1
+Y#1 #2=[#2+#1]
+#1=[#1*2] M76 (ONE PER REPEAT, FIRST ONE WITH #1=1)
+G90 M99
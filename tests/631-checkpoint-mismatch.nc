@@ -0,0 +1,5 @@
+(fed the checkpoint 630-checkpoint writes, see 631-checkpoint-mismatch.args)
+(it is for another program, so none of this may run)
+G21 G90 G17 G01 F600
+X10 Y10
+M02
@@ -0,0 +1,20 @@
+(testing dry runs, see 640-dry-run.args)
+G21 G90 G17 G01 F600
+M06 T1
+S1000 M03 M08
+#1=5
+G00 X[0-#1] Y0 Z2
+G01 Z-1
+G02 X#1 Y0 R#1 (ARCS COUNT AS MOVES TOO)
+M00 (ACKNOWLEDGED WITHOUT WAITING)
+M98 P8000 L2
+X1 X2 (REJECTED BLOCKS ARE COUNTED AS ERRORS)
+M09 M05
+M06 T2
+G00 Z10
+(MSG,MESSAGES STILL GO OUT)
+M02
+
+O8000
+G91 G01 Y[#1*2]
+G90 M99
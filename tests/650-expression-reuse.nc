@@ -0,0 +1,12 @@
+(testing expression results reused until a parameter they read changes)
+G21 G90 G01 F600
+#100=0 #101=2 #102=105 #105=1 #106=-1
+M98 P6000 L4 (SAME EXPRESSIONS, ONLY SOME OF THEIR PARAMETERS CHANGE)
+#101=3 (CHANGES WHAT Y READS, NOTHING ELSE)
+M98 P6000 L2
+M02
+
+O6000
+X[#100*2+1.5*2-1] Y[#101*ATAN[1]/[1]/45] Z[#[#102]]
+#100=[#100+1] #102=[211-#102]
+M99
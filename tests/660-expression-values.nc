@@ -0,0 +1,14 @@
+(testing expression results handed over at full precision)
+G21 G90 G01 F600
+#100=[1/3]
+X[#100*30000] (X SHOULD BE 10000, NOT 9999 FROM 0.3333)
+X[#100*3] Y[0.1*3] (Y SHOULD BE 0.30)
+#[100+2]=[7/2]
+X#102 Y-[#100*3] (X SHOULD BE 3.5, Y SHOULD BE -1)
+#[0.57*100]=4 (56.99999999999999 IS PARAMETER 57)
+X#57 Y4 (X SHOULD BE 4)
+XSIN[30] Y2 (THE REST OF THE BLOCK STAYS, Y SHOULD BE 2)
+XATAN[1]/[1] YCOS[0] (X SHOULD BE 45, Y SHOULD BE 1)
+XABS-[3] Y[7] (X SHOULD BE 3, Y SHOULD BE 7)
+X1[2] (NOT A NUMBER, ILLEGAL)
+M02
@@ -5,7 +5,7 @@ counttotal=0
 
 for i in *.result; do
   ((counttotal += 1))
-  outname=$(echo $i | sed -e 's/.result$/.out/g')
+  outname=$(echo $i | sed -e 's/\(.ncb\|.gz\|.ir\|.rs\)\?.result$/.out/g')
   diff $i $outname > /dev/null
   if [ $? -ne 0 ]; then
     echo "Test $(echo $i | sed -e 's/.result$//g') fails!"
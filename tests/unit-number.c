@@ -0,0 +1,115 @@
+/*
+ ============================================================================
+ Name        : unit-number.c
+ Author      : agent
+ Version     : 1.0 (2026-10-16)
+ Copyright   : (C) 2026 agent <agent@local>
+ Description : Numeric Literal Parser Equivalence Check
+ ============================================================================
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gcode-commons.h"
+#include "gcode-state.h"
+
+
+static uint64_t checked, mismatches;
+
+
+/* What read_gcode_real() used to do for every number */
+static double _reference(const char *line) {
+  const char *end = skip_gcode_digits(line);
+  char *theNumber = calloc(end - line + 1, 1);
+  double result;
+
+  strncpy(theNumber, line, end - line);
+  result = strtod(theNumber, (char **)NULL);
+  free(theNumber);
+
+  return result;
+}
+
+/* Bit for bit, so that -0.0 and 0.0 are told apart */
+static void _check(const char *line) {
+  double expected = _reference(line), actual = read_gcode_real(line);
+
+  checked++;
+  if(memcmp(&expected, &actual, sizeof(double))) {
+    if(mismatches++ < 16)
+      printf("MISMATCH,\"%s\",%.17g,%.17g\n", line, expected, actual);
+  }
+}
+
+/* Every digit string of the given length, with the decimal point in every
+ * possible place (or nowhere), with and without a sign. A following word
+ * letter must never be taken for part of the number */
+static void _exhaustive(unsigned int length) {
+  char digits[16], line[32];
+  uint32_t n, limit = 1;
+  unsigned int i, point, sign, at;
+
+  for(i = 0; i < length; i++) limit *= 10;
+  for(n = 0; n < limit; n++) {
+    snprintf(digits, sizeof(digits), "%0*u", (int)length, n);
+    for(point = 0; point <= length + 1; point++)
+      for(sign = 0; sign < 3; sign++) {
+        at = 0;
+        if(sign) line[at++] = (sign == 1 ? '-' : '+');
+        for(i = 0; i < length; i++) {
+          if(point == i + 1) line[at++] = '.';
+          line[at++] = digits[i];
+        }
+        if(point == length + 1) line[at++] = '.';
+        strcpy(&line[at], "E5X");
+        _check(line);
+      }
+  }
+}
+
+/* Long mantissas, big and small exponents, i.e. the slow path */
+static void _random(uint32_t count) {
+  char line[GCODE_REAL_DIGITS * 2];
+  uint32_t n;
+  unsigned int i, length, point;
+
+  srand(42);
+  for(n = 0; n < count; n++) {
+    length = 1 + rand() % (GCODE_REAL_DIGITS + 8);
+    point = rand() % (length + 1);
+    i = 0;
+    if(rand() % 2) line[i++] = '-';
+    for(; length; length--) {
+      if(length == point) line[i++] = '.';
+      /* Plenty of zeros keep the trailing zero logic busy */
+      line[i++] = (rand() % 3 ? '0' + rand() % 10 : '0');
+    }
+    line[i] = '\0';
+    _check(line);
+  }
+}
+
+/* Prints a single CHECK line, see unit-number.out. Fails on any mismatch */
+int main(void) {
+  static const char *special[] = {
+    "", "-", "+", ".", "-.", "+.", "0", "-0", "+0", "0.", "-0.", ".0", "-.0",
+    "000", "-000.000", "X", "-X", "1.2.3", "--1", "9007199254740992",
+    "9007199254740993", "18014398509481985", "9999999999999999999",
+    "10000000000000000000", "0.000000000000000000000001",
+    "1.7976931348623157", "4.9406564584124654", "123456789012345678901234567",
+    "1000000000000000000000000", "0.1", "0.2", "0.3", "-1234.5678", "25.4"
+  };
+  unsigned int i;
+
+  for(i = 0; i < sizeof(special) / sizeof(special[0]); i++) _check(special[i]);
+  for(i = 1; i <= 5; i++) _exhaustive(i);
+  _random(1000000);
+  printf("CHECK,number,%llu literals,%llu mismatches\n",
+         (unsigned long long)checked, (unsigned long long)mismatches);
+
+  return mismatches ? 1 : 0;
+}